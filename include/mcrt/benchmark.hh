@@ -0,0 +1,38 @@
+#ifndef MCRT_BENCHMARK_HH
+#define MCRT_BENCHMARK_HH
+
+#include <vector>
+#include <cstdint>
+#include <iostream>
+
+#include "mcrt/ray.hh"
+#include "mcrt/scene.hh"
+
+namespace mcrt {
+    // Timings of the parts of the ray tracing core on a loaded scene, which are run by
+    // bin/mcrt --benchmark, e.g to compare layouts (or builds) against each other. All
+    // of them are on one thread, and use the same rays, so the numbers are comparable.
+    namespace benchmark {
+        // Primary rays through random pixels of the camera, and then cosine weighted
+        // bounces from where those hit. The same seed always gives the same rays.
+        std::vector<Ray> sampleRays(const Scene&, std::size_t, std::uint64_t = 1);
+
+        // Rays per second for the closest hits, through a virtual call per geometry
+        // (like scenes used to do) and through the scene's primitive batches instead.
+        void intersections(const Scene&, const std::vector<Ray>&, std::ostream& = std::cout);
+
+        // Triangles tested per second (on one core) by each of the SIMD kernels this CPU
+        // can run, against all the triangles of the meshes in the scene (if any).
+        void triangles(const Scene&, const std::vector<Ray>&, std::ostream& = std::cout);
+
+        // Rays per second through the mesh triangles with each layout of their Bvh, after
+        // building it again (and timing that) over a copy of the triangles for each one.
+        void bvh(const Scene&, const std::vector<Ray>&, std::ostream& = std::cout);
+
+        // Rays per second for the camera rays through the centers of the pixels, traced
+        // one at a time, and in the packets of 8x8 pixels the renderer traces them in.
+        void packets(const Scene&, std::ostream& = std::cout);
+    }
+}
+
+#endif
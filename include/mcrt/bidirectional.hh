@@ -0,0 +1,85 @@
+#ifndef MCRT_BIDIRECTIONAL_HH
+#define MCRT_BIDIRECTIONAL_HH
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "mcrt/ray.hh"
+#include "mcrt/film.hh"
+#include "mcrt/image.hh"
+#include "mcrt/scene.hh"
+#include "mcrt/lights.hh"
+#include "mcrt/camera.hh"
+
+namespace mcrt {
+    // Bidirectional path tracer, as described by Veach and later by pbrt. For every
+    // camera path, a light path is started at an area light, and all of the vertex
+    // pairs are connected and weighted by the power heuristic (MIS). Strategies which
+    // hit the camera directly (light tracing) land on some other pixel, and are then
+    // splatted into one of the film's layers, which are averaged over the passes.
+    class BidirectionalTracer {
+    public:
+        BidirectionalTracer(const Scene&, const Image&);
+
+        // Estimated radiance for the camera ray, splatting any light tracing into the layer.
+        glm::dvec3 trace(const Ray&, Film::Splats&) const;
+
+    private:
+        struct Vertex {
+            enum class Type { Camera, Light, Surface };
+            Type type;
+
+            glm::dvec3 position;
+            glm::dvec3 normal; // Zero for the pinhole camera.
+            const Material* material { nullptr };
+            const AreaLight* light { nullptr };
+
+            glm::dvec3 beta; // Path throughput up to here.
+            bool delta { false };
+            double pdfForward { 0.0 }, pdfReverse { 0.0 };
+
+            bool isOnSurface() const { return glm::dot(normal, normal) > 0.0; }
+            bool isConnectible() const { return !delta; }
+        };
+
+        typedef std::vector<Vertex> Path;
+
+        void cameraSubpath(const Ray&, Path&) const;
+        void lightSubpath(Path&) const;
+        void randomWalk(Ray, glm::dvec3, double, Path&, std::size_t) const;
+
+        // Both subpaths are changed by misWeight while it runs, but are restored after.
+        glm::dvec3 connect(Path&, Path&, std::size_t, std::size_t, Film::Splats&) const;
+        double misWeight(Path&, Path&, const Vertex&, std::size_t, std::size_t) const;
+
+        // Light source sampling is proportional to the power of the lights.
+        const AreaLight* chooseLight(double&) const;
+        double lightPdf(const AreaLight*) const;
+        const AreaLight* findLight(const Material*) const;
+        glm::dvec3 emitted(const AreaLight*, const glm::dvec3&) const;
+
+        // BSDF at surface vertex, with the direction towards the previous and the next.
+        glm::dvec3 bsdf(const Vertex&, const glm::dvec3&, const glm::dvec3&) const;
+        double bsdfPdf(const Vertex&, const glm::dvec3&, const glm::dvec3&) const;
+        bool sampleBsdf(const Vertex&, const glm::dvec3&, glm::dvec3&, glm::dvec3&, double&) const;
+
+        // Density of the vertex sampling next, given the previous (area measure).
+        double pdf(const Vertex&, const Vertex*, const Vertex&) const;
+        double pdfLight(const Vertex&, const Vertex&) const;
+        double pdfLightOrigin(const Vertex&) const;
+        double cameraPdf(const glm::dvec3&) const;
+        double convertDensity(const Vertex&, double, const Vertex&) const;
+        double geometry(const Vertex&, const Vertex&) const;
+
+        const Scene& scene;
+        const Camera& camera;
+        const Image& image;
+        std::size_t maxDepth;
+
+        std::vector<const AreaLight*> lights;
+        std::vector<double> lightPower;
+        double totalLightPower { 0.0 };
+    };
+}
+
+#endif
@@ -10,7 +10,8 @@ namespace mcrt {
     public:
         BoundingSphere() = default;
         BoundingSphere(const glm::dvec3&, const double&);
-        Ray::Intersection intersect(const Ray&) const;
+        // Distance to it, 0 if the ray missed.
+        double intersect(const Ray&) const;
 
     private:
         glm::dvec3 _origin;
@@ -0,0 +1,91 @@
+#ifndef MCRT_BVH_HH
+#define MCRT_BVH_HH
+
+#include <limits>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "mcrt/ray.hh"
+#include "mcrt/simd.hh"
+#include "mcrt/precision.hh"
+
+namespace mcrt {
+    // Bounding volume hierarchy over the triangles of a mesh, built as a binary tree by
+    // the surface area heuristic, and then (by default) collapsed into a wide one. Each
+    // wide node has the bounds of its 4 or 8 children side by side, so a ray is tested
+    // against all of them at once, and visits them front to back by the signs of its
+    // direction. Leaves are ranges of triangles, which build puts next to each other,
+    // so they're tested by the SIMD kernels. Transforms only need a refit of the bounds.
+    class Bvh final {
+    public:
+        enum class Layout { BINARY, BVH4, BVH8 };
+
+        static constexpr std::size_t MAX_LEAF { 8 }, MAX_DEPTH { 48 };
+
+        struct Node {
+            float min[3], max[3];
+            // First child (the second is right after it), or first triangle of a leaf.
+            std::uint32_t index;
+            std::uint32_t count; // Triangles in a leaf, 0 if it's an inner node.
+            std::uint32_t axis; // Which it was split along, for the order of the children.
+        };
+
+        template<std::size_t N> struct WideNode {
+            float minX[N], minY[N], minZ[N], maxX[N], maxY[N], maxZ[N];
+            // Wide node of an inner child, or first triangle of a leaf (if count > 0).
+            std::uint32_t child[N], count[N];
+            // For each octant of ray directions, the children front to back, 4 bits each.
+            std::uint32_t order[8];
+        };
+
+        // The best one for the SIMD kernels this CPU has.
+        static Layout getDefaultLayout();
+
+        Bvh(Layout = getDefaultLayout());
+
+        // Returns where each of the triangles have to go, i.e the one which ends up at
+        // position i is at order[i] now. The nodes refer to them by their new places.
+        std::vector<std::uint32_t> build(const simd::Triangles&);
+        // Fits the bounds to the (same) triangles after they've been transformed.
+        void refit(const simd::Triangles&);
+        // Takes the nodes of an earlier build over the same triangles (in the order it
+        // returned), e.g from a cache, instead of building it again. Sets the layout.
+        void assign(std::vector<Node>);
+        void assign(std::vector<WideNode<4>>);
+        void assign(std::vector<WideNode<8>>);
+
+        // Replaces the closest hit if there's one closer, like the SIMD kernels.
+        void intersect(const simd::Triangles&, const Vector3&, const Vector3&, Ray::Hit&) const;
+        // Same for each of the rays in the packet, which is traced as one if it can be.
+        void intersect(const simd::Triangles&, const simd::Packet&, Ray::Hit*) const;
+
+        Layout getLayout() const { return layout; }
+        static const char* getName(Layout);
+        bool isEmpty() const { return binary.empty() && nodes4.empty() && nodes8.empty(); }
+        std::size_t getNodeCount() const;
+        std::size_t getMemoryUsage() const;
+
+        const std::vector<Node>& getNodes() const { return binary; }
+        const std::vector<WideNode<4>>& getNodes4() const { return nodes4; }
+        const std::vector<WideNode<8>>& getNodes8() const { return nodes8; }
+
+        // How far the boxes are tested, i.e a bit past the closest hit so far in floats.
+        static float getLimit(const Ray::Hit& closest) {
+            return closest.distance < std::numeric_limits<float>::max()
+                 ? static_cast<float>(closest.distance) * 1.000001f : std::numeric_limits<float>::max();
+        }
+
+    private:
+        template<std::size_t N> void collapse(std::vector<WideNode<N>>&);
+        template<std::size_t N> void refit(std::vector<WideNode<N>>&, const simd::Triangles&);
+
+        Layout layout;
+        // Kept after the build only for the binary layout.
+        std::vector<Node> binary;
+        std::vector<WideNode<4>> nodes4;
+        std::vector<WideNode<8>> nodes8;
+    };
+}
+
+#endif
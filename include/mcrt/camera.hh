@@ -35,6 +35,13 @@ namespace mcrt {
         // Simpler approach to just take the center of the sampling plane.
         glm::dvec3 getPixelCenter(const Image&, size_t, size_t) const;
 
+        // Projects a point in the scene back to the (continuous) pixel coordinates
+        // of the image, returns false if it isn't seen through the view plane.
+        bool getRasterPosition(const Image&, const glm::dvec3&, glm::dvec2&) const;
+        // Area of the view plane if it was placed a unit distance from the eye.
+        double getUnitViewPlaneArea() const;
+        glm::dvec3 getForward() const;
+
         void moveTo(const glm::dvec3&);
         glm::dvec3 getEyePosition() const;
         glm::dvec3 getViewPlanePosition() const;
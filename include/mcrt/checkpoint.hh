@@ -0,0 +1,48 @@
+#ifndef MCRT_CHECKPOINT_HH
+#define MCRT_CHECKPOINT_HH
+
+#include <future>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace mcrt {
+    // Everything needed to pick a render up again after the last finished pass (or to
+    // continue one which was done, with more passes, i.e as a raw accumulation): the
+    // raw film sums (with the weights, i.e the samples per pixel), the seed for the
+    // generators (which are seeded again for every pass and tile, so that's all the
+    // state they have) and the parameters it was rendered with (as their JSON text).
+    struct Checkpoint {
+        std::uint64_t width { 0 }, height { 0 };
+        std::uint64_t seed { 0 };
+        std::uint64_t nextPass { 0 }, endPass { 0 };
+        std::string parameters;
+        std::vector<double> film; // See Film::pack.
+
+        // "MCRTCKPT" <version> <width> <height> <seed> <next-pass> <end-pass>
+        // <parameter-length> [<char>] <film-length> [<double>]
+        void save(const std::string&) const;
+        static Checkpoint load(const std::string&);
+
+        static constexpr std::uint32_t VERSION { 2 };
+    };
+
+    // Writes the checkpoints on another thread, so the render doesn't have to wait
+    // for the disk. Only one write is in flight, the next one waits for it first.
+    class CheckpointWriter final {
+    public:
+        CheckpointWriter(const std::string& path) : path { path } {  }
+        ~CheckpointWriter() { wait(); }
+
+        void write(Checkpoint&&);
+        void wait();
+
+        const std::string& getPath() const { return path; }
+
+    private:
+        std::string path;
+        std::future<void> pending;
+    };
+}
+
+#endif
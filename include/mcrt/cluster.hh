@@ -0,0 +1,42 @@
+#ifndef MCRT_CLUSTER_HH
+#define MCRT_CLUSTER_HH
+
+#include <string>
+#include <vector>
+
+#include "mcrt/photon.hh"
+
+namespace mcrt {
+    // Processes of a distributed render, by OpenMPI if built with MCRT_MPI, or else
+    // just a single process on its own. Every rank gets the scene from rank 0, then
+    // renders its share of the passes into its own film (with OpenMP), and then the
+    // films are summed back at rank 0 in a binary tree, which writes out the image.
+    class Cluster final {
+    public:
+        Cluster(int&, char**&);
+        ~Cluster();
+
+        Cluster(const Cluster&) = delete;
+        Cluster& operator=(const Cluster&) = delete;
+
+        int getRank() const { return rank; }
+        int getSize() const { return size; }
+        bool isRoot() const { return rank == 0; }
+
+        // Rank 0 sends its data, and it replaces the data of all others.
+        void broadcast(std::string&) const;
+        void broadcast(std::vector<Photon>&) const;
+        // Sums the data of all ranks at rank 0, in log2(size) rounds.
+        void reduce(std::vector<double>&) const;
+        // Smallest of the values of all ranks, which they all get back.
+        std::size_t minimum(std::size_t) const;
+
+        // If there's any point in asking for OPENMPI.
+        static bool isAvailable();
+
+    private:
+        int rank { 0 }, size { 1 };
+    };
+}
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef MCRT_FILM_HH
+#define MCRT_FILM_HH
+
+#include <mutex>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "mcrt/image.hh"
+#include "mcrt/filter.hh"
+
+namespace mcrt {
+    // Accumulates the samples of the render, instead of having the threads write right
+    // into the shared image (a Color<double> is 32 bytes, so rows at the boundaries
+    // between threads would fight over cache lines). The image is split into tiles,
+    // each tile is traced by one thread into its own private buffer, and then merged
+    // into the film when it's done. Samples are weighted, so that they can be spread
+    // over their neighbours later. Splats which can land anywhere in the image (e.g.
+    // light tracing or MLT) go into a separate full-sized layer for each thread.
+    class Film final {
+    public:
+        struct Pixel {
+            glm::dvec3 radiance { 0.0 }; // Weighted sum.
+            double weight { 0.0 };
+        };
+
+        class Tile final {
+        public:
+            Tile(std::size_t, std::size_t, std::size_t, std::size_t, std::size_t);
+
+            // Weighted sample, where (x, y) is in the image, and may be in the padding.
+            void add(std::size_t, std::size_t, const glm::dvec3&, double = 1.0);
+            // Spreads a sample at a raster position over the pixels inside the filter.
+            void splat(const glm::dvec2&, const glm::dvec3&, const Filter&);
+
+            // The pixels this tile is responsible for tracing, excluding padding.
+            std::size_t getX() const { return x; }
+            std::size_t getY() const { return y; }
+            std::size_t getWidth() const { return width; }
+            std::size_t getHeight() const { return height; }
+            std::size_t getSize() const { return width*height; }
+
+        private:
+            friend class Film;
+            std::size_t x, y, width, height, padding;
+            std::size_t bufferWidth, bufferHeight;
+            std::vector<Pixel> pixels;
+        };
+
+        // Unweighted contributions, which are averaged over the passes instead.
+        class Splats final {
+        public:
+            Splats(std::size_t width, std::size_t height)
+                : width { width }, height { height }, pixels(width*height) {  }
+
+            void add(std::size_t x, std::size_t y, const glm::dvec3& radiance) {
+                pixels[y*width + x] += radiance;
+            }
+
+        private:
+            friend class Film;
+            std::size_t width, height;
+            std::vector<glm::dvec3> pixels;
+        };
+
+        Film(std::size_t, std::size_t, std::size_t, std::size_t = 0);
+
+        std::size_t getTileCount() const { return tilesX * tilesY; }
+        Tile getTile(std::size_t) const;
+        // Adds a finished tile to the film, any thread can call this.
+        void merge(const Tile&);
+
+        Splats& getSplats(std::size_t thread) { return splats[thread]; }
+        // The weighted samples of a pixel (without the splats), e.g. to carry them over to
+        // the film of the next frame, where they are added as if they were traced there.
+        const Pixel& getPixel(std::size_t x, std::size_t y) const { return pixels[y*width + x]; }
+        void add(std::size_t x, std::size_t y, const Pixel&);
+
+        // Splats are an estimate of the whole image per pass, so count them.
+        void nextPass() { ++passes; }
+
+        // Resolves into an image with the same size, that's ready for export.
+        void develop(Image&) const;
+        // Same, but as linear RGBA floats, i.e width*height*4 of them.
+        void develop(float*) const;
+
+        // Raw sums of the film (and its pass count) as a flat buffer, which can then
+        // be added to the buffers of other films, e.g. from other processes.
+        std::vector<double> pack() const;
+        void unpack(const std::vector<double>&);
+        // Doubles in the packed buffer of a film with some resolution.
+        static std::size_t getPackedSize(std::size_t width, std::size_t height) { return width*height*7 + 1; }
+
+        std::size_t getWidth() const { return width; }
+        std::size_t getHeight() const { return height; }
+
+        // Small enough for the tile to stay in the cache.
+        static constexpr std::size_t TILE_SIZE { 16 };
+
+    private:
+        glm::dvec3 resolve(std::size_t) const;
+
+        std::size_t width, height, padding;
+        std::size_t tilesX, tilesY;
+        std::size_t passes { 0 };
+        std::vector<Pixel> pixels;
+        std::vector<Splats> splats;
+        std::mutex mergeMutex;
+    };
+}
+
+#endif
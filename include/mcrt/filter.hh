@@ -0,0 +1,54 @@
+#ifndef MCRT_FILTER_HH
+#define MCRT_FILTER_HH
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+namespace mcrt {
+    // Pixel reconstruction filter, which is used to spread each camera sample over the
+    // pixels around it (with the padding of the film tiles), instead of just box one.
+    // All of them are separable, so only a 1-D table is needed for looking them up.
+    class Filter final {
+    public:
+        enum class Type {
+            BOX, GAUSSIAN,
+            MITCHELL,
+            BLACKMAN_HARRIS
+        };
+
+        Filter(Type = Type::BOX, double = 0.5);
+
+        // Weight of a sample at an offset (dx, dy) from the center of the pixel.
+        double weight(double dx, double dy) const {
+            return lookup(dx) * lookup(dy);
+        }
+
+        Type getType() const { return type; }
+        double getRadius() const { return radius; }
+        // How far outside of its pixel a sample can reach, for sizing the tiles.
+        std::size_t getPadding() const;
+
+        static constexpr std::size_t TABLE_SIZE { 64 };
+        // Falloff of the Gaussian and B, C parameters of Mitchell–Netravali.
+        static constexpr double GAUSSIAN_ALPHA { 2.0 };
+        static constexpr double MITCHELL_B { 1.0 / 3.0 }, MITCHELL_C { 1.0 / 3.0 };
+
+    private:
+        double lookup(double x) const {
+            // Samples right on the radius still count, e.g. the grid pattern's.
+            x = std::abs(x) * inverseRadius;
+            if (x > 1.0) return 0.0;
+            std::size_t i = x * TABLE_SIZE;
+            return table[std::min(i, TABLE_SIZE - 1)];
+        }
+
+        double evaluate(double) const;
+
+        Type type;
+        double radius, inverseRadius;
+        std::vector<double> table;
+    };
+}
+
+#endif
@@ -13,7 +13,14 @@ namespace mcrt {
 
     public:
         virtual ~Geometry() = default;
-        virtual Ray::Intersection intersect(const Ray& ray) const = 0;
+        // Cheap test of where the ray hits, without the normal or anything else.
+        virtual Ray::Hit hit(const Ray&) const = 0;
+        // The rest of the intersection, for a hit that came from this geometry.
+        virtual Ray::Intersection interact(const Ray&, const Ray::Hit&) const = 0;
+        // Both at once, with a distance of 0 if it missed.
+        Ray::Intersection intersect(const Ray&) const;
+        // Fits the bounds again after it was transformed, if there are any.
+        virtual void refit() {  }
 
         Material* getMaterial() const;
     };
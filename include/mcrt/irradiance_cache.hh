@@ -0,0 +1,90 @@
+#ifndef MCRT_IRRADIANCE_CACHE_HH
+#define MCRT_IRRADIANCE_CACHE_HH
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <glm/glm.hpp>
+
+namespace mcrt {
+    // Ward-style irradiance cache. Records are sparse irradiance samples with their
+    // gradients, and are interpolated for any shading points that are close enough.
+    // Stored in an octree where every node has an atomic list of records, so threads
+    // can both look up and insert new records concurrently without a global lock.
+    class IrradianceCache final {
+    public:
+        struct Record {
+            glm::dvec3 position;
+            glm::dvec3 normal;
+            glm::dvec3 irradiance;
+            // Gradients for the r, g and b channels by Ward & Heckbert.
+            glm::dvec3 rotationalGradient[3];
+            glm::dvec3 translationalGradient[3];
+            double harmonicDistance; // i.e the R_i.
+        };
+
+        IrradianceCache() = default;
+        // Octree spans the cube at center with the half size, the error is the 'a'.
+        IrradianceCache(const glm::dvec3&, double, double);
+
+        ~IrradianceCache() { clear(); }
+
+        IrradianceCache(const IrradianceCache&) = delete;
+        IrradianceCache& operator=(const IrradianceCache&) = delete;
+
+        IrradianceCache(IrradianceCache&& other) {
+            *this = std::move(other);
+        }
+
+        IrradianceCache& operator=(IrradianceCache&& other) {
+            clear();
+            root = other.root;
+            error = other.error;
+            records.store(other.records.load());
+            other.root = nullptr;
+            other.records = 0;
+            return *this;
+        }
+
+        // Weighted average of all valid records, false if there weren't any.
+        bool interpolate(const glm::dvec3&, const glm::dvec3&, glm::dvec3&) const;
+        void insert(const Record&);
+
+        bool isEnabled() const { return root != nullptr; }
+        std::size_t size() const { return records; }
+        double getHalfSize() const;
+
+        static constexpr std::size_t MAX_DEPTH { 24 };
+
+    private:
+        struct Entry {
+            Record record;
+            Entry* next;
+        };
+
+        struct Node {
+            Node(const glm::dvec3& center, double halfSize)
+                : center { center }, halfSize { halfSize } {
+                for (auto& child : children) child = nullptr;
+            }
+
+            ~Node();
+
+            glm::dvec3 center;
+            double halfSize;
+            std::atomic<Node*> children[8];
+            std::atomic<Entry*> entries { nullptr };
+        };
+
+        // Weight of a record at the point, as given by Ward et al.
+        double weight(const Record&, const glm::dvec3&, const glm::dvec3&) const;
+        Node* child(Node*, std::size_t) const;
+        void clear();
+
+        Node* root { nullptr };
+        double error { 0.2 };
+        std::atomic<std::size_t> records { 0 };
+    };
+}
+
+#endif
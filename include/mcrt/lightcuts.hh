@@ -0,0 +1,72 @@
+#ifndef MCRT_LIGHTCUTS_HH
+#define MCRT_LIGHTCUTS_HH
+
+#include <random>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "mcrt/ray.hh"
+#include "mcrt/material.hh"
+
+namespace mcrt {
+    class Scene;
+
+    // Instant radiosity point light, left behind on a diffuse surface by some light path.
+    struct VirtualLight {
+        glm::dvec3 position;
+        glm::dvec3 normal; // Points to the side the light came from.
+        glm::dvec3 incoming;
+        glm::dvec3 flux;
+        const Material* material;
+    };
+
+    // Lightcuts by Walter et al. The virtual lights are clustered in a binary tree,
+    // where each cluster is shaded by only one representative light, scaled by the
+    // cluster's total intensity. For every shading point we find a cut through the
+    // tree, refining the clusters with the largest error bound until all of them are
+    // below some fraction of the total, so only a logarithmic amount is evaluated.
+    class LightTree final {
+    public:
+        LightTree() = default;
+        LightTree(const std::vector<VirtualLight>&, double);
+
+        // Reflected radiance from all of the virtual lights seen from the ray. The error
+        // is relative to the total, so any other known radiance (direct) can be added.
+        glm::dvec3 radiance(const Ray&, const Ray::Intersection&, const Scene&,
+                            const glm::dvec3& = glm::dvec3 { 0.0 }) const;
+
+        bool isEnabled() const { return !nodes.empty(); }
+        std::size_t size() const { return lights.size(); }
+
+        // Clamps the geometry term, else we get spikes close to the lights.
+        // Relative to the size of the scene, i.e the bounds of the lights.
+        static constexpr double CLAMP_RATIO { 0.025 };
+        static constexpr std::size_t MAX_CUT { 1000 };
+
+    private:
+        struct Node {
+            glm::dvec3 minimum, maximum;
+            glm::dvec3 intensity; // Summed flux times the max albedo over pi.
+            glm::dvec3 axis; // Cone bounding the normals of the lights.
+            double coneAngle;
+            std::size_t representative;
+            int left { -1 }, right { -1 };
+            bool isLeaf() const { return left < 0; }
+        };
+
+        int build(std::size_t, std::size_t, std::mt19937&);
+        glm::dvec3 contribution(const VirtualLight&, const glm::dvec3&, const glm::dvec3&,
+                                const Ray::Intersection&, const Scene&) const;
+        glm::dvec3 estimate(const Node&, const glm::dvec3&) const;
+        double errorBound(const Node&, const glm::dvec3&, const glm::dvec3&, const Material*) const;
+
+        std::vector<VirtualLight> lights;
+        std::vector<glm::dvec3> intensities; // Of each leaf, by its light.
+        std::vector<Node> nodes;
+        double error { 0.02 };
+        double orientationScale { 1.0 };
+        double minimumDistance { 0.1 };
+    };
+}
+
+#endif
@@ -20,7 +20,11 @@ namespace mcrt {
         Material* material;
         double intensity;
         virtual glm::dvec3 radiance(const Ray&, const Ray::Intersection&, const Scene*) = 0;
-        virtual Ray::Intersection intersect(const Ray&) const = 0;
+        // Same as with Geometry, the rest only for the closest hit.
+        virtual Ray::Hit hit(const Ray&) const = 0;
+        virtual Ray::Intersection interact(const Ray&, const Ray::Hit&) const = 0;
+        // Works out what follows from its shape again after it was edited, if anything.
+        virtual void refit() {  }
     };
 
     struct PointLight : public Light {
@@ -29,8 +33,9 @@ namespace mcrt {
         glm::dvec3 origin;
 
         glm::dvec3 radiance(const Ray&, const Ray::Intersection&, const Scene*) override;
-        Ray::Intersection intersect(const Ray&) const override;
-   
+        Ray::Hit hit(const Ray&) const override;
+        Ray::Intersection interact(const Ray&, const Ray::Hit&) const override;
+
     };
 
     struct AreaLight : public Light {
@@ -39,14 +44,18 @@ namespace mcrt {
         glm::dvec3 v0;
         glm::dvec3 v1;
         glm::dvec3 v2;
+        // These follow the corners, so they have to be refit after those are moved.
         glm::dvec3 normal;
+        glm::dvec3 e1, e2; // From v0, for the intersections.
         double area;
         static size_t shadowRayCount;
 
         glm::dvec3 sample() const;
         glm::dvec3 sampleHemisphere() const;
         glm::dvec3 radiance(const Ray&, const Ray::Intersection&, const Scene*) override;
-        Ray::Intersection intersect(const Ray&) const override;        
+        Ray::Hit hit(const Ray&) const override;
+        Ray::Intersection interact(const Ray&, const Ray::Hit&) const override;
+        void refit() override;
     };
 }
 
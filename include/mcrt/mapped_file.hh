@@ -0,0 +1,31 @@
+#ifndef MCRT_MAPPED_FILE_HH
+#define MCRT_MAPPED_FILE_HH
+
+#include <string>
+#include <cstddef>
+
+namespace mcrt {
+    // Read-only view of a whole file, which is mapped into memory, so that it's only
+    // paged in when touched (and by the threads which touch it), instead of copied
+    // into a buffer first. Windows just reads the file into memory instead for now.
+    class MappedFile final {
+    public:
+        MappedFile(const std::string&);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const char* getData() const { return data; }
+        std::size_t getSize() const { return size; }
+
+    private:
+        const char* data { nullptr };
+        std::size_t size { 0 };
+#ifdef WINDOWS
+        std::string contents;
+#endif
+    };
+}
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef MCRT_MCRT_H
+#define MCRT_MCRT_H
+
+/* Thin C interface to mcrt::Renderer, for embedding it without any of the C++ ABI.
+ * Every call which can fail returns zero when it went fine, or else non-zero, and
+ * then the reason is in mcrt_error (until the next call with the same renderer):
+ *
+ *     mcrt_renderer* renderer = mcrt_create();
+ *     if (mcrt_load_scene(renderer, "share/scene.json") ||
+ *         mcrt_load_parameters(renderer, "share/param.json")) puts(mcrt_error(renderer));
+ *     float* rgba = malloc(mcrt_width(renderer) * mcrt_height(renderer) * 4 * sizeof(float));
+ *     mcrt_render(renderer, 16, rgba, NULL, NULL);
+ *     mcrt_destroy(renderer);
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mcrt_renderer mcrt_renderer;
+/* After every pass, with the passes done by the call and how many it does. */
+typedef void (*mcrt_progress)(size_t pass, size_t passes, void* user);
+
+mcrt_renderer* mcrt_create(void);
+void mcrt_destroy(mcrt_renderer*);
+const char* mcrt_error(const mcrt_renderer*);
+
+int mcrt_load_scene(mcrt_renderer*, const char* path);
+/* From a file, or from the JSON itself, both start over with a new film. */
+int mcrt_load_parameters(mcrt_renderer*, const char* path);
+int mcrt_set_parameters(mcrt_renderer*, const char* json);
+size_t mcrt_width(const mcrt_renderer*);
+size_t mcrt_height(const mcrt_renderer*);
+
+/* Adds passes to the film, and then writes the average of all of them as linear
+ * RGBA floats to the buffer (if not NULL), which has to fit width*height*4. */
+int mcrt_render(mcrt_renderer*, size_t passes, float* rgba,
+                mcrt_progress progress, void* user);
+/* Throws the film away, e.g after the scene has been changed by the caller. */
+int mcrt_reset(mcrt_renderer*);
+/* Scaled as in the parameters, to any of the supported image formats. */
+int mcrt_save(mcrt_renderer*, const char* path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
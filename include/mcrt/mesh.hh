@@ -4,18 +4,29 @@
 #include <vector>
 #include <glm/glm.hpp>
 
+#include "mcrt/bvh.hh"
 #include "mcrt/ray.hh"
+#include "mcrt/simd.hh"
 #include "mcrt/geometry.hh"
-#include "mcrt/sphere.hh"
-#include "mcrt/mesh_triangle.hh"
+#include "mcrt/precision.hh"
+#include "mcrt/mesh_data.hh"
 #include "mcrt/bounding_sphere.hh"
 
 namespace mcrt {
+    // Triangles sharing their vertices by indices (as they come from the importer). The
+    // intersection loop doesn't look them up though, it streams through the corners of
+    // every triangle in order instead, which are copied out into separate arrays for
+    // each coordinate, next to the normal of each triangle for interact. Those (and the
+    // bounds) follow the vertices in updateBoundingSphere.
+    // They're in the order of a Bvh over them, and its leaves are tested many triangles
+    // at a time by the SIMD kernels, see bvh.hh and simd.hh.
     class Mesh : public Geometry {
     public:
         Mesh();
-        ~Mesh() { for (auto t : _triangles) delete t; }
         Mesh(Material*);
+        Mesh(MeshData&&, Material*);
+        // With the hierarchy of an earlier build over the same data, e.g from MeshCache.
+        Mesh(MeshData&&, Bvh&&, Material*);
 
         void move(glm::dvec3);
         void scale(const double&);
@@ -24,20 +35,38 @@ namespace mcrt {
         void rotateZ(const double&);
 
         void updateBoundingSphere();
+        void refit() override { updateBoundingSphere(); }
 
         void setMaterial(Material*);
-        void addTriangle(MeshTriangle*);
-        void addTriangle(const glm::dvec3&, const glm::dvec3&, const glm::dvec3&,
-                         const glm::dvec3&, const glm::dvec3&, const glm::dvec3&);
-        std::vector<MeshTriangle*> getTriangles() const;
+        const MeshData& getData() const { return _data; }
+        std::size_t getTriangleCount() const { return _data.getTriangleCount(); }
+        simd::Triangles getTriangles() const;
+        const Bvh& getBvh() const { return _bvh; }
+        // Everything it keeps around, in bytes.
+        std::size_t getMemoryUsage() const;
 
-        Ray::Intersection intersect(const Ray&) const override;
+        // The index of a hit is the triangle, see getData for its vertices.
+        Ray::Hit hit(const Ray&) const override;
+        // Only hits closer than the distance, which leaves more of the hierarchy out.
+        Ray::Hit hit(const Ray&, double) const;
+        // For many rays at once, which replaces their hits if it has closer ones.
+        void hit(const Ray*, std::size_t, Ray::Hit*) const;
+        Ray::Intersection interact(const Ray&, const Ray::Hit&) const override;
 
         void print();
 
     private:
-        std::vector<MeshTriangle*> _triangles;
+        void rotate(const glm::dvec3&, double);
+        void updateTriangles();
+        void updateSphere();
+
+        MeshData _data;
+        // Corner k of triangle t is at (_x[k][t], _y[k][t], _z[k][t]), padded by zeros.
+        std::vector<float> _x[3], _y[3], _z[3];
+        // Unit normal of triangle t, in the same order, so the hits don't work it out.
+        std::vector<float> _nx, _ny, _nz;
         BoundingSphere _bound;
+        Bvh _bvh;
     };
 }
 
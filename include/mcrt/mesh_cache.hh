@@ -0,0 +1,38 @@
+#ifndef MCRT_MESH_CACHE_HH
+#define MCRT_MESH_CACHE_HH
+
+#include <string>
+#include <cstdint>
+
+#include "mcrt/bvh.hh"
+#include "mcrt/mesh_data.hh"
+
+namespace mcrt {
+    // Binary copy of a parsed mesh file, which is just mapped and copied out in later
+    // runs, instead of parsing all of the text again. It's only used while the mesh
+    // file is still the same, by its size and time, or else by the hash of its bytes
+    // (e.g when it was only touched). The indices are in the order of the mesh's Bvh,
+    // which is saved too (flags are its layout), so it doesn't have to be built again.
+    //
+    // "MCRTMESH" <version> <flags> <source-size> <source-time> <source-hash>
+    // <vertices> <indices> <bvh-nodes> [<float>*3] [<uint32>] [<node>]
+    class MeshCache final {
+    public:
+        // False if there isn't any cache, if it's from another version or file, or if it
+        // has counts, indices or nodes out of bounds (i.e it's corrupted), so it's parsed
+        // again. The hierarchy is only loaded if it has the same layout as the one given,
+        // or else it's left as it is, and has to be built again (e.g on some other CPU).
+        static bool load(const std::string& cache, const std::string& source, MeshData&, Bvh&);
+        static void save(const std::string& cache, const std::string& source, const MeshData&, const Bvh&);
+
+        // Next to the mesh file itself, e.g teapot.obj.mesh.
+        static std::string getPath(const std::string& source) { return source + ".mesh"; }
+
+        // Not cryptographic, it only has to tell edited files apart (and be fast).
+        static std::uint64_t hash(const char*, std::size_t);
+
+        static constexpr std::uint32_t VERSION { 3 };
+    };
+}
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef MCRT_MESH_DATA_HH
+#define MCRT_MESH_DATA_HH
+
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+namespace mcrt {
+    // Indexed triangles, as they come out of the mesh files. Each vertex is only its
+    // position (the triangles are flat shaded), and each triangle is three indices into
+    // the vertices. Floats are enough for the assets (and half of the memory), which
+    // are huge.
+    struct MeshData {
+        std::vector<glm::vec3> positions;
+        std::vector<std::uint32_t> indices;
+
+        std::size_t getVertexCount() const { return positions.size(); }
+        std::size_t getTriangleCount() const { return indices.size() / 3; }
+    };
+}
+
+#endif
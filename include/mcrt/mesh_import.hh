@@ -7,6 +7,7 @@
 
 #include "mcrt/triangle.hh"
 #include "mcrt/mesh.hh"
+#include "mcrt/mesh_data.hh"
 
 namespace mcrt {
     class MeshImporter {
@@ -14,6 +15,10 @@ namespace mcrt {
         static Mesh* load(std::string);
         static void setMaterial(Material*);
 
+        // Wavefront OBJ, with only the positions and faces (polygons become fans of
+        // triangles). The file is mapped and parsed by all threads, in chunks.
+        static MeshData parse(const std::string&);
+
     private:
         static Material* _material;
     };
@@ -0,0 +1,92 @@
+#ifndef MCRT_METROPOLIS_HH
+#define MCRT_METROPOLIS_HH
+
+#include <random>
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+#include "mcrt/film.hh"
+#include "mcrt/image.hh"
+#include "mcrt/scene.hh"
+#include "mcrt/sampling.hh"
+
+namespace mcrt {
+    // Primary sample space MLT by Kelemen et al. Instead of mutating the paths, the
+    // chains mutate the random numbers which rayTrace consumes (by a sampling::Stream)
+    // so it works right on top of the existing path tracer. Many independent chains
+    // are run in parallel. These are started from a set of bootstrap paths, which are
+    // also used to find the image brightness, since MLT only gives the distribution.
+    class MetropolisTracer {
+    public:
+        MetropolisTracer(const Scene&, const Image&, std::size_t, double);
+
+        // Traces the bootstrap paths, finds the brightness and starts the chains.
+        // The seed is for independent renders, e.g. on the other cluster ranks.
+        void bootstrap(std::size_t, bool, std::uint64_t = 0);
+        // Mutates all chains, splatting into the film. Each call of it has the same
+        // brightness as adding one rayTrace sample per pixel, so it's one film pass.
+        void render(std::size_t, Film&, bool);
+
+        double getBrightness() const { return brightness; }
+
+        // Standard deviation of the small step mutations.
+        static constexpr double MUTATION_SIGMA { 0.01 };
+
+    private:
+        // The primary samples are lazily created and mutated when rayTrace
+        // asks for them, and restored if the mutation gets rejected later.
+        class PrimarySamples final : public sampling::Stream {
+        public:
+            PrimarySamples(std::uint64_t seed, double largeStepProbability)
+                : generator { seed }, largeStepProbability { largeStepProbability } {  }
+
+            void startIteration();
+            // Fresh samples have nothing to mutate from, so they need a large step.
+            void startLargeStep();
+            void accept();
+            void reject();
+            double next() override;
+
+        private:
+            struct Sample {
+                double value { 0.0 }, backupValue { 0.0 };
+                std::int64_t lastModified { 0 }, backupModified { 0 };
+            };
+
+            void mutate(Sample&);
+
+            std::mt19937_64 generator;
+            std::uniform_real_distribution<double> uniform { 0.0, 1.0 };
+            std::normal_distribution<double> normal { 0.0, 1.0 };
+
+            std::vector<Sample> samples;
+            std::size_t index { 0 };
+            double largeStepProbability;
+            bool largeStep { true };
+            std::int64_t iteration { 0 }, lastLargeStep { 0 };
+        };
+
+        struct Chain {
+            PrimarySamples samples;
+            std::mt19937_64 generator;
+            glm::dvec2 raster;
+            glm::dvec3 radiance;
+            double contribution;
+        };
+
+        glm::dvec3 evaluate(PrimarySamples&, glm::dvec2&) const;
+        static double contribution(const glm::dvec3&);
+        void splat(Film::Splats&, const glm::dvec2&, const glm::dvec3&) const;
+
+        const Scene& scene;
+        const Image& image;
+        std::size_t chainCount;
+        double largeStepProbability;
+
+        double brightness { 0.0 };
+        std::vector<Chain> chains;
+    };
+}
+
+#endif
@@ -9,6 +9,7 @@ namespace mcrt {
     class ParameterImporter {
     public:
         static Parameters load(const std::string&);
+        static Parameters parse(const std::string&);
     };
 }
 
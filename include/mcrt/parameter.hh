@@ -1,9 +1,11 @@
 #ifndef MCRT_PARAMETER_HH
 #define MCRT_PARAMETER_HH
 
+#include <cstdint>
 #include <iostream>
 
 #include "mcrt/supersample.hh"
+#include "mcrt/filter.hh"
 
 namespace mcrt {
     struct Parameters {
@@ -11,22 +13,48 @@ namespace mcrt {
             NONE, OPENMP, OPENMPI
         };
 
+        enum class Integrator {
+            PATH, BIDIRECTIONAL, METROPOLIS
+        };
+
         ParallelFramework parallelFramework { ParallelFramework::NONE };
+        Integrator integrator { Integrator::PATH };
         size_t resolutionWidth { 256 }, resolutionHeight { 256 };
         double scalingFactorX  { 1.0 }, scalingFactorY   { 1.0 };
         Image::ResizeMethod interpolationMethod { Image::ResizeMethod::BILINEAR };
         Supersampler::Pattern samplingPattern { Supersampler::Pattern::GRID };
         size_t samplesPerPixel { 49 };
+        Filter::Type filterType { Filter::Type::BOX };
+        double filterRadius { 0.5 };
         size_t maxRayDepth { 7 };
         size_t shadowRayCount { 1 };
         double photonEstimationRadius { 0.1 };
         size_t photonAmount { 1000000 };
         bool photonMap { false };
+        bool globalPhotonMap { false };
+        size_t globalPhotonAmount { 200000 };
+        double globalEstimationRadius { 0.5 };
         bool progressiveRendering { true };
         bool recordStatistics { false };
         bool photonMapVisualize { false };
+        bool irradianceCache { false };
+        double irradianceCacheError { 0.2 };
+        size_t finalGatherRays { 64 };
+        bool virtualLights { false };
+        size_t virtualLightPaths { 10000 };
+        double lightcutError { 0.02 };
+        bool restir { false };
+        size_t restirCandidates { 32 };
+        size_t restirNeighbours { 5 };
+        double restirRadius { 10.0 };
+        size_t metropolisBootstrap { 100000 };
+        size_t metropolisChains { 256 };
+        double largeStepProbability { 0.3 };
+        std::uint64_t seed { 0 }; // i.e random.
+        double checkpointInterval { 0.0 };
+        size_t temporalSamples { 0 }; // i.e none reused.
 
-        void writeStatistics(const std::string&, double);
+        void writeStatistics(const std::string&, double) const;
     };
 
 }
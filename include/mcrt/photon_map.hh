@@ -2,6 +2,7 @@
 #define MCRT_PHOTON_MAP_HH
 
 #include <vector>
+#include <utility>
 #include <iostream>
 
 #include "mcrt/photon.hh"
@@ -25,14 +26,14 @@ namespace mcrt {
 
         PhotonMap(PhotonMap&& photonMap) {
             rebalanced = photonMap.rebalanced;
-            photons = photonMap.photons;
+            photons = std::move(photonMap.photons); // Keeps k-d pointers valid.
             root = photonMap.root;
             photonMap.root = nullptr;
         }
 
         PhotonMap& operator=(PhotonMap&& photonMap) {
             rebalanced = photonMap.rebalanced;
-            photons = photonMap.photons;
+            photons = std::move(photonMap.photons); // Keeps k-d pointers valid.
             root = photonMap.root;
             photonMap.root = nullptr;
             return *this;
@@ -47,6 +48,7 @@ namespace mcrt {
         void print(std::ostream&, const std::vector<const Photon*>&) const;
 
         bool isBalanced() const { return rebalanced; }
+        const std::vector<Photon>& getPhotons() const { return photons; }
         std::vector<const Photon*> around(const glm::dvec3&, double) const;
 
     private:
@@ -0,0 +1,24 @@
+#ifndef MCRT_PRECISION_HH
+#define MCRT_PRECISION_HH
+
+#include <glm/glm.hpp>
+
+namespace mcrt {
+    // Scalar of the intersection core (the primitive batches and the meshes), which is
+    // float when built with premake5 gmake --single-precision, and double by default.
+    // That's half the memory and twice the SIMD lanes, but hits are only as precise as
+    // it, so rays leave surfaces by Ray::offset. Everything else (the shading, lights,
+    // cameras and the film) stays in double, it's not where the time goes anyway.
+#ifdef MCRT_SINGLE_PRECISION
+    typedef float Real;
+#else
+    typedef double Real;
+#endif
+
+    typedef glm::vec<3, Real> Vector3;
+
+    // For the benchmarks, to tell the builds apart.
+    constexpr const char* PRECISION { sizeof(Real) == sizeof(float) ? "float" : "double" };
+}
+
+#endif
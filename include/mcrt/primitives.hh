@@ -0,0 +1,66 @@
+#ifndef MCRT_PRIMITIVES_HH
+#define MCRT_PRIMITIVES_HH
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "mcrt/ray.hh"
+#include "mcrt/mesh.hh"
+#include "mcrt/sphere.hh"
+#include "mcrt/geometry.hh"
+#include "mcrt/triangle.hh"
+#include "mcrt/precision.hh"
+
+namespace mcrt {
+    // The geometries of a scene sorted by their type, each into plain arrays of their
+    // own, so that intersecting them is a tight loop per type (without a virtual call
+    // and a whole Ray::Intersection for each one), and only the closest hit is filled
+    // in at the end. Geometry is still what the importer makes and the scene owns, so
+    // this has to be built again when they change. Unknown types are still virtual.
+    // The arrays (and the tests) are in Real, the hits that come out are in double.
+    class Primitives final {
+    public:
+        void build(const std::vector<Geometry*>&);
+        void add(const Geometry*);
+        void clear();
+
+        // Closest hit in front of the ray, or the max distance (and no material) if none.
+        Ray::Intersection intersect(const Ray&) const;
+        // Same for many rays, e.g camera rays, where the meshes trace packets of them.
+        void intersect(const Ray*, std::size_t, Ray::Intersection*) const;
+        // Distance to the closest hit which isn't refractive, or the max if none.
+        double occlusion(const Ray&) const;
+
+        std::size_t getSphereCount() const { return sphereRadii.size(); }
+        std::size_t getTriangleCount() const { return triangleMaterials.size(); }
+        std::size_t getMeshCount() const { return meshes.size(); }
+        std::size_t getOtherCount() const { return others.size(); }
+
+    private:
+        // Which batch (and which one in it) the closest hit is, so far.
+        struct Hit {
+            enum class Type { NONE, SPHERE, TRIANGLE, MESH, OTHER } type { Type::NONE };
+            std::size_t index { 0 };
+            double distance;
+            Ray::Hit surface; // Only for meshes and others, e.g which triangle.
+        };
+
+        template<typename Accept> Hit closest(const Ray&, const Accept&) const;
+        // The spheres and triangles, and then the others, which come before and after the meshes.
+        template<typename Accept> void closestShapes(const Ray&, const Accept&, Hit&) const;
+        template<typename Accept> void closestOthers(const Ray&, const Accept&, Hit&) const;
+        Ray::Intersection interact(const Ray&, const Hit&) const;
+
+        std::vector<Vector3> sphereOrigins;
+        std::vector<Real> sphereRadii;
+        std::vector<Material*> sphereMaterials;
+
+        std::vector<Vector3> triangleVertices, triangleEdges1, triangleEdges2;
+        std::vector<Material*> triangleMaterials;
+
+        std::vector<const Mesh*> meshes;
+        std::vector<const Geometry*> others;
+    };
+}
+
+#endif
@@ -2,6 +2,7 @@
 #define MCRT_RAY_HH
 
 #include <cmath>
+#include <algorithm>
 #include <vector>
 #include <limits>
 #include <random>
@@ -9,11 +10,24 @@
 #include <glm/glm.hpp>
 
 #include "mcrt/material.hh"
+#include "mcrt/precision.hh"
 
 namespace mcrt {
     struct Ray {
-        // Used for e.g. offsetting ray fr. surf.
+        // Below this a ray is parallel to a triangle.
         static constexpr double EPSILON { 1e-8 };
+        // How far rays leave surfaces, relative to how far from the origin they are,
+        // since that's how big the rounding errors of the hit positions are too. Those
+        // are a lot bigger with a float core, see precision.hh.
+        static constexpr double OFFSET { sizeof(Real) == sizeof(float) ? 1e-5 : 1e-8 };
+
+        // Moves a hit position off its surface, along the normal to the side which the
+        // new ray leaves in, so it can't hit the same surface again, even at grazing
+        // angles (where moving along the direction barely gets away from it).
+        static glm::dvec3 offset(const glm::dvec3&, const glm::dvec3&, const glm::dvec3&);
+        // Same, for points which aren't on a surface we know the normal of.
+        static glm::dvec3 offset(const glm::dvec3&, const glm::dvec3&);
+        static double getOffset(const glm::dvec3&);
 
         struct Intersection {
             double distance; // Distance to the surface's point.
@@ -24,6 +38,15 @@ namespace mcrt {
             glm::dvec3 position; // Surface point position.
         };
 
+        // Only how far away a hit is (0 if it missed) and where on the surface, e.g in
+        // which triangle of a mesh, at which barycentrics. That's enough to find which
+        // one is closest, and then only that one becomes an Intersection.
+        struct Hit {
+            double distance { 0.0 };
+            std::size_t index { 0 };
+            double u { 0.0 }, v { 0.0 };
+        };
+
         double fresnel(const glm::dvec3&, const double) const;
         Ray reflect(const glm::dvec3&, const glm::dvec3&) const;
         // Special case of reflect where we are inside our surface.
@@ -35,6 +58,21 @@ namespace mcrt {
     };
 }
 
+inline double mcrt::Ray::getOffset(const glm::dvec3& position) {
+    glm::dvec3 magnitude { glm::abs(position) };
+    return OFFSET * std::max(1.0, std::max(magnitude.x, std::max(magnitude.y, magnitude.z)));
+}
+
+inline glm::dvec3 mcrt::Ray::offset(const glm::dvec3& position, const glm::dvec3& normal,
+                                    const glm::dvec3& direction) {
+    double distance { getOffset(position) };
+    return position + (glm::dot(normal, direction) < 0.0 ? -normal : normal) * distance;
+}
+
+inline glm::dvec3 mcrt::Ray::offset(const glm::dvec3& position, const glm::dvec3& direction) {
+    return position + direction * getOffset(position);
+}
+
 inline double mcrt::Ray::fresnel( const glm::dvec3& normal, const double refractionIndex) const {
         double cosi = glm::clamp(glm::dot(direction, normal),-1.0,1.0);
         double etai = 1;
@@ -60,22 +98,20 @@ inline double mcrt::Ray::fresnel( const glm::dvec3& normal, const double refract
 inline mcrt::Ray mcrt::Ray::reflect(const glm::dvec3& hitPosition, const glm::dvec3& surfaceNormal) const {
     glm::dvec3 reflection { direction - 2.0*surfaceNormal * glm::dot(direction, surfaceNormal) };
     glm::dvec3 normalizedReflection { glm::normalize(reflection) };
-    return { hitPosition + normalizedReflection*EPSILON, normalizedReflection };
+    return { offset(hitPosition, surfaceNormal, normalizedReflection), normalizedReflection };
 }
 
     // Perfect refraction from high density to air
 inline mcrt::Ray mcrt::Ray::insideReflect(const glm::dvec3& hitPosition, const glm::dvec3& surfaceNormal) const {
     glm::dvec3 reflection { direction - 2.0*surfaceNormal * glm::dot(direction, surfaceNormal) };
     glm::dvec3 normalizedReflection { glm::normalize(reflection) };
-    return { hitPosition + normalizedReflection*-EPSILON, normalizedReflection };
+    return { offset(hitPosition, surfaceNormal, normalizedReflection), normalizedReflection };
 }
 
     // Perfect refraction from air to high density
 inline mcrt::Ray mcrt::Ray::refract(const glm::dvec3& hitPosition, const glm::dvec3& surfaceNormal,
                              double refractionIndex) const {
     double cosi = glm::clamp(glm::dot(surfaceNormal, direction), -1.0, 1.0);
-    bool outside = glm::dot(direction, surfaceNormal) < 0.0;
-    glm::dvec3 bias = surfaceNormal*Ray::EPSILON;
 
     double n1 = 1.0;
     double n2 = refractionIndex;
@@ -96,7 +132,7 @@ inline mcrt::Ray mcrt::Ray::refract(const glm::dvec3& hitPosition, const glm::dv
         refractionDir = glm::dvec3(0.0);
     else
         refractionDir = n * direction + (n * cosi - glm::sqrt(k)) * normal;
-    return { hitPosition + (outside ? -bias : bias), refractionDir };
+    return { offset(hitPosition, surfaceNormal, direction), refractionDir };
 }
 
 #endif
@@ -0,0 +1,129 @@
+#ifndef MCRT_RENDERER_HH
+#define MCRT_RENDERER_HH
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+#include "mcrt/film.hh"
+#include "mcrt/image.hh"
+#include "mcrt/scene.hh"
+#include "mcrt/parameter.hh"
+#include "mcrt/checkpoint.hh"
+
+namespace mcrt {
+    class Cluster;
+    class BidirectionalTracer;
+    class ReservoirResampler;
+    class MetropolisTracer;
+
+    // Everything that goes from a scene and its parameters to a film, so it can be
+    // embedded in other programs too (see mcrt.h for C), bin/mcrt is just one of them.
+    // Passes are added with render, as many at a time as wanted, and can be developed
+    // to an image or a buffer in between. The scene stays loaded (with its photon maps
+    // etc.), so only the film has to start over when e.g the camera moves, see reset.
+    class Renderer final {
+    public:
+        // After every pass, with the passes done by this call and how many it does.
+        typedef std::function<void(std::size_t, std::size_t)> Progress;
+
+        Renderer();
+        ~Renderer();
+
+        Renderer(const Renderer&) = delete;
+        Renderer& operator=(const Renderer&) = delete;
+
+        // Meshes in the scene file are loaded relative to it.
+        void loadScene(const std::string&);
+        void setScene(Scene&&);
+        Scene& getScene() { return *scene; }
+        const Scene& getScene() const { return *scene; }
+
+        // Both start over with a new film, since e.g the resolution might be another.
+        void loadParameters(const std::string&);
+        void setParameters(const Parameters&, const std::string& = "");
+        const Parameters& getParameters() const { return parameters; }
+        // The JSON they came from (if any), e.g for the checkpoints.
+        const std::string& getParameterFile() const { return parameterFile; }
+
+        // With OpenMPI every rank traces every size:th pass, with photons from rank 0.
+        void setCluster(const Cluster&);
+
+        // View independent parts, i.e the photon maps, irradiance cache and virtual
+        // lights. Done by the first render if not before, but this takes a while.
+        void prepare();
+
+        // Every tile of every pass gets its own random stream, so the seed is all we need.
+        // The photon maps and virtual lights are traced by prepare on streams of their own,
+        // past any of the passes, so they come out the same for a seed (and on every rank).
+        void setSeed(std::uint64_t);
+        std::uint64_t getSeed() const { return seed; }
+        static constexpr std::uint64_t PREPASS_STREAM { ~std::uint64_t { 0 } };
+
+        // Picks up the film (and seed) of a checkpoint, from the pass after its last one.
+        void resume(const Checkpoint&);
+        // Snapshot of the film, which is to be rendered until (not including) some pass.
+        Checkpoint checkpoint(std::size_t) const;
+        // Throws away the film, e.g after the camera moved, but keeps everything else.
+        void reset();
+        // Same, but for the next frame of a sequence, which is seen from another camera.
+        // With temporalSamples, pixels which find the same (diffuse) surface as in the
+        // last frame start with its radiance, and only get that many new passes. Pixels
+        // which weren't seen before (or are shiny) get all of them, like in a new film.
+        void nextFrame(const Camera&);
+
+        // Traces more passes into the film, calling back after each one of them.
+        void render(std::size_t, const Progress& = Progress {  });
+        // How many passes are left before some pass, for this rank.
+        std::size_t getPassesUntil(std::size_t) const;
+        std::size_t getNextPass() const { return nextPass; }
+
+        // Averages the passes so far, to an image which has the resolution of the film,
+        // or to linear RGBA floats (width*height*4 of them), in the caller's buffer.
+        void develop(Image&);
+        void develop(float*);
+        // Developed, scaled as in the parameters, and written to an image file.
+        void save(const std::string&);
+
+        Film& getFilm();
+        std::size_t getWidth() const { return parameters.resolutionWidth; }
+        std::size_t getHeight() const { return parameters.resolutionHeight; }
+
+    private:
+        // First hit through the center of a pixel, to find it again in the next frame.
+        struct Surface {
+            glm::dvec3 position, normal;
+            double depth { 0.0 };
+            bool valid { false };
+        };
+
+        void start();
+        int getRanks() const;
+        std::vector<Surface> traceSurfaces() const;
+
+        std::unique_ptr<Scene> scene;
+        Parameters parameters;
+        std::string parameterFile;
+        const Cluster* cluster { nullptr };
+        bool prepared { false };
+
+        std::uint64_t seed { 0 };
+        std::size_t nextPass { 0 }, passStride { 1 };
+
+        // Created lazily by start, since they depend on both scene and parameters.
+        std::unique_ptr<Image> image;
+        std::unique_ptr<Film> film;
+        std::unique_ptr<BidirectionalTracer> bidirectionalTracer;
+        std::unique_ptr<ReservoirResampler> reservoirResampler;
+        std::unique_ptr<MetropolisTracer> metropolisTracer;
+        bool bootstrapped { false };
+
+        // Pixels with radiance from the last frame, which only trace every stride:th pass.
+        std::vector<bool> history;
+        std::size_t historyStride { 1 };
+    };
+}
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef MCRT_RESTIR_HH
+#define MCRT_RESTIR_HH
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "mcrt/ray.hh"
+#include "mcrt/film.hh"
+#include "mcrt/image.hh"
+#include "mcrt/scene.hh"
+#include "mcrt/lights.hh"
+
+namespace mcrt {
+    // ReSTIR by Bitterli et al, but only for the direct light at the first diffuse hit.
+    // Each pixel keeps a reservoir with a single light sample, picked by resampling a
+    // lot of cheap (unshadowed) candidates. Reservoirs are then reused over the passes
+    // (temporal) and between nearby pixels (spatial), so only the chosen sample needs
+    // a shadow ray, i.e one for each pixel and pass, regardless of how many lights.
+    class ReservoirResampler {
+    public:
+        ReservoirResampler(const Scene&, const Image&, std::size_t, std::size_t, double);
+
+        // Radiance along the camera ray at (x, y), but without the direct light from the
+        // area lights at the first hit, that is added later in resolve, after every pixel
+        // had its turn. The other lights are cheap enough to be shaded right away here.
+        glm::dvec3 trace(std::size_t, std::size_t, const Ray&);
+        // Does the spatial reuse and then shades all pixels with one shadow ray each.
+        void resolve(Film&, bool);
+
+        // Cap on the temporal history, relative to the amount of candidates.
+        static constexpr double MAX_HISTORY { 20.0 };
+
+    private:
+        struct Reservoir {
+            const AreaLight* light { nullptr };
+            glm::dvec3 point;
+            double weightSum { 0.0 }, samples { 0.0 };
+            double weight { 0.0 }; // i.e the W, for the chosen sample.
+
+            void update(const AreaLight*, const glm::dvec3&, double);
+        };
+
+        struct Surface {
+            bool valid { false };
+            glm::dvec3 position, normal, outgoing;
+            const Material* material;
+            double depth;
+        };
+
+        glm::dvec3 unshadowed(const Surface&, const AreaLight*, const glm::dvec3&) const;
+        double targetPdf(const Surface&, const AreaLight*, const glm::dvec3&) const;
+        void merge(Reservoir&, const Reservoir&, const Surface&) const;
+        void finalize(Reservoir&, const Surface&) const;
+        bool similar(const Surface&, const Surface&) const;
+
+        const Scene& scene;
+        const Image& image;
+        std::size_t candidates, neighbours;
+        double radius;
+
+        std::vector<const AreaLight*> lights;
+        std::vector<double> lightWeights;
+        double totalLightWeight { 0.0 };
+        std::vector<Light*> otherLights; // e.g point lights, these can't be sampled.
+
+        std::vector<Surface> surfaces, previousSurfaces;
+        std::vector<Reservoir> reservoirs, previousReservoirs;
+    };
+}
+
+#endif
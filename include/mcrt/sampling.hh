@@ -0,0 +1,38 @@
+#ifndef MCRT_SAMPLING_HH
+#define MCRT_SAMPLING_HH
+
+#include <cstdint>
+#include <glm/glm.hpp>
+
+namespace mcrt {
+    namespace sampling {
+        // Uniform number in [0, 1). Each thread draws from its own generator,
+        // so it's safe to call this from inside of the OpenMP render loops.
+        double uniform();
+        // Restarts this thread's generator at a stream given by the seed and e.g the
+        // pass and the tile, so renders are repeatable, and can be resumed later on.
+        void seed(std::uint64_t, std::uint64_t = 0, std::uint64_t = 0);
+        // What seed restarts the generator with, for the ones which aren't per thread.
+        std::uint64_t streamSeed(std::uint64_t, std::uint64_t = 0, std::uint64_t = 0);
+        // Seed for when the user doesn't care, from the system's entropy.
+        std::uint64_t randomSeed();
+
+        // Replaces the numbers given by uniform() on this thread, e.g for the
+        // Metropolis sampler which needs to drive rayTrace with its own ones.
+        class Stream {
+        public:
+            virtual ~Stream() = default;
+            virtual double next() = 0;
+        };
+
+        // Pass nullptr to go back to the thread's own generator again.
+        void setStream(Stream*);
+
+        // Finds some orthonormal tangent and bitangent around the normal given.
+        void tangentFrame(const glm::dvec3&, glm::dvec3&, glm::dvec3&);
+        // Maps two uniform numbers to a cosine-weighted direction around normal.
+        glm::dvec3 cosineHemisphere(const glm::dvec3&, double, double);
+    }
+}
+
+#endif
@@ -7,6 +7,11 @@
 #include "mcrt/geometry.hh"
 #include "mcrt/photon.hh"
 #include "mcrt/photon_map.hh"
+#include "mcrt/irradiance_cache.hh"
+#include "mcrt/lightcuts.hh"
+#include "mcrt/primitives.hh"
+
+#include <functional>
 
 namespace mcrt {
     class Light;
@@ -28,6 +33,7 @@ namespace mcrt {
 
         Scene& operator=(Scene&& other) noexcept {
             camera = other.camera;
+            cameras = other.cameras;
             lights = other.lights;
 
             // Here comes the trick, rip this classes' guts out!
@@ -36,6 +42,9 @@ namespace mcrt {
                 other.geometries[i] = nullptr;
             }
 
+            primitives.build(geometries);
+            other.primitives.clear();
+
             for (size_t i { 0 }; i < other.materials.size(); ++i) {
                 materials.push_back(other.materials[i]);
                 other.materials[i] = nullptr;
@@ -48,44 +57,140 @@ namespace mcrt {
         void add(Light* light);
         void add(Geometry* geometry);
 
-        glm::dvec3 rayTrace(const Ray& ray, const size_t) const;
+        // Depth counts every bounce, while diffuse depth only counts the diffuse ones.
+        glm::dvec3 rayTrace(const Ray& ray, const size_t, const size_t = 0) const;
+        // Same, but from where the ray is already known to hit, e.g from a packet.
+        glm::dvec3 rayTrace(const Ray& ray, const Ray::Intersection&, const size_t, const size_t = 0) const;
         Ray::Intersection intersect(const Ray& ray) const;
+        // The closest hits of many rays that go about the same way, like camera rays.
+        void intersect(const Ray*, std::size_t, Ray::Intersection*) const;
+        // Only the diffuse indirect part of rayTrace at the hit, the direct light is given
+        // separately (only used as a hint), so it can be found in some other way instead.
+        glm::dvec3 indirectRadiance(const Ray&, const Ray::Intersection&, const size_t,
+                                    const size_t = 0, const glm::dvec3& = glm::dvec3 { 0.0 }) const;
 
         double inShadow(const Ray& ray) const;
+        // Unlike inShadow, every surface (even glass) blocks the segment here.
+        bool visible(const glm::dvec3&, const glm::dvec3&) const;
 
         void gatherPhotons(std::size_t);
         void dumpPhotonMap(const std::string&) const;
 
+        // Multi-bounce photons (with Russian roulette) for the global photon map,
+        // which lets camera paths terminate after their first diffuse bounce.
+        void gatherGlobalPhotons(std::size_t);
+
+        // For handing over photon maps which were gathered by some other process.
+        const PhotonMap& getPhotonMap() const { return photonMap; }
+        const PhotonMap& getGlobalPhotonMap() const { return globalPhotonMap; }
+        void setPhotonMap(const std::vector<Photon>&);
+        void setGlobalPhotonMap(const std::vector<Photon>&);
+
+        // Replaces diffuse indirect rays with an irradiance cache, which is filled
+        // lazily by final gathering, i.e with the error and amount of gather rays.
+        void enableIrradianceCache(double, std::size_t);
+        const IrradianceCache& getIrradianceCache() const { return irradianceCache; }
+
+        // Instant radiosity, i.e virtual point lights left by the light paths are used
+        // for diffuse indirect light instead, clustered in a lightcut tree (with error).
+        void gatherVirtualLights(std::size_t, double);
+        const LightTree& getLightTree() const { return lightTree; }
+
         std::vector<Material*>& getMaterials() { return materials; }
         const std::vector<Material*>& getMaterials() const { return materials; }
 
         std::vector<Geometry*>& getGeometries() { return geometries; }
         const std::vector<Geometry*>& getGeometries() const { return geometries; }
+        // What's actually intersected, which follows the geometries in add and update.
+        const Primitives& getPrimitives() const { return primitives; }
 
         static size_t maxRayDepth;
         static double photonEstimationRadius;
+        static double globalEstimationRadius;
 
         const std::vector<Light*>& getLights() const { return lights; }
         std::vector<Light*>& getLights() { return lights; }
 
         const Camera& getCamera() const { return camera; }
         Camera& getCamera() { return camera; }
+        // Frames to render one after another instead (e.g turntables), if any.
+        const std::vector<Camera>& getCameras() const { return cameras; }
+        std::vector<Camera>& getCameras() { return cameras; }
+
+        // What an edit throws away, so it only has to pay for that. These are ordered,
+        // so each one also invalidates the ones before it, e.g moving a mesh needs its
+        // bounds refitted, then the photon maps (etc.) again, and then a new film too.
+        enum class Invalidation {
+            NOTHING,
+            ACCUMULATION,
+            PHOTON_MAP, // And the irradiance cache and virtual lights.
+            GEOMETRY
+        };
+
+        // In place edits for interactive use, instead of loading the scene file again.
+        // They return (and remember) what they invalidated, but the caller may know
+        // better, e.g a material on something which isn't seen by the camera at all.
+        Invalidation editCamera(const std::function<void(Camera&)>&,
+                                Invalidation = Invalidation::ACCUMULATION);
+        Invalidation editMaterial(std::size_t, const std::function<void(Material&)>&,
+                                  Invalidation = Invalidation::PHOTON_MAP);
+        Invalidation editLight(std::size_t, const std::function<void(Light&)>&,
+                               Invalidation = Invalidation::PHOTON_MAP);
+        Invalidation editGeometry(std::size_t, const std::function<void(Geometry&)>&,
+                                  Invalidation = Invalidation::GEOMETRY);
+
+        // Redoes whatever the edits since last time invalidated, with the settings it
+        // was gathered with before (lights are always refit, see Light::refit). Returns
+        // that, i.e if the film must start over.
+        Invalidation update();
+        Invalidation getInvalidation() const { return invalidation; }
 
     private:
         std::vector<Material*> materials;
         std::vector<Geometry*> geometries;
+        Primitives primitives;
         bool photonMapEnabled { false };
         std::vector<Light*> lights;
         PhotonMap photonMap;
 
+        bool globalPhotonMapEnabled { false };
+        PhotonMap globalPhotonMap;
+
         unsigned currentPhoton;
 
         bool photonTrace(const Ray& ray, const glm::dvec3&, const size_t);
         void getPhotons(const Ray& ray, const glm::dvec3&);
         bool hasPhotonMap() const { return photonMapEnabled; }
+        bool hasGlobalPhotonMap() const { return globalPhotonMapEnabled; }
+        // The closest of the hit (so far) and the lights.
+        Ray::Intersection intersectLights(const Ray&, const Ray::Intersection&) const;
+
+        // Called at every diffuse surface hit by the ray, with the flux it carried there.
+        typedef std::function<void(const Ray&, const Ray::Intersection&, const glm::dvec3&)> PhotonHit;
+        void globalPhotonTrace(const Ray&, const glm::dvec3&, const size_t, const PhotonHit&) const;
+        bool estimateGlobalRadiance(const Ray&, const Ray::Intersection&, glm::dvec3&) const;
         bool radianceEstimationPossible(const std::vector<const Photon*>&) const;
+        bool estimateRadiance(const Ray&, const Ray::Intersection&, glm::dvec3&) const;
+        glm::dvec3 directRadiance(const Ray&, const Ray::Intersection&) const;
+
+        mutable IrradianceCache irradianceCache;
+        std::size_t finalGatherRays { 64 };
+
+        glm::dvec3 indirectIrradiance(const Ray::Intersection&) const;
+        IrradianceCache::Record finalGather(const Ray::Intersection&) const;
+        glm::dvec3 gatherRadiance(const Ray&, const Ray::Intersection&, const size_t) const;
+
+        LightTree lightTree;
 
         Camera camera;
+        std::vector<Camera> cameras;
+
+        Invalidation invalidate(Invalidation);
+        Invalidation invalidation { Invalidation::NOTHING };
+
+        // Settings of the view independent parts, for redoing them in update.
+        std::size_t gatheredPhotons { 0 }, gatheredGlobalPhotons { 0 }, gatheredLightPaths { 0 };
+        double irradianceCacheError { 0.0 }, lightcutError { 0.0 };
     };
 }
 
@@ -8,6 +8,10 @@ namespace mcrt {
     class SceneImporter {
     public:
         static Scene load(const std::string&);
+        // From the contents of a scene file, which is still needed to find the meshes.
+        static Scene parse(const std::string&, const std::string&);
+        // Same as the camera in the scene files, e.g for moving it between renders.
+        static void parseCamera(const std::string&, Camera&);
     };
 }
 
@@ -0,0 +1,64 @@
+#ifndef MCRT_SERVER_HH
+#define MCRT_SERVER_HH
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "mcrt/scene.hh"
+#include "mcrt/camera.hh"
+#include "mcrt/renderer.hh"
+#include "mcrt/parameter.hh"
+
+namespace mcrt {
+    // Render daemon on a local (Unix) socket, so that previews don't pay for loading
+    // the meshes and gathering the photon maps all over again every time. Jobs and
+    // replies are both JSON, one on each line, and the clients are served in order:
+    //  > {"scene": "share/scene.json", "parameters": "share/param.json",
+    //     "camera": {"origin": [0, 4, 8]}, "output": "share/render.png"}
+    //  < {"status": "progress", "pass": 1, "passes": 49, "output": "share/render.png"}
+    //  < {"status": "done", "cached": true, "invalidated": "accumulation", "seconds": 1.5}
+    // Parameters can also be given inline as an object, and the camera is optional.
+    // {"shutdown": true} stops the server. Scenes are kept by the hash of their file
+    // and of the parameters which are used for the view independent parts of them.
+    // Jobs may also edit the cached scenes in place (see Scene::Invalidation), e.g
+    //  > {..., "edits": [{"material": 2, "color": [1, 0, 0]}, {"light": 0, "intensity": 9},
+    //                    {"geometry": 5, "move": [0, 1, 0]}], "accumulate": true}
+    // which stay until the scene file changes. With "accumulate" the passes are added
+    // to the last job's film, if nothing since then (e.g the camera) invalidated it.
+    // Each scene has its own Renderer, so that film never even leaves the memory.
+    class Server final {
+    public:
+        Server(const std::string&);
+        ~Server();
+
+        Server(const Server&) = delete;
+        Server& operator=(const Server&) = delete;
+
+        // Serves the clients one at a time, until one of them asks for a shutdown.
+        void run();
+
+        // Least recently used scene is dropped after this, they can be big.
+        static constexpr std::size_t MAX_SCENES { 4 };
+
+    private:
+        struct CachedScene {
+            std::unique_ptr<Renderer> renderer;
+            Camera camera; // As in the file, since the jobs move it around.
+            std::size_t lastUsed;
+            std::string lastCamera; // Of the last job, i.e what the film has.
+        };
+
+        bool serve(int);
+        bool handle(int, const std::string&);
+        CachedScene& fetch(const std::string&, const Parameters&, bool&);
+
+        std::string path;
+
+        int listener { -1 };
+        std::size_t jobs { 0 };
+        std::unordered_map<std::size_t, CachedScene> scenes;
+    };
+}
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef MCRT_SIMD_HH
+#define MCRT_SIMD_HH
+
+#include <vector>
+#include <cstddef>
+
+#include "mcrt/ray.hh"
+#include "mcrt/precision.hh"
+
+namespace mcrt {
+    class Bvh;
+
+    // Möller–Trumbore against many triangles at once, i.e one ray against as many of
+    // them as fit in the vector registers (8 floats with AVX2, 16 with AVX-512, half as
+    // many in a double core). Each instruction set has its own kernel, built only for
+    // it (see simd_kernel.hh), and the best one the CPU has is picked at startup.
+    // They all find the same hits as the scalar one, bit for bit, just more at a time.
+    namespace simd {
+        enum class Isa { SCALAR, SSE, AVX2, AVX512 };
+
+        // Corner k of triangle t is at (x[k][t], y[k][t], z[k][t]). There must be at
+        // least PADDING more (e.g degenerate) triangles after the count, which kernels
+        // might read (but never hit) when the end isn't a whole vector away.
+        struct Triangles {
+            const float* x[3];
+            const float* y[3];
+            const float* z[3];
+            std::size_t count;
+        };
+
+        constexpr std::size_t PADDING { 16 };
+
+        // Rays that go the same way (like the camera rays of an 8x8 block of pixels),
+        // which are traced through a Bvh together, and tested many rays at a time.
+        struct Packet {
+            static constexpr std::size_t SIZE { 64 };
+            Real ox[SIZE], oy[SIZE], oz[SIZE], dx[SIZE], dy[SIZE], dz[SIZE];
+            std::size_t count;
+        };
+
+        // Replaces the closest hit if any of triangles [begin, end) is closer than it,
+        // so it has to start out with the max distance (or e.g the closest one so far).
+        typedef void (*Kernel)(const Triangles&, std::size_t, std::size_t,
+                               const Vector3&, const Vector3&, Ray::Hit&);
+        // Same, but for all of the triangles, going through the (wide) nodes of a Bvh.
+        typedef void (*BvhKernel)(const Bvh&, const Triangles&, const Vector3&, const Vector3&, Ray::Hit&);
+        // And for each of the rays in a packet, with the closest hits of each of them.
+        typedef void (*PacketKernel)(const Bvh&, const Triangles&, const Packet&, Ray::Hit*);
+
+        // The best one this CPU has, which is what intersect uses.
+        Isa getIsa();
+        // Those built in and supported by the CPU, from the scalar one and up.
+        std::vector<Isa> getSupported();
+        Kernel getKernel(Isa);
+        BvhKernel getBvhKernel(Isa);
+        PacketKernel getPacketKernel(Isa);
+        const char* getName(Isa);
+
+        void intersect(const Triangles&, std::size_t, std::size_t,
+                       const Vector3&, const Vector3&, Ray::Hit&);
+    }
+}
+
+#endif
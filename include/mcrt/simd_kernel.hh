@@ -0,0 +1,489 @@
+#ifndef MCRT_SIMD_KERNEL_HH
+#define MCRT_SIMD_KERNEL_HH
+
+#include <cmath>
+#include <limits>
+#include <cstring>
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+
+#include "mcrt/bvh.hh"
+#include "mcrt/simd.hh"
+
+// Only for the kernels in src/mcrt/simd_*.cc, which are each built for their own
+// instruction set. The template has internal linkage, so every one of those gets a
+// copy of its own (and the linker can't pick e.g the AVX-512 one for all of them).
+namespace mcrt {
+    namespace simd {
+        void intersectSse(const Triangles&, std::size_t, std::size_t,
+                          const Vector3&, const Vector3&, Ray::Hit&);
+        void intersectAvx2(const Triangles&, std::size_t, std::size_t,
+                           const Vector3&, const Vector3&, Ray::Hit&);
+        void intersectAvx512(const Triangles&, std::size_t, std::size_t,
+                             const Vector3&, const Vector3&, Ray::Hit&);
+
+        void intersectBvhSse(const Bvh&, const Triangles&, const Vector3&, const Vector3&, Ray::Hit&);
+        void intersectBvhAvx2(const Bvh&, const Triangles&, const Vector3&, const Vector3&, Ray::Hit&);
+        void intersectBvhAvx512(const Bvh&, const Triangles&, const Vector3&, const Vector3&, Ray::Hit&);
+
+        void intersectPacketSse(const Bvh&, const Triangles&, const Packet&, Ray::Hit*);
+        void intersectPacketAvx2(const Bvh&, const Triangles&, const Packet&, Ray::Hit*);
+        void intersectPacketAvx512(const Bvh&, const Triangles&, const Packet&, Ray::Hit*);
+
+// Only the kernels below are built for the instruction set of the file that asks for
+// it (by defining MCRT_SIMD_AVX2 or MCRT_SIMD_AVX512 first), not the whole file, or the
+// inline functions they share with everything else (glm, the standard library, Bvh...)
+// would be too, and the linker could keep those copies for the whole program. These
+// have all been included above, so nothing in here instantiates them for it either.
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(MCRT_SIMD_AVX2) || defined(MCRT_SIMD_AVX512))
+#define MCRT_SIMD_TARGET
+#if defined(__clang__) && defined(MCRT_SIMD_AVX512)
+#pragma clang attribute push (__attribute__((target("avx512f"))), apply_to = function)
+#elif defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2"))), apply_to = function)
+#else
+#pragma GCC push_options
+#if defined(MCRT_SIMD_AVX512)
+#pragma GCC target("avx512f")
+#else
+#pragma GCC target("avx2")
+#endif
+#endif
+#endif
+
+        namespace {
+            // Vector of N lanes, where the type has to depend on a template parameter for
+            // GCC to take the size (see traverseWide, which has one only for the size).
+            template<typename T, std::size_t N> struct Lanes {
+                typedef T Type __attribute__((vector_size(N * sizeof(T))));
+            };
+
+            // The floats from there in lanes of T (which may be wider).
+            template<typename V, typename F> V convert(const float* data) {
+                F lanes;
+                std::memcpy(&lanes, data, sizeof(lanes));
+                return __builtin_convertvector(lanes, V);
+            }
+
+            // W triangles in each step, in the vector extensions of GCC (and Clang),
+            // which become whatever registers the translation unit is built for. Has
+            // the same operations in the same order as the scalar one, so the same hits.
+            template<typename T, std::size_t W>
+            void intersectWide(const Triangles& triangles, std::size_t begin, std::size_t end,
+                               const Vector3& origin, const Vector3& direction, Ray::Hit& closest) {
+                typedef T V __attribute__((vector_size(W * sizeof(T))));
+                typedef float F __attribute__((vector_size(W * sizeof(float))));
+                // Lanes of -1 or 0 (as comparisons give), or indices, as wide as T.
+                typedef typename std::conditional<sizeof(T) == 4, std::int32_t, std::int64_t>::type I;
+                typedef I M __attribute__((vector_size(W * sizeof(T))));
+
+                const V ox = V {  } + origin.x, oy = V {  } + origin.y, oz = V {  } + origin.z,
+                        dx = V {  } + direction.x, dy = V {  } + direction.y, dz = V {  } + direction.z;
+                const V epsilon = V {  } + static_cast<T>(Ray::EPSILON);
+                const T limit { closest.distance < std::numeric_limits<T>::max()
+                              ? static_cast<T>(closest.distance) : std::numeric_limits<T>::max() };
+
+                // Closest hit in each lane, which are only compared at the end.
+                V best = V {  } + limit, bestU = V {  }, bestV = V {  };
+                M lane, bestIndex = M {  } - 1;
+                for (std::size_t i = 0; i < W; ++i) lane[i] = i;
+
+                for (std::size_t t = begin; t < end; t += W) {
+                    V x0 = convert<V, F>(triangles.x[0] + t), y0 = convert<V, F>(triangles.y[0] + t),
+                      z0 = convert<V, F>(triangles.z[0] + t);
+                    V e1x = convert<V, F>(triangles.x[1] + t) - x0, e1y = convert<V, F>(triangles.y[1] + t) - y0,
+                      e1z = convert<V, F>(triangles.z[1] + t) - z0;
+                    V e2x = convert<V, F>(triangles.x[2] + t) - x0, e2y = convert<V, F>(triangles.y[2] + t) - y0,
+                      e2z = convert<V, F>(triangles.z[2] + t) - z0;
+
+                    V px = dy * e2z - e2y * dz, py = dz * e2x - e2z * dx, pz = dx * e2y - e2x * dy;
+                    V det = e1x * px + e1y * py + e1z * pz;
+                    M index = lane + static_cast<I>(t);
+                    M hit = ((det >= epsilon) | (det <= -epsilon)) & (index < static_cast<I>(end));
+
+                    V inv = static_cast<T>(1) / det;
+                    V tx = ox - x0, ty = oy - y0, tz = oz - z0;
+                    V u = (tx * px + ty * py + tz * pz) * inv;
+                    hit &= (u >= 0) & (u <= 1);
+
+                    V qx = ty * e1z - e1y * tz, qy = tz * e1x - e1z * tx, qz = tx * e1y - e1x * ty;
+                    V v = (dx * qx + dy * qy + dz * qz) * inv;
+                    hit &= (v >= 0) & (u + v <= 1);
+
+                    V distance = (e2x * qx + e2y * qy + e2z * qz) * inv;
+                    hit &= (distance > 0) & (distance < best);
+
+                    best = hit ? distance : best;
+                    bestU = hit ? u : bestU;
+                    bestV = hit ? v : bestV;
+                    bestIndex = hit ? index : bestIndex;
+                }
+
+                // The closest of the lanes, or the first one of those if they're as close.
+                std::size_t found { W };
+                for (std::size_t i = 0; i < W; ++i) {
+                    if (bestIndex[i] < 0) continue;
+                    if (found == W || best[i] < best[found] ||
+                        (best[i] == best[found] && bestIndex[i] < bestIndex[found])) found = i;
+                }
+
+                if (found == W) return;
+                closest = { best[found], static_cast<std::size_t>(bestIndex[found]), bestU[found], bestV[found] };
+            }
+
+            // Slab test of all N children of a wide node at once (in floats, since that's
+            // what the bounds are in), and then the hit ones are pushed back to front, so
+            // the nearest one is popped first. Leaves go to the kernel, which is given as
+            // e.g intersectWide with the right width, and makes the boxes test shorter.
+            template<std::size_t N, typename Leaf>
+            void traverseWide(const std::vector<Bvh::WideNode<N>>& nodes, const Triangles& triangles,
+                              const Vector3& origin, const Vector3& direction, Ray::Hit& closest, Leaf leaf,
+                              std::uint32_t root = 0) {
+                typedef typename Lanes<float, N>::Type B;
+                typedef typename Lanes<std::int32_t, N>::Type C;
+                if (nodes.empty()) return;
+
+                // Through a reference, since e.g a BVH8 is wider than the registers of SSE.
+                auto load = [](B& lanes, const float* data, const B& origin, const B& inverse) {
+                    std::memcpy(&lanes, data, sizeof(lanes));
+                    lanes = (lanes - origin) * inverse;
+                };
+
+                const float inverse[3] { 1.0f / static_cast<float>(direction.x), 1.0f / static_cast<float>(direction.y),
+                                         1.0f / static_cast<float>(direction.z) };
+                const bool negative[3] { inverse[0] < 0.0f, inverse[1] < 0.0f, inverse[2] < 0.0f };
+                const unsigned octant { negative[0] * 1u + negative[1] * 2u + negative[2] * 4u };
+                const B ox = B {  } + static_cast<float>(origin.x), oy = B {  } + static_cast<float>(origin.y),
+                        oz = B {  } + static_cast<float>(origin.z);
+                const B ix = B {  } + inverse[0], iy = B {  } + inverse[1], iz = B {  } + inverse[2];
+
+                // A leaf is a range of triangles (count > 0), and otherwise a wide node.
+                struct Entry { std::uint32_t index, count; };
+                Entry stack[Bvh::MAX_DEPTH * N + 1];
+                std::size_t size { 1 };
+                stack[0] = { root, 0 };
+
+                while (size > 0) {
+                    Entry entry { stack[--size] };
+                    if (entry.count > 0) {
+                        leaf(triangles, entry.index, entry.index + entry.count, origin, direction, closest);
+                        continue;
+                    }
+
+                    const Bvh::WideNode<N>& node { nodes[entry.index] };
+                    B x0, x1, y0, y1, z0, z1;
+                    load(x0, negative[0] ? node.maxX : node.minX, ox, ix);
+                    load(x1, negative[0] ? node.minX : node.maxX, ox, ix);
+                    load(y0, negative[1] ? node.maxY : node.minY, oy, iy);
+                    load(y1, negative[1] ? node.minY : node.maxY, oy, iy);
+                    load(z0, negative[2] ? node.maxZ : node.minZ, oz, iz);
+                    load(z1, negative[2] ? node.minZ : node.maxZ, oz, iz);
+
+                    // Like the scalar one, NaNs (from 0 * inf) fail the compares and are left out.
+                    B near = B {  }, far = B {  } + Bvh::getLimit(closest);
+                    near = x0 > near ? x0 : near; near = y0 > near ? y0 : near; near = z0 > near ? z0 : near;
+                    far = x1 < far ? x1 : far; far = y1 < far ? y1 : far; far = z1 < far ? z1 : far;
+                    C hit = near <= far;
+
+                    unsigned mask { 0 };
+                    for (std::size_t slot = 0; slot < N; ++slot) mask |= (hit[slot] & 1u) << slot;
+                    if (mask == 0) continue;
+
+                    // Most of the time it's only one of them, which doesn't need sorting.
+                    if ((mask & (mask - 1)) == 0) {
+                        std::size_t slot { static_cast<std::size_t>(__builtin_ctz(mask)) };
+                        stack[size++] = { node.child[slot], node.count[slot] };
+                        continue;
+                    }
+
+                    std::uint32_t order { node.order[octant] };
+                    for (std::size_t k = N; k-- > 0;) {
+                        std::size_t slot { (order >> (4 * k)) & 15 };
+                        if (mask & (1u << slot)) stack[size++] = { node.child[slot], node.count[slot] };
+                    }
+                }
+            }
+
+            // Which of the wide node layouts the Bvh has, with leaves W triangles at a time.
+            template<typename T, std::size_t W>
+            void intersectBvh(const Bvh& bvh, const Triangles& triangles,
+                              const Vector3& origin, const Vector3& direction, Ray::Hit& closest) {
+                if (bvh.getLayout() == Bvh::Layout::BVH4)
+                    traverseWide(bvh.getNodes4(), triangles, origin, direction, closest, intersectWide<T, W>);
+                else
+                    traverseWide(bvh.getNodes8(), triangles, origin, direction, closest, intersectWide<T, W>);
+            }
+            // The rays of a packet go through the wide nodes together, with a mask of the
+            // ones which are still in each of them. Children are first culled by the frustum
+            // around all of the rays (by interval arithmetic on the bounds of their origins
+            // and inverse directions), and then tested against the rays in the mask, as many
+            // at a time as there are floats in a register. In the leaves, W of those rays are
+            // tested against one triangle at a time, by the same operations as intersectWide,
+            // so each ray gets the hits it would if it was traced alone. Rays with a closest
+            // hit at 0 so far (i.e nothing can be closer) are left out from the start.
+            template<typename T, std::size_t W, std::size_t N>
+            void traversePacket(const std::vector<Bvh::WideNode<N>>& nodes, const Triangles& triangles,
+                                const Packet& packet, Ray::Hit* hits) {
+                typedef typename Lanes<T, W>::Type V;
+                typedef typename std::conditional<sizeof(T) == 4, std::int32_t, std::int64_t>::type I;
+                typedef typename Lanes<I, W>::Type M;
+                typedef typename Lanes<float, N>::Type B;
+                typedef typename Lanes<std::int32_t, N>::Type C;
+                constexpr std::size_t L { W * sizeof(T) / sizeof(float) };
+                typedef typename Lanes<float, L>::Type F;
+                typedef typename Lanes<std::int32_t, L>::Type K;
+                constexpr std::size_t S { Packet::SIZE }, ALONE { 8 };
+                static_assert(S <= 64 && S % W == 0 && S % L == 0, "The rays of a packet are masked by 64 bits.");
+                const std::size_t count { packet.count };
+                if (nodes.empty() || count == 0) return;
+
+                // Closest hits so far by ray, and how far each of them tests the boxes.
+                T best[S], bestU[S], bestV[S];
+                I bestIndex[S];
+                float ox[S], oy[S], oz[S], ix[S], iy[S], iz[S], limit[S];
+                std::uint64_t active { 0 };
+                for (std::size_t r = 0; r < S; ++r) {
+                    best[r] = bestU[r] = bestV[r] = 0;
+                    bestIndex[r] = -1;
+                    ox[r] = oy[r] = oz[r] = ix[r] = iy[r] = iz[r] = 0.0f;
+                    limit[r] = -1.0f;
+                    if (r >= count || hits[r].distance <= 0.0) continue;
+
+                    active |= std::uint64_t { 1 } << r;
+                    best[r] = hits[r].distance < std::numeric_limits<T>::max()
+                            ? static_cast<T>(hits[r].distance) : std::numeric_limits<T>::max();
+                    ox[r] = static_cast<float>(packet.ox[r]);
+                    oy[r] = static_cast<float>(packet.oy[r]);
+                    oz[r] = static_cast<float>(packet.oz[r]);
+                    ix[r] = 1.0f / static_cast<float>(packet.dx[r]);
+                    iy[r] = 1.0f / static_cast<float>(packet.dy[r]);
+                    iz[r] = 1.0f / static_cast<float>(packet.dz[r]);
+                    limit[r] = Bvh::getLimit(hits[r]);
+                }
+
+                if (active == 0) return;
+                const float* origins[3] { ox, oy, oz };
+                const float* inverses[3] { ix, iy, iz };
+                float originMin[3], originMax[3], inverseMin[3], inverseMax[3], farthest { -1.0f };
+                for (int a = 0; a < 3; ++a) {
+                    originMin[a] = inverseMin[a] = std::numeric_limits<float>::max();
+                    originMax[a] = inverseMax[a] = -std::numeric_limits<float>::max();
+                }
+
+                for (std::size_t r = 0; r < count; ++r) {
+                    if (limit[r] < 0.0f) continue;
+                    farthest = std::max(farthest, limit[r]);
+                    for (int a = 0; a < 3; ++a) {
+                        originMin[a] = std::min(originMin[a], origins[a][r]);
+                        originMax[a] = std::max(originMax[a], origins[a][r]);
+                        inverseMin[a] = std::min(inverseMin[a], inverses[a][r]);
+                        inverseMax[a] = std::max(inverseMax[a], inverses[a][r]);
+                    }
+                }
+
+                // The children are in the order of the first ray, which they mostly share.
+                const std::size_t first = __builtin_ctzll(active);
+                const unsigned octant { (ix[first] < 0.0f) * 1u + (iy[first] < 0.0f) * 2u + (iz[first] < 0.0f) * 4u };
+                // Only where all of the rays go the same way is the range of 1/d an interval.
+                bool bounded[3];
+                for (int a = 0; a < 3; ++a)
+                    bounded[a] = (inverseMin[a] > 0.0f || inverseMax[a] < 0.0f) &&
+                                 std::abs(inverseMin[a]) <= std::numeric_limits<float>::max() &&
+                                 std::abs(inverseMax[a]) <= std::numeric_limits<float>::max();
+
+                // Lowest (or highest) t = (plane - o) / d in the packet for each of the planes.
+                auto extreme = [&](B& t, const float* planes, int a, bool highest) {
+                    std::memcpy(&t, planes, sizeof(t));
+                    B below = t - originMax[a], above = t - originMin[a];
+                    B t0 = below * inverseMin[a], t1 = below * inverseMax[a],
+                      t2 = above * inverseMin[a], t3 = above * inverseMax[a];
+                    if (highest) {
+                        t0 = t1 > t0 ? t1 : t0; t2 = t3 > t2 ? t3 : t2; t = t2 > t0 ? t2 : t0;
+                    } else {
+                        t0 = t1 < t0 ? t1 : t0; t2 = t3 < t2 ? t3 : t2; t = t2 < t0 ? t2 : t0;
+                    }
+                };
+
+                auto lanes = [](std::size_t c, std::size_t width) {
+                    return (width == 64 ? ~std::uint64_t { 0 } : (std::uint64_t { 1 } << width) - 1) << c;
+                };
+
+                // Those of the rays in the mask which hit the box in the slot.
+                auto hitRays = [&](const Bvh::WideNode<N>& node, std::size_t slot, std::uint64_t mask) {
+                    const float minimum[3] { node.minX[slot], node.minY[slot], node.minZ[slot] },
+                                maximum[3] { node.maxX[slot], node.maxY[slot], node.maxZ[slot] };
+                    std::uint64_t hit { 0 };
+                    for (std::size_t c = 0; c < S; c += L) {
+                        if ((mask & lanes(c, L)) == 0) continue;
+                        F near = F {  }, far, origin, inverse;
+                        std::memcpy(&far, limit + c, sizeof(F));
+                        for (int a = 0; a < 3; ++a) {
+                            std::memcpy(&origin, origins[a] + c, sizeof(F));
+                            std::memcpy(&inverse, inverses[a] + c, sizeof(F));
+                            F t0 = (minimum[a] - origin) * inverse, t1 = (maximum[a] - origin) * inverse;
+                            K negative = inverse < 0.0f;
+                            F t2 = negative ? t1 : t0, t3 = negative ? t0 : t1;
+                            near = t2 > near ? t2 : near;
+                            far = t3 < far ? t3 : far;
+                        }
+
+                        K inside = near <= far;
+                        for (std::size_t l = 0; l < L; ++l)
+                            hit |= static_cast<std::uint64_t>(inside[l] & 1) << (c + l);
+                    }
+
+                    return hit & mask;
+                };
+
+                // Wide node or range of triangles, like in traverseWide, and the rays in it.
+                struct Entry { std::uint32_t index, count; std::uint64_t rays; };
+                Entry stack[Bvh::MAX_DEPTH * N + 1];
+                std::size_t size { 1 };
+                stack[0] = { 0, 0, active };
+
+                while (size > 0) {
+                    Entry entry { stack[--size] };
+                    // With only a few rays left, they go on by themselves, which is faster.
+                    if (__builtin_popcountll(entry.rays) <= ALONE) {
+                        for (std::uint64_t rays = entry.rays; rays != 0; rays &= rays - 1) {
+                            std::size_t r = __builtin_ctzll(rays);
+                            Ray::Hit closest { best[r], static_cast<std::size_t>(bestIndex[r]), bestU[r], bestV[r] };
+                            const Vector3 origin { packet.ox[r], packet.oy[r], packet.oz[r] },
+                                          direction { packet.dx[r], packet.dy[r], packet.dz[r] };
+                            if (entry.count > 0)
+                                intersectWide<T, W>(triangles, entry.index, entry.index + entry.count,
+                                                    origin, direction, closest);
+                            else
+                                traverseWide(nodes, triangles, origin, direction, closest,
+                                             intersectWide<T, W>, entry.index);
+                            if (closest.distance >= best[r]) continue;
+                            best[r] = closest.distance;
+                            bestIndex[r] = closest.index;
+                            bestU[r] = closest.u;
+                            bestV[r] = closest.v;
+                            limit[r] = Bvh::getLimit(closest);
+                        }
+
+                        continue;
+                    }
+
+                    if (entry.count > 0) {
+                        const V epsilon = V {  } + static_cast<T>(Ray::EPSILON);
+                        for (std::size_t c = 0; c < S; c += W) {
+                            if ((entry.rays & lanes(c, W)) == 0) continue;
+                            V rox, roy, roz, rdx, rdy, rdz, b, bu, bv;
+                            M bi;
+                            std::memcpy(&rox, packet.ox + c, sizeof(V)); std::memcpy(&rdx, packet.dx + c, sizeof(V));
+                            std::memcpy(&roy, packet.oy + c, sizeof(V)); std::memcpy(&rdy, packet.dy + c, sizeof(V));
+                            std::memcpy(&roz, packet.oz + c, sizeof(V)); std::memcpy(&rdz, packet.dz + c, sizeof(V));
+                            std::memcpy(&b, best + c, sizeof(V)); std::memcpy(&bi, bestIndex + c, sizeof(M));
+                            std::memcpy(&bu, bestU + c, sizeof(V)); std::memcpy(&bv, bestV + c, sizeof(V));
+
+                            for (std::size_t t = entry.index; t < entry.index + entry.count; ++t) {
+                                V x0 = V {  } + static_cast<T>(triangles.x[0][t]), y0 = V {  } + static_cast<T>(triangles.y[0][t]),
+                                  z0 = V {  } + static_cast<T>(triangles.z[0][t]);
+                                V e1x = (V {  } + static_cast<T>(triangles.x[1][t])) - x0,
+                                  e1y = (V {  } + static_cast<T>(triangles.y[1][t])) - y0,
+                                  e1z = (V {  } + static_cast<T>(triangles.z[1][t])) - z0;
+                                V e2x = (V {  } + static_cast<T>(triangles.x[2][t])) - x0,
+                                  e2y = (V {  } + static_cast<T>(triangles.y[2][t])) - y0,
+                                  e2z = (V {  } + static_cast<T>(triangles.z[2][t])) - z0;
+
+                                V px = rdy * e2z - e2y * rdz, py = rdz * e2x - e2z * rdx, pz = rdx * e2y - e2x * rdy;
+                                V det = e1x * px + e1y * py + e1z * pz;
+                                M hit = (det >= epsilon) | (det <= -epsilon);
+
+                                V inv = static_cast<T>(1) / det;
+                                V tx = rox - x0, ty = roy - y0, tz = roz - z0;
+                                V u = (tx * px + ty * py + tz * pz) * inv;
+                                hit &= (u >= 0) & (u <= 1);
+
+                                V qx = ty * e1z - e1y * tz, qy = tz * e1x - e1z * tx, qz = tx * e1y - e1x * ty;
+                                V v = (rdx * qx + rdy * qy + rdz * qz) * inv;
+                                hit &= (v >= 0) & (u + v <= 1);
+
+                                V distance = (e2x * qx + e2y * qy + e2z * qz) * inv;
+                                hit &= (distance > 0) & (distance < b);
+
+                                b = hit ? distance : b;
+                                bu = hit ? u : bu;
+                                bv = hit ? v : bv;
+                                bi = hit ? M {  } + static_cast<I>(t) : bi;
+                            }
+
+                            std::memcpy(best + c, &b, sizeof(V)); std::memcpy(bestIndex + c, &bi, sizeof(M));
+                            std::memcpy(bestU + c, &bu, sizeof(V)); std::memcpy(bestV + c, &bv, sizeof(V));
+                        }
+
+                        // Closer hits make the rays (and so the frustum) shorter.
+                        farthest = -1.0f;
+                        for (std::size_t r = 0; r < count; ++r) {
+                            if (limit[r] < 0.0f) continue;
+                            if (bestIndex[r] >= 0) {
+                                Ray::Hit closest;
+                                closest.distance = best[r];
+                                limit[r] = Bvh::getLimit(closest);
+                            }
+
+                            farthest = std::max(farthest, limit[r]);
+                        }
+
+                        continue;
+                    }
+
+                    const Bvh::WideNode<N>& node { nodes[entry.index] };
+                    const float* minimum[3] { node.minX, node.minY, node.minZ };
+                    const float* maximum[3] { node.maxX, node.maxY, node.maxZ };
+                    B near = B {  }, far = B {  } + farthest;
+                    for (int a = 0; a < 3; ++a) {
+                        if (!bounded[a]) continue;
+                        bool negative { inverseMax[a] < 0.0f };
+                        B t0, t1;
+                        extreme(t0, negative ? maximum[a] : minimum[a], a, false);
+                        extreme(t1, negative ? minimum[a] : maximum[a], a, true);
+                        near = t0 > near ? t0 : near;
+                        far = t1 < far ? t1 : far;
+                    }
+
+                    C inside = near <= far;
+                    Entry children[N];
+                    std::size_t hit { 0 };
+                    std::uint32_t order { node.order[octant] };
+                    for (std::size_t k = 0; k < N; ++k) {
+                        std::size_t slot { (order >> (4 * k)) & 15 };
+                        if (!inside[slot]) continue;
+                        std::uint64_t rays { hitRays(node, slot, entry.rays) };
+                        if (rays != 0) children[hit++] = { node.child[slot], node.count[slot], rays };
+                    }
+
+                    while (hit > 0) stack[size++] = children[--hit];
+                }
+
+                for (std::size_t r = 0; r < count; ++r) {
+                    if (bestIndex[r] < 0) continue;
+                    hits[r] = { best[r], static_cast<std::size_t>(bestIndex[r]), bestU[r], bestV[r] };
+                }
+            }
+
+            template<typename T, std::size_t W>
+            void intersectPacket(const Bvh& bvh, const Triangles& triangles, const Packet& packet, Ray::Hit* hits) {
+                if (bvh.getLayout() == Bvh::Layout::BVH4)
+                    traversePacket<T, W>(bvh.getNodes4(), triangles, packet, hits);
+                else
+                    traversePacket<T, W>(bvh.getNodes8(), triangles, packet, hits);
+            }
+        }
+
+#ifdef MCRT_SIMD_TARGET
+#undef MCRT_SIMD_TARGET
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+#endif
+    }
+}
+
+#endif
@@ -13,7 +13,11 @@ namespace mcrt {
         double _radius;
     public:
         Sphere(const glm::dvec3 o, double r, Material* m);
-        Ray::Intersection intersect(const Ray& ray) const override;
+        Ray::Hit hit(const Ray&) const override;
+        Ray::Intersection interact(const Ray&, const Ray::Hit&) const override;
+
+        const glm::dvec3& getOrigin() const { return _origin; }
+        double getRadius() const { return _radius; }
     };
 
 }
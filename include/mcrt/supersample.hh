@@ -1,7 +1,7 @@
 #ifndef MCRT_SUPERSAMPLE_HH
 #define MCRT_SUPERSAMPLE_HH
 
-#include <random>
+#include <cmath>
 #include <glm/glm.hpp>
 #include "mcrt/camera.hh"
 
@@ -16,8 +16,7 @@ namespace mcrt {
         Supersampler(size_t samplingAmount, Pattern pattern)
             : samplingAmount { samplingAmount },
               samplingWidth { std::sqrt(samplingAmount) },
-              pattern { pattern },
-              randomNumberGenerator { std::random_device {  }() } {  }
+              pattern { pattern } {  }
 
         Pattern getPattern() const { return this->pattern; }
         void setPattern(Pattern pattern) { this->pattern = pattern; }
@@ -26,19 +25,20 @@ namespace mcrt {
         size_t getSamplingWidth() const { return samplingWidth; }
 
         glm::dvec3 next(Camera::SamplingPlane&, size_t) const;
+        // Where in the pixel the sample is, in [0, 1) unless it's the Gaussian
+        // pattern, which may land outside. The film splats them where they are.
+        glm::dvec2 offset(size_t) const;
+        glm::dvec3 position(Camera::SamplingPlane&, const glm::dvec2&) const;
 
     private:
         // Below are the types of sample pattern distribution.
-        glm::dvec3 grid(Camera::SamplingPlane&, size_t) const;
-        glm::dvec3 prng(Camera::SamplingPlane&, size_t) const;
-        glm::dvec3 norm(Camera::SamplingPlane&, size_t) const;
+        glm::dvec2 grid(size_t) const;
+        glm::dvec2 prng(size_t) const;
+        glm::dvec2 norm(size_t) const;
 
         size_t samplingAmount { 1 };
         double samplingWidth  { 1 };
         Pattern pattern  { Pattern::GRID };
-        mutable std::mt19937 randomNumberGenerator;
-        mutable std::normal_distribution<double> gaussian { 0.5, 0.5 };
-        mutable std::uniform_real_distribution<double> uniform { 0.0, 1.0 };
     };
 }
 
@@ -11,10 +11,16 @@ namespace mcrt {
         glm::dvec3 _v1;
         glm::dvec3 _v2;
         glm::dvec3 _v3;
+        // Don't change after construction, so only worked out once.
+        glm::dvec3 _e1, _e2;
+        glm::dvec3 _normal;
 
     public:
         Triangle(const glm::dvec3& v1,const glm::dvec3& v2,const glm::dvec3& v3, Material* m);
-        Ray::Intersection intersect(const Ray& ray) const override;
+        Ray::Hit hit(const Ray&) const override;
+        Ray::Intersection interact(const Ray&, const Ray::Hit&) const override;
+
+        glm::dmat3 getCorners() const { return { _v1, _v2, _v3 }; }
     };
 }
 #endif
@@ -1,5 +1,21 @@
 --- premake5.lua
 name = "mcrt"
+
+newoption {
+    trigger = "with-mpi",
+    description = "Distributed rendering with OpenMPI"
+}
+
+newoption {
+    trigger = "shared",
+    description = "Build libmcrt as a shared library"
+}
+
+newoption {
+    trigger = "single-precision",
+    description = "Intersect in floats instead of doubles"
+}
+
 workspace (name)
     language "C++"
     location "build"
@@ -23,14 +39,51 @@ workspace (name)
         defines {"WINDOWS"}
     filter {"system:linux or system:bsd"}
         defines {"LINUX_OR_BSD"}
+    -- Changes the layout of the core, so everything that includes it needs it too.
+    filter {"options:single-precision"}
+        defines {"MCRT_SINGLE_PRECISION"}
+
+------ Library
+project ("lib"..name)
+    targetname (name)
+    targetdir "lib"
+    kind "StaticLib"
+    files {"src/foreign/**.cc"}
+    files {"src/"..name.."/**.cc"}
+    includedirs {"include/foreign"}
+    includedirs {"include"}
+
+    -- SIMD kernels, which are only called if the CPU has them (x86 only for now).
+    -- Their instruction sets are picked in mcrt/simd_kernel.hh, only for the kernels
+    -- and only on x86. Without contractions into FMAs (which AVX-512 brings along),
+    -- so they hit exactly what the scalar one hits.
+    filter {"files:src/"..name.."/simd_avx2.cc or src/"..name.."/simd_avx512.cc"}
+        buildoptions {"-ffp-contract=off"}
+
+    filter {"system:macosx"}
+        linkoptions  {"-fopenmp"}
+        buildoptions {"-fopenmp"}
+    filter {"system:windows"}
+        linkoptions  {"-fopenmp"}
+        buildoptions {" -static -static-libgcc -static-libstdc++",
+                      "-mwindows", "-mconsole", "-fopenmp"}
+    filter {"system:linux or system:bsd"}
+        linkoptions  {"-fopenmp"}
+        buildoptions {"-fopenmp"}
+    filter {"options:shared"}
+        kind "SharedLib"
+        pic "On"
+    filter {"options:with-mpi"}
+        defines {"MCRT_MPI"}
+        linkoptions  {"`mpicxx --showme:link`"}
+        buildoptions {"`mpicxx --showme:compile`"}
 
 ------ Program
 project (name)
     targetdir "bin"
     kind "WindowedApp"
     files {"src/main.cc"}
-    files {"src/foreign/**.cc"}
-    files {"src/"..name.."/**.cc"}
+    links {"lib"..name}
     includedirs {"include/foreign"}
     includedirs {"include"}
 
@@ -44,3 +97,34 @@ project (name)
     filter {"system:linux or system:bsd"}
         linkoptions  {"-fopenmp"}
         buildoptions {"-fopenmp"}
+    filter {"options:shared"}
+        runpathdirs {"lib"}
+    filter {"options:with-mpi"}
+        defines {"MCRT_MPI"}
+        linkoptions  {"`mpicxx --showme:link`"}
+        buildoptions {"`mpicxx --showme:compile`"}
+
+------ Tests
+project "tests"
+    targetdir "bin"
+    kind "ConsoleApp"
+    files {"tests/**.cc"}
+    links {"lib"..name}
+    includedirs {"include/foreign"}
+    includedirs {"include"}
+
+    filter {"system:macosx"}
+        linkoptions  {"-fopenmp"}
+        buildoptions {"-fopenmp"}
+    filter {"system:windows"}
+        linkoptions  {"-fopenmp"}
+        buildoptions {"-fopenmp"}
+    filter {"system:linux or system:bsd"}
+        linkoptions  {"-fopenmp"}
+        buildoptions {"-fopenmp"}
+    filter {"options:shared"}
+        runpathdirs {"lib"}
+    filter {"options:with-mpi"}
+        defines {"MCRT_MPI"}
+        linkoptions  {"`mpicxx --showme:link`"}
+        buildoptions {"`mpicxx --showme:compile`"}
@@ -1,2 +0,0 @@
-#define TINYOBJLOADER_IMPLEMENTATION
-#include "tiny_obj_loader.hh"
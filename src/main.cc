@@ -1,160 +1,246 @@
 #include <chrono>
+#include <algorithm>
 #include <cstring>
+#include <fstream>
+#include <sstream>
 #include <iostream>
+#include <string>
 #include <vector>
-#include <numeric>
 
+#include "mcrt/renderer.hh"
 #include "mcrt/param_import.hh"
 #include "mcrt/scene_import.hh"
-#include "mcrt/parameter.hh"
-#include "mcrt/scene.hh"
-
-#include "mcrt/photon.hh"
-#include "mcrt/photon_map.hh"
-
-#include "mcrt/image.hh"
-#include "mcrt/material.hh"
-#include "mcrt/supersample.hh"
 #include "mcrt/image_export.hh"
-#include "mcrt/progress.hh"
+#include "mcrt/checkpoint.hh"
+#include "mcrt/cluster.hh"
+#include "mcrt/server.hh"
+#include "mcrt/benchmark.hh"
 
 int usage(int argc, char** argv) {
     if (argc < 2) std::cerr << "Error: need the path to render scenes to!" << std::endl;
     std::cerr << "Usage: " << argv[0] << " "
-              << "IMAGE-FILE [SCENE-FILE] [PARAM-FILE]"
+              << "[--resume | --continue RAW-FILE] IMAGE-FILE [SCENE-FILE] [PARAM-FILE]"
               << std::endl;
+    std::cerr << "       " << argv[0] << " --serve SOCKET-FILE" << std::endl;
+    std::cerr << "       " << argv[0] << " --benchmark SCENE-FILE [RAYS]" << std::endl;
     return 1;
 }
 
-int main(int argc, char** argv) {
-    if (argc == 1) return usage(argc, argv);
-    if (argc == 2 && std::strcmp(argv[1], "-h") == 0) {
-        // User seems to be requesting for help...
-        return usage(argc, argv);
-    }
-
-    std::string renderImagePath;
-    mcrt::Parameters parameters;
-    mcrt::Scene scene;
+std::string readFile(const char* path) {
+    std::ifstream fileStream { path };
+    std::stringstream contents;
+    contents << fileStream.rdbuf();
+    return contents.str();
+}
 
-    if (argc > 1) renderImagePath = argv[1];
-    else return usage(argc, argv); // Too few arguments.
-    if (argc > 2) scene = mcrt::SceneImporter::load(argv[2]);
-    if (argc > 3) parameters = mcrt::ParameterImporter::load(argv[3]);
-    if (argc > 4) return usage(argc, argv); // Now it's just too many.
+// Frames of a batch are numbered before the extension, e.g render-007.png.
+std::string framePath(const std::string& renderImagePath, size_t frame, size_t frames) {
+    std::string number { std::to_string(frame) };
+    size_t digits { std::max<size_t>(3, std::to_string(frames - 1).size()) };
+    number = std::string(digits - std::min(digits, number.size()), '0') + number;
+
+    size_t extension { renderImagePath.find_last_of('.') };
+    size_t folder { renderImagePath.find_last_of("/\\") };
+    if (extension == std::string::npos || (folder != std::string::npos && extension < folder))
+        return renderImagePath + "-" + number;
+    return renderImagePath.substr(0, extension) + "-" + number + renderImagePath.substr(extension);
+}
 
-    // Shorthands for enabling or disabling the parallel framework under run-time. TODO: OpenMPI.
-    bool openmp  { parameters.parallelFramework == mcrt::Parameters::ParallelFramework::OPENMP };
-    const mcrt::Supersampler sampler { parameters.samplesPerPixel,  parameters.samplingPattern };
+// Traces all passes (until the end pass) into the film of the current camera, and
+// writes it out at rank 0. Leaves checkpoints behind, unless there's no path to them.
+void renderFilm(mcrt::Renderer& renderer, const mcrt::Cluster& cluster, const std::string& renderImagePath,
+                const std::string& checkpointPath, size_t endPass, bool keepFilm,
+                std::chrono::steady_clock::time_point renderStart) {
+    const mcrt::Parameters& parameters { renderer.getParameters() };
+    bool openmpi { parameters.parallelFramework == mcrt::Parameters::ParallelFramework::OPENMPI };
+    int ranks { openmpi ? cluster.getSize() : 1 };
+    bool checkpoints { !checkpointPath.empty() };
 
-    // Note that render background will be transparent.
+    // Save a black image to start off with...
     mcrt::Image renderImage { parameters.resolutionWidth,
                               parameters.resolutionHeight };
-    const mcrt::Camera& sceneCamera { scene.getCamera() };
-
-    // Save a black image to start off with...
     renderImage.clear({ 0.0, 0.0, 0.0, 0.0 });
-    mcrt::ImageExporter::save(renderImage, renderImagePath);
-
-    // Combine settings from the scenes and trace parameters.
-    double fieldOfView { scene.getCamera().getFieldOfView() };
-    scene.getCamera().setAspectRatio(renderImage.getAspectRatio());
-    scene.getCamera().setFieldOfView(fieldOfView);
-
-    mcrt::Scene::maxRayDepth = parameters.maxRayDepth;
-    mcrt::Scene::photonEstimationRadius = parameters.photonEstimationRadius;
-    mcrt::AreaLight::shadowRayCount = parameters.shadowRayCount;
+    if (cluster.isRoot()) mcrt::ImageExporter::save(renderImage, renderImagePath);
+
+    mcrt::CheckpointWriter checkpointWriter { checkpointPath };
+    auto lastCheckpoint { std::chrono::steady_clock::now() };
+    renderer.render(renderer.getPassesUntil(endPass), [&](size_t, size_t) {
+        // Snapshot of the film, written out by another thread.
+        auto now { std::chrono::steady_clock::now() };
+        std::chrono::duration<double> sinceCheckpoint { now - lastCheckpoint };
+        if (checkpoints && parameters.checkpointInterval > 0.0 && sinceCheckpoint.count() >= parameters.checkpointInterval) {
+            checkpointWriter.write(renderer.checkpoint(endPass));
+            lastCheckpoint = now;
+        }
 
-    auto renderStart  { std::chrono::steady_clock::now() };
+        // Preview the current rendered image, only with the passes from rank 0.
+        if (parameters.progressiveRendering && cluster.isRoot()) {
+            renderer.develop(renderImage); // Averages the samples so far.
+            mcrt::ImageExporter::save(renderImage, renderImagePath);
+        }
+    });
 
-    // ==================== Photon Gather Step =====================
+    // The finished film can be continued later too, which always needs one.
+    if (checkpoints && (parameters.checkpointInterval > 0.0 || keepFilm)) {
+        checkpointWriter.write(renderer.checkpoint(endPass));
+        checkpointWriter.wait();
+    }
 
-    if (parameters.photonMap) // Trade-off between speed and memory.
-        scene.gatherPhotons(parameters.photonAmount); // Photon map.
-    if (parameters.photonMapVisualize) // Write photon map to a CSV:
-        scene.dumpPhotonMap("photon-map.csv"); // See: photon-map.r.
+    if (ranks > 1) { // Add up the films from all ranks at rank 0.
+        std::vector<double> filmBuffer { renderer.getFilm().pack() };
+        cluster.reduce(filmBuffer);
+        if (!cluster.isRoot()) return;
+        renderer.getFilm().unpack(filmBuffer);
+    }
 
-    // ===================== Ray Tracing Step ======================
+    auto renderFinish { std::chrono::steady_clock::now() };
 
-    size_t pixelSamplesTaken { 0 }; // Shared resource.
-    const size_t imagePixels { renderImage.getSize() };
-    double samplesPerPixel = parameters.samplesPerPixel;
-    double totalPixelSamples { samplesPerPixel * imagePixels };
-    const glm::dvec3 eyePoint { sceneCamera.getEyePosition() };
+    std::chrono::duration<double> renderDuration { renderFinish - renderStart };
+    size_t renderTimeInSeconds = renderDuration.count();
+    size_t renderTimeInMinutes = renderTimeInSeconds / 60.0;
+    renderTimeInSeconds = renderTimeInSeconds % 60;
+    std::cout << "Render took: " << renderTimeInMinutes << " minutes and "
+                                 << renderTimeInSeconds << " seconds."
+                                 << std::endl;
+    if (parameters.irradianceCache)
+        std::cout << "Irradiance cache: " << renderer.getScene().getIrradianceCache().size()
+                  << " records." << std::endl;
+    if (parameters.virtualLights)
+        std::cout << "Virtual lights: " << renderer.getScene().getLightTree().size()
+                  << " in the lightcut tree." << std::endl;
+
+    renderer.save(renderImagePath); // A resized variant.
+    std::cout << "Rendered to: '" << renderImagePath << "'." << std::endl;
+    if (parameters.recordStatistics) // Write benchmarking data to CSV file.
+        parameters.writeStatistics(renderImagePath, renderDuration.count());
+}
 
-    for (size_t i = 0; i < samplesPerPixel; ++i) {
+int main(int argc, char** argv) {
+    mcrt::Cluster cluster { argc, argv }; // Also a single process if no MPI.
 
-        // ----------------------- Ray Trace -----------------------
+    // Keeps on running, rendering the jobs which are sent to the socket.
+    if (argc == 3 && std::strcmp(argv[1], "--serve") == 0) {
+        if (cluster.getSize() > 1) {
+            std::cerr << "Error: the server can't be distributed!" << std::endl;
+            return 1;
+        }
 
-        #pragma omp parallel for schedule(dynamic) if (openmp)
-        for (size_t y = 0; y < renderImage.getHeight(); ++y) {
+        mcrt::Server server { argv[2] };
+        std::cout << "Serving on: '" << argv[2] << "'." << std::endl;
+        server.run();
+        return 0;
+    }
 
-            #pragma omp critical
-            printProgress("Ray tracing: ", pixelSamplesTaken /
-                                           totalPixelSamples);
-            #pragma omp atomic
-            pixelSamplesTaken += renderImage.getWidth();
+    // Times the intersections (etc.) of the scene's rays, instead of rendering it.
+    if ((argc == 3 || argc == 4) && std::strcmp(argv[1], "--benchmark") == 0) {
+        mcrt::Renderer renderer;
+        renderer.loadScene(argv[2]);
+        std::size_t rays { argc == 4 ? std::stoul(argv[3]) : 100000 };
+        std::vector<mcrt::Ray> sampled { mcrt::benchmark::sampleRays(renderer.getScene(), rays) };
+        mcrt::benchmark::intersections(renderer.getScene(), sampled);
+        mcrt::benchmark::triangles(renderer.getScene(), sampled);
+        mcrt::benchmark::bvh(renderer.getScene(), sampled);
+        mcrt::benchmark::packets(renderer.getScene());
+        return 0;
+    }
 
-            for (size_t x = 0; x < renderImage.getWidth(); ++x) {
+    // Picks up from the checkpoint next to the image, instead of from scratch. Or
+    // adds more samples to a finished render, i.e its checkpoint (the raw film).
+    bool resume { false }, continuing { false };
+    std::string continuePath;
+    if (argc > 1 && std::strcmp(argv[1], "--resume") == 0) {
+        resume = true;
+        ++argv; --argc;
+    } else if (argc > 2 && std::strcmp(argv[1], "--continue") == 0) {
+        continuing = true;
+        continuePath = argv[2];
+        argv += 2; argc -= 2;
+    }
 
-                // Below is the interval in the pixel where we can get further pp samples.
-                auto samplingPlane = sceneCamera.getPixelSamplingPlane(renderImage, x, y);
+    if (argc == 1) return usage(argc, argv);
+    if (argc == 2 && std::strcmp(argv[1], "-h") == 0) {
+        // User seems to be requesting for help...
+        return usage(argc, argv);
+    }
 
-                // Here we actually fetch the next sampling position to take.
-                glm::dvec3 viewPlanePoint { sampler.next(samplingPlane, i) };
-                // Find our where in the scene our eye's pixel sample is looking at...
-                glm::dvec3 rayDirection { glm::normalize(viewPlanePoint - eyePoint) };
-                mcrt::Ray rayFromViewPlane { viewPlanePoint, rayDirection };
+    std::string renderImagePath;
+    if (argc > 1) renderImagePath = argv[1];
+    else return usage(argc, argv); // Too few arguments.
+    if (argc > 4) return usage(argc, argv); // Now it's just too many.
 
-                // Finally, raytrace through the scene and get the pixel irradiance.
-                glm::dvec3 colorPixelSample { scene.rayTrace(rayFromViewPlane, 0) };
-                // Since this is just one sample, it should only contribute a bit...
-                renderImage.pixel(x, y) += colorPixelSample; // We average it later.
+    // Only rank 0 reads the files, the others might not even share a file system.
+    std::string sceneFile, parameterFile;
+    if (cluster.isRoot() && argc > 2) sceneFile = readFile(argv[2]);
+    if (cluster.isRoot() && argc > 3) parameterFile = readFile(argv[3]);
+    cluster.broadcast(sceneFile);
+    cluster.broadcast(parameterFile);
+
+    mcrt::Renderer renderer;
+    renderer.setCluster(cluster);
+    if (argc > 2) renderer.setScene(mcrt::SceneImporter::parse(sceneFile, argv[2]));
+    if (argc > 3) renderer.setParameters(mcrt::ParameterImporter::parse(parameterFile), parameterFile);
+
+    // Each rank has its own, since they all trace their own passes in their films.
+    std::string checkpointPath { renderImagePath + ".checkpoint" };
+    if (cluster.getSize() > 1) checkpointPath += "." + std::to_string(cluster.getRank());
+    mcrt::Checkpoint checkpoint;
+    if (resume) { // Rendered with these parameters, so they must be used from now on.
+        checkpoint = mcrt::Checkpoint::load(checkpointPath);
+        if (!checkpoint.parameters.empty())
+            renderer.setParameters(mcrt::ParameterImporter::parse(checkpoint.parameters),
+                                   checkpoint.parameters);
+    } else if (continuing) { // But here the new parameters give the amount of samples.
+        if (cluster.getSize() > 1) continuePath += "." + std::to_string(cluster.getRank());
+        checkpoint = mcrt::Checkpoint::load(continuePath);
+    }
 
-            }
+    const mcrt::Parameters& parameters { renderer.getParameters() };
 
-        }
+    // Shorthands for enabling or disabling the parallel framework under run-time.
+    bool openmpi { parameters.parallelFramework == mcrt::Parameters::ParallelFramework::OPENMPI };
+    if (openmpi && !mcrt::Cluster::isAvailable())
+        std::cerr << "Warning: built without OpenMPI, rendering in one process!" << std::endl;
+    if (!openmpi && !cluster.isRoot()) return 0; // Wasn't asked to help out.
 
-        // Preview the current rendered image.
-        if (parameters.progressiveRendering) {
-            mcrt::Image previewImage { renderImage }; // Makes copy for this.
-            // We average out the current samples we have taken from the scene.
-            previewImage.filterByColor([i](const mcrt::Color<double>& sample) {
-                return sample / static_cast<double>(i + 1);
-            });
-            mcrt::ImageExporter::save(previewImage, renderImagePath);
-        }
+    // Every frame gets a film of its own, there's nothing to pick up from.
+    const std::vector<mcrt::Camera> cameras { renderer.getScene().getCameras() };
+    if (!cameras.empty() && (resume || continuing)) {
+        std::cerr << "Error: batches of frames can't be resumed or continued!" << std::endl;
+        return 1;
+    }
 
-        // ---------------------------------------------------------
+    auto renderStart  { std::chrono::steady_clock::now() };
 
-    }
+    // ==================== Photon Gather Step =====================
 
-    // =============================================================
+    renderer.prepare(); // Shared by all of the frames.
 
-    auto renderFinish { std::chrono::steady_clock::now() };
+    // ===================== Ray Tracing Step ======================
 
-    printProgress("Ray tracing: ", 1.0); // Might not be 100% in output.
-    std::cout << std::endl; // Reset buffer after progress bar flush() hack.
-    std::chrono::duration<double> renderDuration { renderFinish - renderStart };
-    size_t renderTimeInSeconds = renderDuration.count();
-    size_t renderTimeInMinutes = renderTimeInSeconds / 60.0;
-    renderTimeInSeconds = renderTimeInSeconds % 60;
-    std::cout << "Render took: " << renderTimeInMinutes << " minutes and "
-                                 << renderTimeInSeconds << " seconds."
-                                 << std::endl;
+    if (cameras.empty()) {
+        size_t endPass = parameters.samplesPerPixel;
+        if (resume || continuing) renderer.resume(checkpoint);
+        if (resume) endPass = checkpoint.endPass;
+        // Passes after the old ones have other random streams and sample positions.
+        // Every rank has its own next pass, but all of the passes before the smallest
+        // of them are done, so that's where the new ones start, for all of the ranks.
+        if (continuing) endPass = cluster.minimum(checkpoint.nextPass) + parameters.samplesPerPixel;
+        // Always keeps the finished film, so any render can be continued later on.
+        renderFilm(renderer, cluster, renderImagePath, checkpointPath,
+                   endPass, true, renderStart);
+        return 0;
+    }
 
-    // Finally, averages out the color by taking into account the sampling we have done.
-    renderImage.filterByColor([samplesPerPixel](const mcrt::Color<double>& pixelColor) {
-        return pixelColor / static_cast<double>(samplesPerPixel);
-    });
+    for (size_t frame = 0; frame < cameras.size(); ++frame) {
+        if (cluster.isRoot()) std::cout << "Frame " << frame + 1 << " of "
+                                        << cameras.size() << ":" << std::endl;
+        // Only a new film, the scene stays as it is (and some of the last film too).
+        renderer.nextFrame(cameras[frame]);
+        renderFilm(renderer, cluster, framePath(renderImagePath, frame, cameras.size()), "",
+                   parameters.samplesPerPixel, false, std::chrono::steady_clock::now());
+    }
 
-    size_t scaledWidth  = parameters.resolutionWidth  * parameters.scalingFactorX,
-           scaledHeight = parameters.resolutionHeight * parameters.scalingFactorY;
-    renderImage.resize(scaledWidth, scaledHeight, parameters.interpolationMethod);
+    // =============================================================
 
-    mcrt::ImageExporter::save(renderImage, renderImagePath); // A resized variant.
-    std::cout << "Rendered to: '" << renderImagePath << "'." << std::endl;
-    if (parameters.recordStatistics) // Write benchmarking data to CSV file.
-        parameters.writeStatistics(renderImagePath, renderDuration.count());
     return 0;
 }
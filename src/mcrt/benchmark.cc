@@ -0,0 +1,261 @@
+#include "mcrt/benchmark.hh"
+#include "mcrt/sampling.hh"
+#include "mcrt/image.hh"
+#include "mcrt/bvh.hh"
+#include "mcrt/simd.hh"
+#include "mcrt/mesh.hh"
+
+#include <chrono>
+#include <limits>
+#include <iomanip>
+#include <algorithm>
+
+namespace {
+    struct Timing {
+        double raysPerSecond;
+        double checksum; // Sum of the hit distances, so they can be checked against each other.
+    };
+
+    // Runs the rays until at least a second has gone, so short scenes are timed too.
+    // All of them are given at once, e.g to be traced in packets, and the checksum of
+    // the hit distances comes back.
+    template<typename F> Timing timeAll(const std::vector<mcrt::Ray>& rays, const F& intersect) {
+        auto start = std::chrono::steady_clock::now();
+        std::chrono::duration<double> elapsed { 0.0 };
+        std::size_t traced { 0 };
+        double checksum { 0.0 };
+        while (elapsed.count() < 1.0) {
+            checksum = intersect(rays);
+            traced += rays.size();
+            elapsed = std::chrono::steady_clock::now() - start;
+        }
+
+        return { traced / elapsed.count(), checksum };
+    }
+
+    template<typename F> Timing time(const std::vector<mcrt::Ray>& rays, const F& intersect) {
+        return timeAll(rays, [&intersect](const std::vector<mcrt::Ray>& rays) {
+            double checksum { 0.0 };
+            for (const mcrt::Ray& ray : rays) {
+                double distance { intersect(ray) };
+                if (distance < std::numeric_limits<double>::max()) checksum += distance;
+            }
+
+            return checksum;
+        });
+    }
+
+    // Millions of rays per second, or of something else there's some of in every ray.
+    void report(std::ostream& output, const std::string& name, const Timing& timing, const Timing& baseline,
+                const std::string& unit = "rays", double perRay = 1.0) {
+        output << "    " << std::left << std::setw(24) << name + ":" << std::right << std::fixed
+               << std::setprecision(2) << timing.raysPerSecond * perRay / 1e6 << " M" << unit << "/s ("
+               << timing.raysPerSecond / baseline.raysPerSecond << "x)";
+        // Spheres and triangles are always intersected in double by the virtual calls.
+        const double tolerance { sizeof(mcrt::Real) == sizeof(float) ? 1e-4 : 1e-6 };
+        if (std::abs(timing.checksum - baseline.checksum) > tolerance * std::abs(baseline.checksum))
+            output << ", but different hits!";
+        output << std::endl;
+    }
+
+    // Triangles of a mesh in the order a Bvh put them in, with the padding of Mesh.
+    struct Reordered {
+        std::vector<float> x[3], y[3], z[3];
+
+        Reordered(const mcrt::simd::Triangles& triangles, const std::vector<std::uint32_t>& order) {
+            for (std::size_t k = 0; k < 3; ++k) {
+                x[k].assign(triangles.count + mcrt::simd::PADDING, 0.0f);
+                y[k].assign(triangles.count + mcrt::simd::PADDING, 0.0f);
+                z[k].assign(triangles.count + mcrt::simd::PADDING, 0.0f);
+                for (std::size_t t = 0; t < order.size(); ++t) {
+                    x[k][t] = triangles.x[k][order[t]];
+                    y[k][t] = triangles.y[k][order[t]];
+                    z[k][t] = triangles.z[k][order[t]];
+                }
+            }
+        }
+
+        mcrt::simd::Triangles getTriangles() const {
+            return { { x[0].data(), x[1].data(), x[2].data() },
+                     { y[0].data(), y[1].data(), y[2].data() },
+                     { z[0].data(), z[1].data(), z[2].data() }, x[0].size() - mcrt::simd::PADDING };
+        }
+    };
+}
+
+std::vector<mcrt::Ray> mcrt::benchmark::sampleRays(const Scene& scene, std::size_t count, std::uint64_t seed) {
+    const Image image { 256, 256 };
+    Camera camera { scene.getCamera() };
+    double fieldOfView { camera.getFieldOfView() };
+    camera.setAspectRatio(image.getAspectRatio());
+    camera.setFieldOfView(fieldOfView);
+    const glm::dvec3 eyePoint { camera.getEyePosition() };
+
+    sampling::seed(seed);
+    std::vector<Ray> rays;
+    rays.reserve(count);
+    while (rays.size() < count) {
+        std::size_t x = sampling::uniform() * image.getWidth(),
+                    y = sampling::uniform() * image.getHeight();
+        glm::dvec3 viewPlanePoint { camera.getPixelCenter(image, x, y) };
+        Ray ray { viewPlanePoint, glm::normalize(viewPlanePoint - eyePoint) };
+        rays.push_back(ray);
+
+        Ray::Intersection rayHit = scene.intersect(ray);
+        if (rayHit.material == nullptr || rays.size() == count) continue;
+        glm::dvec3 direction { sampling::cosineHemisphere(rayHit.normal, sampling::uniform(),
+                                                          sampling::uniform()) };
+        rays.push_back({ Ray::offset(rayHit.position, rayHit.normal, direction), direction });
+    }
+
+    return rays;
+}
+
+void mcrt::benchmark::intersections(const Scene& scene, const std::vector<Ray>& rays, std::ostream& output) {
+    const Primitives& primitives { scene.getPrimitives() };
+    output << "Intersections of " << rays.size() << " rays with " << scene.getGeometries().size()
+           << " geometries (" << primitives.getSphereCount() << " spheres, "
+           << primitives.getTriangleCount() << " triangles, " << primitives.getMeshCount()
+           << " meshes and " << primitives.getOtherCount() << " others), in a "
+           << PRECISION << " core:" << std::endl;
+
+    Timing virtualCalls = time(rays, [&scene](const Ray& ray) {
+        double closest { std::numeric_limits<double>::max() };
+        for (const Geometry* geometry : scene.getGeometries()) {
+            Ray::Hit rayHit = geometry->hit(ray);
+            if (rayHit.distance > 0.0 && rayHit.distance < closest) closest = rayHit.distance;
+        }
+
+        return closest;
+    });
+
+    Timing batches = time(rays, [&primitives](const Ray& ray) {
+        return primitives.intersect(ray).distance;
+    });
+
+    report(output, "virtual geometries", virtualCalls, virtualCalls);
+    report(output, "primitive batches", batches, virtualCalls);
+}
+
+void mcrt::benchmark::triangles(const Scene& scene, const std::vector<Ray>& rays, std::ostream& output) {
+    std::vector<simd::Triangles> meshes;
+    std::size_t count { 0 };
+    for (const Geometry* geometry : scene.getGeometries()) {
+        if (const Mesh* mesh = dynamic_cast<const Mesh*>(geometry)) {
+            meshes.push_back(mesh->getTriangles());
+            count += mesh->getTriangleCount();
+        }
+    }
+
+    if (count == 0) return;
+
+    // Every ray is tested against every triangle, so fewer of them for huge meshes.
+    std::size_t used { std::min(rays.size(), std::max<std::size_t>(1, 100000000 / count)) };
+    const std::vector<Ray> subset(rays.begin(), rays.begin() + used);
+    output << "Triangle tests of " << used << " rays against all " << count << " mesh triangles, in a "
+           << PRECISION << " core (using " << simd::getName(simd::getIsa()) << "):" << std::endl;
+
+    Timing baseline { 0.0, 0.0 };
+    for (simd::Isa isa : simd::getSupported()) {
+        simd::Kernel kernel { simd::getKernel(isa) };
+        Timing timing = time(subset, [&meshes, kernel](const Ray& ray) {
+            Ray::Hit closest;
+            closest.distance = std::numeric_limits<double>::max();
+            const Vector3 origin { ray.origin }, direction { ray.direction };
+            for (const simd::Triangles& triangles : meshes)
+                kernel(triangles, 0, triangles.count, origin, direction, closest);
+            return closest.distance;
+        });
+
+        if (isa == simd::Isa::SCALAR) baseline = timing;
+        report(output, simd::getName(isa), timing, baseline, "triangles", count);
+    }
+}
+
+void mcrt::benchmark::bvh(const Scene& scene, const std::vector<Ray>& rays, std::ostream& output) {
+    std::vector<simd::Triangles> meshes;
+    std::size_t count { 0 };
+    for (const Geometry* geometry : scene.getGeometries()) {
+        if (const Mesh* mesh = dynamic_cast<const Mesh*>(geometry)) {
+            meshes.push_back(mesh->getTriangles());
+            count += mesh->getTriangleCount();
+        }
+    }
+
+    if (count == 0) return;
+    output << "Hierarchies over " << count << " mesh triangles, traced by " << rays.size() << " rays, in a "
+           << PRECISION << " core (using " << simd::getName(simd::getIsa()) << "):" << std::endl;
+
+    Timing baseline { 0.0, 0.0 };
+    for (Bvh::Layout layout : { Bvh::Layout::BINARY, Bvh::Layout::BVH4, Bvh::Layout::BVH8 }) {
+        std::vector<Bvh> hierarchies;
+        std::vector<Reordered> reordered;
+        std::size_t nodes { 0 }, bytes { 0 };
+        auto start = std::chrono::steady_clock::now();
+        for (const simd::Triangles& triangles : meshes) {
+            hierarchies.emplace_back(layout);
+            reordered.emplace_back(triangles, hierarchies.back().build(triangles));
+            nodes += hierarchies.back().getNodeCount();
+            bytes += hierarchies.back().getMemoryUsage();
+        }
+
+        std::chrono::duration<double> elapsed { std::chrono::steady_clock::now() - start };
+        Timing timing = time(rays, [&hierarchies, &reordered](const Ray& ray) {
+            Ray::Hit closest;
+            closest.distance = std::numeric_limits<double>::max();
+            const Vector3 origin { ray.origin }, direction { ray.direction };
+            for (std::size_t i = 0; i < hierarchies.size(); ++i)
+                hierarchies[i].intersect(reordered[i].getTriangles(), origin, direction, closest);
+            return closest.distance;
+        });
+
+        if (layout == Bvh::Layout::BINARY) baseline = timing;
+        output << "    " << Bvh::getName(layout) << " built in " << std::fixed << std::setprecision(2)
+               << elapsed.count() * 1e3 << " ms, with " << nodes << " nodes in " << bytes / 1e6 << " MB" << std::endl;
+        report(output, Bvh::getName(layout), timing, baseline);
+    }
+}
+
+void mcrt::benchmark::packets(const Scene& scene, std::ostream& output) {
+    // The centers of the pixels in 8x8 blocks, in the order the renderer has them.
+    const Image image { 256, 256 };
+    const std::size_t block { 8 };
+    Camera camera { scene.getCamera() };
+    double fieldOfView { camera.getFieldOfView() };
+    camera.setAspectRatio(image.getAspectRatio());
+    camera.setFieldOfView(fieldOfView);
+    const glm::dvec3 eyePoint { camera.getEyePosition() };
+
+    std::vector<Ray> rays;
+    rays.reserve(image.getSize());
+    for (std::size_t by = 0; by < image.getHeight(); by += block)
+    for (std::size_t bx = 0; bx < image.getWidth();  bx += block)
+    for (std::size_t y = by; y < by + block; ++y)
+    for (std::size_t x = bx; x < bx + block; ++x) {
+        glm::dvec3 viewPlanePoint { camera.getPixelCenter(image, x, y) };
+        rays.push_back({ viewPlanePoint, glm::normalize(viewPlanePoint - eyePoint) });
+    }
+
+    output << "Camera rays of " << image.getWidth() << "x" << image.getHeight() << " pixels in blocks of "
+           << block << "x" << block << ", in a " << PRECISION << " core (using "
+           << simd::getName(simd::getIsa()) << "):" << std::endl;
+
+    Timing single = time(rays, [&scene](const Ray& ray) {
+        return scene.intersect(ray).distance;
+    });
+
+    Timing packets = timeAll(rays, [&scene, block](const std::vector<Ray>& rays) {
+        double checksum { 0.0 };
+        std::vector<Ray::Intersection> hits(block * block);
+        for (std::size_t first = 0; first < rays.size(); first += block * block) {
+            scene.intersect(rays.data() + first, block * block, hits.data());
+            for (const Ray::Intersection& hit : hits)
+                if (hit.distance < std::numeric_limits<double>::max()) checksum += hit.distance;
+        }
+
+        return checksum;
+    });
+
+    report(output, "one by one", single, single);
+    report(output, "packets", packets, single);
+}
@@ -0,0 +1,464 @@
+#include "mcrt/bidirectional.hh"
+
+#include <cmath>
+#include <glm/gtc/constants.hpp>
+
+#include "mcrt/sampling.hh"
+
+namespace {
+    // Overrides something until the end of the scope, like pbrt's ScopedAssignment,
+    // so the subpaths don't have to be copied for every strategy to be weighted.
+    template<typename T> class ScopedAssignment {
+    public:
+        ScopedAssignment(T* target, const T& value) : target { target } {
+            if (target == nullptr) return;
+            backup = *target;
+            *target = value;
+        }
+
+        ~ScopedAssignment() { if (target != nullptr) *target = backup; }
+
+        ScopedAssignment(const ScopedAssignment&) = delete;
+        ScopedAssignment& operator=(const ScopedAssignment&) = delete;
+
+    private:
+        T* target;
+        T backup {  };
+    };
+}
+
+namespace mcrt {
+    BidirectionalTracer::BidirectionalTracer(const Scene& scene, const Image& image)
+        : scene { scene }, camera { scene.getCamera() }, image { image },
+          maxDepth { Scene::maxRayDepth } {
+        for (const Light* light : scene.getLights()) {
+            const AreaLight* areaLight = dynamic_cast<const AreaLight*>(light);
+            if (areaLight == nullptr) continue; // Point lights can't be hit by paths.
+            const glm::dvec3 radiance { areaLight->material->color * areaLight->intensity };
+            double power { areaLight->area * (radiance.r + radiance.g + radiance.b) };
+            lights.push_back(areaLight);
+            lightPower.push_back(power);
+            totalLightPower += power;
+        }
+    }
+
+    glm::dvec3 BidirectionalTracer::trace(const Ray& ray, Film::Splats& splats) const {
+        Path cameraPath, lightPath;
+        cameraPath.reserve(maxDepth + 2);
+        lightPath.reserve(maxDepth + 1);
+
+        cameraSubpath(ray, cameraPath);
+        lightSubpath(lightPath);
+
+        glm::dvec3 radiance { 0.0 };
+        for (std::size_t t { 1 }; t <= cameraPath.size(); ++t) {
+            for (std::size_t s { 0 }; s <= lightPath.size(); ++s) {
+                if (s + t < 2 || s + t - 2 > maxDepth) continue;
+                if (s == 1 && t == 1) continue; // We can't hit a pinhole.
+                radiance += connect(lightPath, cameraPath, s, t, splats);
+            }
+        }
+
+        return radiance;
+    }
+
+    void BidirectionalTracer::cameraSubpath(const Ray& ray, Path& path) const {
+        Vertex eye;
+        eye.type = Vertex::Type::Camera;
+        eye.position = camera.getEyePosition();
+        eye.normal = glm::dvec3 { 0.0 };
+        // Importance over the pdf of the camera ray is exactly one for pinholes.
+        eye.beta = glm::dvec3 { 1.0 };
+        path.push_back(eye);
+        randomWalk(ray, eye.beta, cameraPdf(ray.direction), path, maxDepth + 1);
+    }
+
+    void BidirectionalTracer::lightSubpath(Path& path) const {
+        double choicePdf;
+        const AreaLight* light { chooseLight(choicePdf) };
+        if (light == nullptr) return;
+
+        glm::dvec3 origin { light->sample() },
+                   direction { light->sampleHemisphere() };
+        double positionPdf { 1.0 / light->area };
+        double cosine { glm::dot(light->normal, direction) };
+        double directionPdf { cosine / glm::pi<double>() };
+        if (directionPdf <= 0.0) return;
+
+        glm::dvec3 radiance { emitted(light, direction) };
+
+        Vertex vertex;
+        vertex.type = Vertex::Type::Light;
+        vertex.position = origin;
+        vertex.normal = light->normal;
+        vertex.light = light;
+        vertex.beta = radiance / (choicePdf * positionPdf);
+        vertex.pdfForward = choicePdf * positionPdf;
+        path.push_back(vertex);
+
+        glm::dvec3 beta { radiance * cosine / (choicePdf * positionPdf * directionPdf) };
+        randomWalk({ Ray::offset(origin, light->normal, direction), direction }, beta, directionPdf, path, maxDepth);
+    }
+
+    void BidirectionalTracer::randomWalk(Ray ray, glm::dvec3 beta, double pdfForward,
+                                         Path& path, std::size_t maxBounces) const {
+        if (maxBounces == 0) return;
+        bool fromCamera { path.front().type == Vertex::Type::Camera };
+
+        for (std::size_t bounces { 0 };;) {
+            Ray::Intersection rayHit = scene.intersect(ray);
+            if (rayHit.material == nullptr) break;
+
+            Vertex vertex;
+            vertex.position = rayHit.position;
+            vertex.normal = rayHit.normal;
+            vertex.material = rayHit.material;
+            vertex.beta = beta;
+
+            if (rayHit.material->type == Material::Type::LightSource) {
+                // Lights don't reflect anything, but camera paths may still use the hit.
+                if (!fromCamera) break;
+                vertex.type = Vertex::Type::Light;
+                vertex.light = findLight(rayHit.material);
+                if (vertex.light == nullptr) break;
+                vertex.normal = vertex.light->normal;
+                vertex.pdfForward = convertDensity(path.back(), pdfForward, vertex);
+                path.push_back(vertex);
+                break;
+            }
+
+            vertex.type = Vertex::Type::Surface;
+            vertex.pdfForward = convertDensity(path.back(), pdfForward, vertex);
+            path.push_back(vertex);
+            if (++bounces >= maxBounces) break;
+
+            glm::dvec3 outgoing { -ray.direction }, incoming, f;
+            double pdf;
+            if (!sampleBsdf(vertex, outgoing, incoming, f, pdf)) break;
+
+            bool delta { vertex.material->type != Material::Type::Diffuse };
+            beta *= f * std::abs(glm::dot(incoming, vertex.normal)) / pdf;
+            double pdfReverse { bsdfPdf(vertex, incoming, outgoing) };
+            pdfForward = pdf;
+            if (delta) {
+                path.back().delta = true;
+                pdfForward = pdfReverse = 0.0;
+            }
+
+            path[path.size() - 2].pdfReverse = convertDensity(path.back(), pdfReverse,
+                                                              path[path.size() - 2]);
+            ray = { Ray::offset(vertex.position, vertex.normal, incoming), incoming };
+        }
+    }
+
+    glm::dvec3 BidirectionalTracer::connect(Path& lightPath, Path& cameraPath,
+                                            std::size_t s, std::size_t t, Film::Splats& splats) const {
+        if (t > 1 && s != 0 && cameraPath[t - 1].type == Vertex::Type::Light)
+            return glm::dvec3 { 0.0 };
+
+        glm::dvec3 radiance { 0.0 };
+        glm::dvec2 raster;
+        Vertex sampled;
+
+        if (s == 0) {
+            // The camera path found a light by itself.
+            const Vertex& pt { cameraPath[t - 1] };
+            if (pt.type != Vertex::Type::Light) return glm::dvec3 { 0.0 };
+            glm::dvec3 toPrevious { glm::normalize(cameraPath[t - 2].position - pt.position) };
+            radiance = emitted(pt.light, toPrevious) * pt.beta;
+        } else if (t == 1) {
+            // Light tracing, i.e connect to the camera and land in some other pixel.
+            const Vertex& qs { lightPath[s - 1] };
+            if (!qs.isConnectible() || qs.type != Vertex::Type::Surface) return glm::dvec3 { 0.0 };
+            if (!camera.getRasterPosition(image, qs.position, raster)) return glm::dvec3 { 0.0 };
+
+            glm::dvec3 eye { camera.getEyePosition() }, forward { camera.getForward() };
+            glm::dvec3 incoming { eye - qs.position };
+            double distanceSquared { glm::dot(incoming, incoming) };
+            incoming = glm::normalize(incoming);
+
+            double cosine { glm::dot(-incoming, forward) };
+            double importance { 1.0 / (camera.getUnitViewPlaneArea() * std::pow(cosine, 4.0)) };
+
+            sampled.type = Vertex::Type::Camera;
+            sampled.position = eye;
+            sampled.normal = glm::dvec3 { 0.0 };
+            sampled.beta = glm::dvec3 { importance * cosine / distanceSquared };
+
+            glm::dvec3 toPrevious { glm::normalize(lightPath[s - 2].position - qs.position) };
+            radiance = qs.beta * bsdf(qs, toPrevious, incoming) * sampled.beta
+                     * std::abs(glm::dot(incoming, qs.normal));
+
+            // Only check against the view plane, not the eye, like the camera rays.
+            double planeDistance { glm::dot(camera.getViewPlanePosition() - eye, forward) };
+            glm::dvec3 planePoint { eye - incoming * (planeDistance / cosine) };
+            if (radiance != glm::dvec3 { 0.0 } && !scene.visible(qs.position, planePoint))
+                radiance = glm::dvec3 { 0.0 };
+        } else if (s == 1) {
+            // Next event estimation, i.e sample a new point on some light source.
+            const Vertex& pt { cameraPath[t - 1] };
+            if (!pt.isConnectible()) return glm::dvec3 { 0.0 };
+
+            double choicePdf;
+            const AreaLight* light { chooseLight(choicePdf) };
+            if (light == nullptr) return glm::dvec3 { 0.0 };
+
+            glm::dvec3 lightPoint { light->sample() };
+            glm::dvec3 incoming { lightPoint - pt.position };
+            double distanceSquared { glm::dot(incoming, incoming) };
+            incoming = glm::normalize(incoming);
+
+            double cosine { glm::dot(light->normal, -incoming) };
+            if (cosine <= 0.0) return glm::dvec3 { 0.0 };
+            double solidAnglePdf { distanceSquared / (cosine * light->area) };
+
+            sampled.type = Vertex::Type::Light;
+            sampled.position = lightPoint;
+            sampled.normal = light->normal;
+            sampled.light = light;
+            sampled.beta = emitted(light, -incoming) / (solidAnglePdf * choicePdf);
+            sampled.pdfForward = pdfLightOrigin(sampled);
+
+            glm::dvec3 toPrevious { glm::normalize(cameraPath[t - 2].position - pt.position) };
+            radiance = pt.beta * bsdf(pt, toPrevious, incoming) * sampled.beta
+                     * std::abs(glm::dot(incoming, pt.normal));
+            if (radiance != glm::dvec3 { 0.0 } && !scene.visible(pt.position, lightPoint))
+                radiance = glm::dvec3 { 0.0 };
+        } else {
+            // Join two vertices in the middle of both subpaths.
+            const Vertex& qs { lightPath[s - 1] };
+            const Vertex& pt { cameraPath[t - 1] };
+            if (!qs.isConnectible() || !pt.isConnectible()) return glm::dvec3 { 0.0 };
+
+            glm::dvec3 toCamera { glm::normalize(pt.position - qs.position) };
+            glm::dvec3 qsPrevious { glm::normalize(lightPath[s - 2].position - qs.position) };
+            glm::dvec3 ptPrevious { glm::normalize(cameraPath[t - 2].position - pt.position) };
+            radiance = qs.beta * bsdf(qs, qsPrevious, toCamera)
+                     * bsdf(pt, ptPrevious, -toCamera) * pt.beta;
+            if (radiance != glm::dvec3 { 0.0 })
+                radiance *= geometry(qs, pt);
+        }
+
+        if (radiance == glm::dvec3 { 0.0 }) return radiance;
+        radiance *= misWeight(lightPath, cameraPath, sampled, s, t);
+
+        if (t == 1) {
+            std::size_t x = raster.x, y = raster.y;
+            splats.add(x, y, radiance);
+            return glm::dvec3 { 0.0 };
+        }
+
+        return radiance;
+    }
+
+    // Power heuristic over all of the other strategies which could have made the path.
+    // Done like pbrt, by walking both subpaths and accumulating the ratio of the pdfs.
+    double BidirectionalTracer::misWeight(Path& lightPath, Path& cameraPath, const Vertex& sampled,
+                                          std::size_t s, std::size_t t) const {
+        if (s + t == 2) return 1.0;
+
+        Vertex* qs      { s > 0 ? &lightPath[s - 1]  : nullptr };
+        Vertex* pt      { t > 0 ? &cameraPath[t - 1] : nullptr };
+        Vertex* qsMinus { s > 1 ? &lightPath[s - 2]  : nullptr };
+        Vertex* ptMinus { t > 1 ? &cameraPath[t - 2] : nullptr };
+
+        // Only these change, and they're restored in the reverse order when we return.
+        ScopedAssignment<Vertex> sampledVertex { s == 1 ? qs : (t == 1 ? pt : nullptr), sampled };
+        ScopedAssignment<bool> ptDelta { pt != nullptr ? &pt->delta : nullptr, false },
+                               qsDelta { qs != nullptr ? &qs->delta : nullptr, false };
+
+        ScopedAssignment<double> ptReverse {
+            pt != nullptr ? &pt->pdfReverse : nullptr,
+            pt != nullptr ? (s > 0 ? pdf(*qs, qsMinus, *pt) : pdfLightOrigin(*pt)) : 0.0 };
+        ScopedAssignment<double> ptMinusReverse {
+            ptMinus != nullptr ? &ptMinus->pdfReverse : nullptr,
+            ptMinus != nullptr ? (s > 0 ? pdf(*pt, qs, *ptMinus) : pdfLight(*pt, *ptMinus)) : 0.0 };
+        ScopedAssignment<double> qsReverse {
+            qs != nullptr ? &qs->pdfReverse : nullptr,
+            qs != nullptr ? pdf(*pt, ptMinus, *qs) : 0.0 };
+        ScopedAssignment<double> qsMinusReverse {
+            qsMinus != nullptr ? &qsMinus->pdfReverse : nullptr,
+            qsMinus != nullptr ? pdf(*qs, pt, *qsMinus) : 0.0 };
+
+        auto remap = [](double pdf) { return pdf != 0.0 ? pdf : 1.0; };
+        auto squared = [](double x) { return x * x; };
+
+        double sumRatios { 0.0 }, ratio { 1.0 };
+        for (std::size_t i { t - 1 }; i > 0; --i) {
+            ratio *= squared(remap(cameraPath[i].pdfReverse) / remap(cameraPath[i].pdfForward));
+            if (!cameraPath[i].delta && !cameraPath[i - 1].delta)
+                sumRatios += ratio;
+        }
+
+        ratio = 1.0;
+        for (std::size_t i { s }; i-- > 0;) {
+            ratio *= squared(remap(lightPath[i].pdfReverse) / remap(lightPath[i].pdfForward));
+            bool deltaBefore { i > 0 ? lightPath[i - 1].delta : false };
+            if (!lightPath[i].delta && !deltaBefore)
+                sumRatios += ratio;
+        }
+
+        return 1.0 / (1.0 + sumRatios);
+    }
+
+    const AreaLight* BidirectionalTracer::chooseLight(double& choicePdf) const {
+        if (lights.empty() || totalLightPower <= 0.0) return nullptr;
+        double target { sampling::uniform() * totalLightPower };
+        for (std::size_t i { 0 }; i < lights.size(); ++i) {
+            if (target < lightPower[i] || i == lights.size() - 1) {
+                choicePdf = lightPower[i] / totalLightPower;
+                return lights[i];
+            }
+            target -= lightPower[i];
+        }
+        return nullptr;
+    }
+
+    double BidirectionalTracer::lightPdf(const AreaLight* light) const {
+        for (std::size_t i { 0 }; i < lights.size(); ++i)
+            if (lights[i] == light) return lightPower[i] / totalLightPower;
+        return 0.0;
+    }
+
+    const AreaLight* BidirectionalTracer::findLight(const Material* material) const {
+        // Each light owns its material, so we can find it this way.
+        for (const AreaLight* light : lights)
+            if (light->material == material) return light;
+        return nullptr;
+    }
+
+    glm::dvec3 BidirectionalTracer::emitted(const AreaLight* light, const glm::dvec3& direction) const {
+        if (light == nullptr || glm::dot(light->normal, direction) <= 0.0) return glm::dvec3 { 0.0 };
+        return light->material->color * light->intensity;
+    }
+
+    glm::dvec3 BidirectionalTracer::bsdf(const Vertex& vertex, const glm::dvec3& outgoing,
+                                         const glm::dvec3& incoming) const {
+        if (vertex.type != Vertex::Type::Surface ||
+            vertex.material->type != Material::Type::Diffuse)
+            return glm::dvec3 { 0.0 }; // Specular ones are only reachable by sampling.
+
+        glm::dvec3 normal { vertex.normal };
+        if (glm::dot(normal, outgoing) < 0.0) normal = -normal;
+        if (glm::dot(normal, incoming) <= 0.0) return glm::dvec3 { 0.0 };
+        return vertex.material->brdf(vertex.position, normal, incoming, outgoing);
+    }
+
+    double BidirectionalTracer::bsdfPdf(const Vertex& vertex, const glm::dvec3& outgoing,
+                                        const glm::dvec3& incoming) const {
+        if (vertex.type != Vertex::Type::Surface ||
+            vertex.material->type != Material::Type::Diffuse)
+            return 0.0;
+
+        glm::dvec3 normal { vertex.normal };
+        if (glm::dot(normal, outgoing) < 0.0) normal = -normal;
+        return std::max(0.0, glm::dot(normal, incoming)) / glm::pi<double>();
+    }
+
+    bool BidirectionalTracer::sampleBsdf(const Vertex& vertex, const glm::dvec3& outgoing,
+                                         glm::dvec3& incoming, glm::dvec3& f, double& pdf) const {
+        const Material* material { vertex.material };
+        glm::dvec3 normal { vertex.normal };
+
+        if (material->type == Material::Type::Diffuse) {
+            if (glm::dot(normal, outgoing) < 0.0) normal = -normal;
+            incoming = sampling::cosineHemisphere(normal, sampling::uniform(), sampling::uniform());
+            pdf = bsdfPdf(vertex, outgoing, incoming);
+            f = bsdf(vertex, outgoing, incoming);
+            return pdf > 0.0;
+        }
+
+        Ray arriving { vertex.position, -outgoing };
+        glm::dvec3 reflected { glm::normalize(-outgoing + 2.0*normal*glm::dot(outgoing, normal)) };
+
+        if (material->type == Material::Type::Reflective) {
+            incoming = reflected;
+            double cosine { std::abs(glm::dot(incoming, normal)) };
+            if (cosine <= 0.0) return false;
+            f = glm::dvec3 { 0.9 / cosine }; // Same falloff as in rayTrace.
+            pdf = 1.0;
+            return true;
+        } else if (material->type == Material::Type::Refractive) {
+            double kr = arriving.fresnel(normal, material->refractionIndex);
+            if (sampling::uniform() < kr) {
+                incoming = reflected;
+                pdf = kr;
+            } else {
+                incoming = arriving.refract(vertex.position, normal, material->refractionIndex).direction;
+                if (glm::length(incoming) <= 0.0) return false;
+                incoming = glm::normalize(incoming);
+                pdf = 1.0 - kr;
+            }
+
+            double cosine { std::abs(glm::dot(incoming, normal)) };
+            if (cosine <= 0.0 || pdf <= 0.0) return false;
+            f = glm::dvec3 { pdf / cosine };
+            return true;
+        }
+
+        return false;
+    }
+
+    double BidirectionalTracer::pdf(const Vertex& vertex, const Vertex* previous, const Vertex& next) const {
+        if (vertex.type == Vertex::Type::Light) return pdfLight(vertex, next);
+
+        glm::dvec3 toNext { glm::normalize(next.position - vertex.position) };
+        double pdf { 0.0 };
+        if (vertex.type == Vertex::Type::Camera) {
+            pdf = cameraPdf(toNext);
+        } else if (previous != nullptr) {
+            glm::dvec3 toPrevious { glm::normalize(previous->position - vertex.position) };
+            pdf = bsdfPdf(vertex, toPrevious, toNext);
+        }
+
+        return convertDensity(vertex, pdf, next);
+    }
+
+    double BidirectionalTracer::pdfLight(const Vertex& vertex, const Vertex& next) const {
+        glm::dvec3 direction { next.position - vertex.position };
+        double distanceSquared { glm::dot(direction, direction) };
+        if (distanceSquared <= 0.0) return 0.0;
+        direction /= std::sqrt(distanceSquared);
+
+        double pdf { std::max(0.0, glm::dot(vertex.normal, direction)) / glm::pi<double>() };
+        pdf /= distanceSquared;
+        if (next.isOnSurface()) pdf *= std::abs(glm::dot(next.normal, direction));
+        return pdf;
+    }
+
+    double BidirectionalTracer::pdfLightOrigin(const Vertex& vertex) const {
+        if (vertex.light == nullptr) return 0.0;
+        return lightPdf(vertex.light) / vertex.light->area;
+    }
+
+    double BidirectionalTracer::cameraPdf(const glm::dvec3& direction) const {
+        double cosine { glm::dot(direction, camera.getForward()) };
+        if (cosine <= 0.0) return 0.0;
+        glm::dvec2 raster; // Outside of the view plane it could never have been sampled.
+        if (!camera.getRasterPosition(image, camera.getEyePosition() + direction, raster)) return 0.0;
+        return 1.0 / (camera.getUnitViewPlaneArea() * cosine * cosine * cosine);
+    }
+
+    // From solid angle at the vertex to the area measure at the next one.
+    double BidirectionalTracer::convertDensity(const Vertex& vertex, double pdf, const Vertex& next) const {
+        glm::dvec3 direction { next.position - vertex.position };
+        double distanceSquared { glm::dot(direction, direction) };
+        if (distanceSquared <= 0.0) return 0.0;
+        pdf /= distanceSquared;
+        if (next.isOnSurface())
+            pdf *= std::abs(glm::dot(next.normal, direction / std::sqrt(distanceSquared)));
+        return pdf;
+    }
+
+    double BidirectionalTracer::geometry(const Vertex& a, const Vertex& b) const {
+        glm::dvec3 direction { a.position - b.position };
+        double distanceSquared { glm::dot(direction, direction) };
+        if (distanceSquared <= 0.0) return 0.0;
+        direction /= std::sqrt(distanceSquared);
+
+        double g { 1.0 / distanceSquared };
+        if (a.isOnSurface()) g *= std::abs(glm::dot(a.normal, direction));
+        if (b.isOnSurface()) g *= std::abs(glm::dot(b.normal, direction));
+        return scene.visible(a.position, b.position) ? g : 0.0;
+    }
+}
@@ -3,8 +3,8 @@
 namespace mcrt {
     BoundingSphere::BoundingSphere(const glm::dvec3& origin, const double& radius) : _origin(origin), _radius(radius) {}
 
-    Ray::Intersection BoundingSphere::intersect(const Ray& ray) const {
-        Ray::Intersection result {0, glm::dvec3(0.0), nullptr, glm::dvec3(0.0)};
+    double BoundingSphere::intersect(const Ray& ray) const {
+        double result { 0.0 };
 
         double t0,t1;
         glm::dvec3 L = _origin - ray.origin;
@@ -35,8 +35,6 @@ namespace mcrt {
             }
         }
 
-        result.distance = t0;
-        result.normal = glm::normalize((ray.origin + ray.direction * t0) - _origin);
-        return result;
+        return t0;
     }
 }
@@ -0,0 +1,406 @@
+#include "mcrt/bvh.hh"
+
+#include <limits>
+#include <numeric>
+#include <algorithm>
+
+namespace {
+    struct Bounds {
+        glm::vec3 min { std::numeric_limits<float>::max() }, max { -std::numeric_limits<float>::max() };
+
+        void extend(const glm::vec3& point) {
+            min = glm::min(min, point);
+            max = glm::max(max, point);
+        }
+
+        void extend(const Bounds& bounds) {
+            min = glm::min(min, bounds.min);
+            max = glm::max(max, bounds.max);
+        }
+
+        float getArea() const {
+            if (min.x > max.x) return 0.0f;
+            glm::vec3 size { max - min };
+            return 2.0f * (size.x*size.y + size.y*size.z + size.z*size.x);
+        }
+
+        // A bit bigger than the triangles, so rays (rounded to floats) never miss what
+        // they would hit in the triangle tests. The planes are farther out than their
+        // rounding errors, which are relative to how far from the origin they are.
+        Bounds padded() const {
+            glm::vec3 magnitude { glm::max(glm::abs(min), glm::abs(max)) };
+            float pad { 1e-5f * std::max(1.0f, std::max(magnitude.x, std::max(magnitude.y, magnitude.z))) };
+            return { min - pad, max + pad };
+        }
+    };
+
+    Bounds getBounds(const mcrt::simd::Triangles& triangles, std::size_t begin, std::size_t end) {
+        Bounds bounds;
+        for (std::size_t t = begin; t < end; ++t)
+            for (std::size_t k = 0; k < 3; ++k)
+                bounds.extend({ triangles.x[k][t], triangles.y[k][t], triangles.z[k][t] });
+        return bounds;
+    }
+
+    void setBounds(mcrt::Bvh::Node& node, const Bounds& bounds) {
+        for (int a = 0; a < 3; ++a) {
+            node.min[a] = bounds.min[a];
+            node.max[a] = bounds.max[a];
+        }
+    }
+
+    Bounds getBounds(const mcrt::Bvh::Node& node) {
+        return { { node.min[0], node.min[1], node.min[2] }, { node.max[0], node.max[1], node.max[2] } };
+    }
+
+    template<std::size_t N> void setBounds(mcrt::Bvh::WideNode<N>& node, std::size_t slot, const Bounds& bounds) {
+        node.minX[slot] = bounds.min.x; node.minY[slot] = bounds.min.y; node.minZ[slot] = bounds.min.z;
+        node.maxX[slot] = bounds.max.x; node.maxY[slot] = bounds.max.y; node.maxZ[slot] = bounds.max.z;
+    }
+
+    template<std::size_t N> Bounds getBounds(const mcrt::Bvh::WideNode<N>& node) {
+        Bounds bounds;
+        for (std::size_t slot = 0; slot < N; ++slot) {
+            if (node.child[slot] == 0 && node.count[slot] == 0) continue;
+            bounds.extend({ node.minX[slot], node.minY[slot], node.minZ[slot] });
+            bounds.extend({ node.maxX[slot], node.maxY[slot], node.maxZ[slot] });
+        }
+
+        return bounds;
+    }
+
+    // Top down, by binning the centroids of the triangles along each of the axes, and
+    // splitting where the surface area heuristic says it's cheapest to trace through.
+    struct Builder {
+        static constexpr std::size_t BINS { 16 };
+
+        std::vector<Bounds> bounds;
+        std::vector<glm::vec3> centroids;
+        std::vector<std::uint32_t> order;
+        std::vector<mcrt::Bvh::Node>& nodes;
+
+        void split(std::size_t node, std::size_t begin, std::size_t end, std::size_t depth) {
+            Bounds box, centroidBox;
+            for (std::size_t i = begin; i < end; ++i) {
+                box.extend(bounds[order[i]]);
+                centroidBox.extend(centroids[order[i]]);
+            }
+
+            std::size_t count { end - begin };
+            setBounds(nodes[node], box.padded());
+            nodes[node].index = begin;
+            nodes[node].count = count;
+            nodes[node].axis = 0;
+            if (count == 1 || depth >= mcrt::Bvh::MAX_DEPTH) return;
+
+            // Splitting after bin b along axis a costs (relative to testing a triangle)
+            // one box test, and then the triangles on each side by how likely it's hit.
+            float bestCost { std::numeric_limits<float>::max() };
+            std::size_t bestAxis { 0 }, bestBin { 0 };
+            for (std::size_t axis = 0; axis < 3; ++axis) {
+                float extent { centroidBox.max[axis] - centroidBox.min[axis] };
+                if (extent <= 0.0f) continue;
+
+                Bounds binBounds[BINS];
+                std::size_t binCounts[BINS] { 0 };
+                float scale { BINS / extent };
+                for (std::size_t i = begin; i < end; ++i) {
+                    std::size_t bin { getBin(centroids[order[i]][axis], centroidBox.min[axis], scale) };
+                    binBounds[bin].extend(bounds[order[i]]);
+                    ++binCounts[bin];
+                }
+
+                float rightCosts[BINS];
+                Bounds right;
+                std::size_t rightCount { 0 };
+                for (std::size_t bin = BINS - 1; bin > 0; --bin) {
+                    right.extend(binBounds[bin]);
+                    rightCount += binCounts[bin];
+                    rightCosts[bin - 1] = right.getArea() * rightCount;
+                }
+
+                Bounds left;
+                std::size_t leftCount { 0 };
+                for (std::size_t bin = 0; bin < BINS - 1; ++bin) {
+                    left.extend(binBounds[bin]);
+                    leftCount += binCounts[bin];
+                    float cost { left.getArea() * leftCount + rightCosts[bin] };
+                    if (leftCount > 0 && leftCount < count && cost < bestCost) {
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestBin = bin;
+                    }
+                }
+            }
+
+            std::size_t middle;
+            if (bestCost == std::numeric_limits<float>::max()) {
+                // All of the centroids are in the same place, so just split them in half.
+                if (count <= mcrt::Bvh::MAX_LEAF) return;
+                middle = begin + count / 2;
+            } else {
+                float area { box.getArea() };
+                if (count <= mcrt::Bvh::MAX_LEAF && area * count <= area + bestCost) return;
+
+                float scale { BINS / (centroidBox.max[bestAxis] - centroidBox.min[bestAxis]) };
+                float minimum { centroidBox.min[bestAxis] };
+                auto first = order.begin() + begin, last = order.begin() + end;
+                middle = std::partition(first, last, [&](std::uint32_t triangle) {
+                    return getBin(centroids[triangle][bestAxis], minimum, scale) <= bestBin;
+                }) - order.begin();
+            }
+
+            std::size_t child { nodes.size() };
+            nodes[node].index = child;
+            nodes[node].count = 0;
+            nodes[node].axis = bestAxis;
+            nodes.emplace_back();
+            nodes.emplace_back();
+            split(child, begin, middle, depth + 1);
+            split(child + 1, middle, end, depth + 1);
+        }
+
+        static std::size_t getBin(float centroid, float minimum, float scale) {
+            return std::min(BINS - 1, static_cast<std::size_t>((centroid - minimum) * scale));
+        }
+    };
+
+    // The inner node with the largest area in the frontier is opened up, since that's
+    // the one most rays go through, until it has as many children as a wide node can.
+    template<std::size_t N> std::size_t collapseNode(const std::vector<mcrt::Bvh::Node>& binary,
+                                                     std::vector<mcrt::Bvh::WideNode<N>>& wide,
+                                                     std::size_t root, std::size_t index) {
+        std::size_t frontier[N] { root }, size { 1 };
+        while (size < N) {
+            std::size_t largest { N };
+            float largestArea { -1.0f };
+            for (std::size_t i = 0; i < size; ++i) {
+                const mcrt::Bvh::Node& node { binary[frontier[i]] };
+                float area { getBounds(node).getArea() };
+                if (node.count == 0 && area > largestArea) {
+                    largest = i;
+                    largestArea = area;
+                }
+            }
+
+            if (largest == N) break;
+            std::size_t children { binary[frontier[largest]].index };
+            frontier[largest] = children;
+            frontier[size++] = children + 1;
+        }
+
+        mcrt::Bvh::WideNode<N> node;
+        for (std::size_t slot = 0; slot < N; ++slot) {
+            setBounds(node, slot, Bounds {  });
+            node.child[slot] = node.count[slot] = 0;
+        }
+
+        for (std::size_t slot = 0; slot < size; ++slot) {
+            const mcrt::Bvh::Node& child { binary[frontier[slot]] };
+            setBounds(node, slot, getBounds(child));
+            if (child.count > 0) {
+                node.child[slot] = child.index;
+                node.count[slot] = child.count;
+            } else {
+                node.child[slot] = wide.size();
+                wide.emplace_back();
+                collapseNode(binary, wide, frontier[slot], node.child[slot]);
+            }
+        }
+
+        // Front to back is the order of the binary tree, with the children swapped on
+        // every axis the rays go down along. The empty slots are just put at the end.
+        for (unsigned octant = 0; octant < 8; ++octant) {
+            std::size_t slots { 0 };
+            std::uint32_t order { 0 };
+            auto visit = [&](std::size_t b, const auto& visit) -> void {
+                const std::size_t* found { std::find(frontier, frontier + size, b) };
+                if (found != frontier + size) {
+                    order |= static_cast<std::uint32_t>(found - frontier) << (4 * slots++);
+                    return;
+                }
+
+                const mcrt::Bvh::Node& inner { binary[b] };
+                bool flip { ((octant >> inner.axis) & 1) != 0 };
+                visit(inner.index + (flip ? 1 : 0), visit);
+                visit(inner.index + (flip ? 0 : 1), visit);
+            };
+
+            visit(root, visit);
+            for (std::size_t slot = size; slot < N; ++slot)
+                order |= static_cast<std::uint32_t>(slot) << (4 * slots++);
+            node.order[octant] = order;
+        }
+
+        wide[index] = node;
+        return index;
+    }
+
+    bool hitBox(const mcrt::Bvh::Node& node, const float origin[3], const float inverse[3], float limit) {
+        float near { 0.0f }, far { limit };
+        for (int a = 0; a < 3; ++a) {
+            float t0 { (node.min[a] - origin[a]) * inverse[a] },
+                  t1 { (node.max[a] - origin[a]) * inverse[a] };
+            if (inverse[a] < 0.0f) std::swap(t0, t1);
+            near = t0 > near ? t0 : near;
+            far = t1 < far ? t1 : far;
+        }
+
+        return near <= far;
+    }
+
+    // One box at a time, nearest child first (by the sign along the split axis).
+    void traverseBinary(const std::vector<mcrt::Bvh::Node>& nodes, const mcrt::simd::Triangles& triangles,
+                        const mcrt::Vector3& origin, const mcrt::Vector3& direction, mcrt::Ray::Hit& closest) {
+        if (nodes.empty()) return;
+        const float rayOrigin[3] { static_cast<float>(origin.x), static_cast<float>(origin.y),
+                                   static_cast<float>(origin.z) };
+        const float inverse[3] { 1.0f / static_cast<float>(direction.x), 1.0f / static_cast<float>(direction.y),
+                                 1.0f / static_cast<float>(direction.z) };
+
+        std::uint32_t stack[mcrt::Bvh::MAX_DEPTH + 2];
+        std::size_t size { 1 };
+        stack[0] = 0;
+        while (size > 0) {
+            const mcrt::Bvh::Node& node { nodes[stack[--size]] };
+            if (!hitBox(node, rayOrigin, inverse, mcrt::Bvh::getLimit(closest))) continue;
+
+            if (node.count > 0) {
+                mcrt::simd::intersect(triangles, node.index, node.index + node.count, origin, direction, closest);
+                continue;
+            }
+
+            bool flip { inverse[node.axis] < 0.0f };
+            stack[size++] = node.index + (flip ? 0 : 1);
+            stack[size++] = node.index + (flip ? 1 : 0);
+        }
+    }
+}
+
+mcrt::Bvh::Layout mcrt::Bvh::getDefaultLayout() {
+    return simd::getIsa() >= simd::Isa::AVX2 ? Layout::BVH8 : Layout::BVH4;
+}
+
+mcrt::Bvh::Bvh(Layout layout) : layout { layout } {  }
+
+std::vector<std::uint32_t> mcrt::Bvh::build(const simd::Triangles& triangles) {
+    binary.clear();
+    nodes4.clear();
+    nodes8.clear();
+    if (triangles.count == 0) return {};
+
+    Builder builder { {  }, {  }, {  }, binary };
+    builder.bounds.reserve(triangles.count);
+    builder.centroids.reserve(triangles.count);
+    for (std::size_t t = 0; t < triangles.count; ++t) {
+        builder.bounds.push_back(getBounds(triangles, t, t + 1));
+        builder.centroids.push_back((builder.bounds.back().min + builder.bounds.back().max) * 0.5f);
+    }
+
+    builder.order.resize(triangles.count);
+    std::iota(builder.order.begin(), builder.order.end(), 0);
+    binary.reserve(2 * triangles.count - 1);
+    binary.emplace_back();
+    builder.split(0, 0, triangles.count, 0);
+
+    if (layout == Layout::BVH4) collapse(nodes4);
+    if (layout == Layout::BVH8) collapse(nodes8);
+    if (layout != Layout::BINARY) std::vector<Node> {  }.swap(binary);
+    binary.shrink_to_fit();
+    return builder.order;
+}
+
+template<std::size_t N> void mcrt::Bvh::collapse(std::vector<WideNode<N>>& nodes) {
+    nodes.clear();
+    nodes.reserve(binary.size() / 2);
+    nodes.emplace_back();
+    collapseNode(binary, nodes, 0, 0);
+    nodes.shrink_to_fit();
+}
+
+void mcrt::Bvh::refit(const simd::Triangles& triangles) {
+    // Children are always after their parents, so backwards has them done first.
+    for (std::size_t i = binary.size(); i-- > 0;) {
+        Node& node { binary[i] };
+        if (node.count > 0) {
+            setBounds(node, getBounds(triangles, node.index, node.index + node.count).padded());
+        } else {
+            Bounds bounds { getBounds(binary[node.index]) };
+            bounds.extend(getBounds(binary[node.index + 1]));
+            setBounds(node, bounds);
+        }
+    }
+
+    refit(nodes4, triangles);
+    refit(nodes8, triangles);
+}
+
+template<std::size_t N> void mcrt::Bvh::refit(std::vector<WideNode<N>>& nodes, const simd::Triangles& triangles) {
+    for (std::size_t i = nodes.size(); i-- > 0;) {
+        WideNode<N>& node { nodes[i] };
+        for (std::size_t slot = 0; slot < N; ++slot) {
+            if (node.count[slot] > 0) {
+                std::size_t first { node.child[slot] };
+                setBounds(node, slot, getBounds(triangles, first, first + node.count[slot]).padded());
+            } else if (node.child[slot] != 0) {
+                setBounds(node, slot, getBounds(nodes[node.child[slot]]));
+            }
+        }
+    }
+}
+
+void mcrt::Bvh::assign(std::vector<Node> nodes) {
+    layout = Layout::BINARY;
+    binary = std::move(nodes);
+    nodes4.clear();
+    nodes8.clear();
+}
+
+void mcrt::Bvh::assign(std::vector<WideNode<4>> nodes) {
+    layout = Layout::BVH4;
+    binary.clear();
+    nodes4 = std::move(nodes);
+    nodes8.clear();
+}
+
+void mcrt::Bvh::assign(std::vector<WideNode<8>> nodes) {
+    layout = Layout::BVH8;
+    binary.clear();
+    nodes4.clear();
+    nodes8 = std::move(nodes);
+}
+
+void mcrt::Bvh::intersect(const simd::Triangles& triangles, const Vector3& origin,
+                          const Vector3& direction, Ray::Hit& closest) const {
+    if (layout == Layout::BINARY) return traverseBinary(binary, triangles, origin, direction, closest);
+    static const simd::BvhKernel kernel { simd::getBvhKernel(simd::getIsa()) };
+    kernel(*this, triangles, origin, direction, closest);
+}
+
+void mcrt::Bvh::intersect(const simd::Triangles& triangles, const simd::Packet& packet, Ray::Hit* hits) const {
+    static const simd::PacketKernel kernel { simd::getPacketKernel(simd::getIsa()) };
+    if (layout != Layout::BINARY && kernel != nullptr) return kernel(*this, triangles, packet, hits);
+    for (std::size_t r = 0; r < packet.count; ++r) {
+        if (hits[r].distance <= 0.0) continue;
+        intersect(triangles, { packet.ox[r], packet.oy[r], packet.oz[r] },
+                  { packet.dx[r], packet.dy[r], packet.dz[r] }, hits[r]);
+    }
+}
+
+const char* mcrt::Bvh::getName(Layout layout) {
+    switch (layout) {
+    case Layout::BINARY: return "binary";
+    case Layout::BVH4:   return "bvh4";
+    case Layout::BVH8:   return "bvh8";
+    default:             return "unknown";
+    }
+}
+
+std::size_t mcrt::Bvh::getNodeCount() const {
+    return binary.size() + nodes4.size() + nodes8.size();
+}
+
+std::size_t mcrt::Bvh::getMemoryUsage() const {
+    return binary.capacity() * sizeof(Node) + nodes4.capacity() * sizeof(WideNode<4>) +
+           nodes8.capacity() * sizeof(WideNode<8>);
+}
@@ -97,6 +97,37 @@ mcrt::Camera::SamplingPlane mcrt::Camera::getPixelSamplingPlane(const Image& ima
     return pixelSamplingPlane;
 }
 
+bool mcrt::Camera::getRasterPosition(const Image& image, const glm::dvec3& point, glm::dvec2& raster) const {
+    glm::dvec3 forward { getForward() };
+    glm::dvec3 direction { point - eyePoint };
+    double alignment { glm::dot(direction, forward) };
+    if (alignment <= 0.0) return false; // Behind us.
+
+    // Find where the line to the eye crosses the view plane.
+    double planeDistance { glm::dot(getViewPlanePosition() - eyePoint, forward) };
+    glm::dvec3 planePoint { eyePoint + direction * (planeDistance / alignment) };
+
+    glm::dvec3 xViewPlaneAxis { viewPlane[1] - viewPlane[0] },
+               yViewPlaneAxis { viewPlane[3] - viewPlane[0] };
+    double x { glm::dot(planePoint - viewPlane[0], xViewPlaneAxis) / glm::dot(xViewPlaneAxis, xViewPlaneAxis) },
+           y { glm::dot(planePoint - viewPlane[0], yViewPlaneAxis) / glm::dot(yViewPlaneAxis, yViewPlaneAxis) };
+    if (x < 0.0 || x >= 1.0 || y < 0.0 || y >= 1.0) return false;
+
+    raster = { x * image.getWidth(), y * image.getHeight() };
+    return true;
+}
+
+double mcrt::Camera::getUnitViewPlaneArea() const {
+    double eyeToPlaneDistance { glm::distance(eyePoint, getViewPlanePosition()) };
+    double viewPlaneWidth  { glm::distance(viewPlane[1], viewPlane[0]) },
+           viewPlaneHeight { glm::distance(viewPlane[3], viewPlane[0]) };
+    return viewPlaneWidth * viewPlaneHeight / (eyeToPlaneDistance * eyeToPlaneDistance);
+}
+
+glm::dvec3 mcrt::Camera::getForward() const {
+    return glm::normalize(getViewPlanePosition() - eyePoint);
+}
+
 void mcrt::Camera::moveTo(const glm::dvec3& viewPlanePosition) {
     glm::dvec3 planeToCamera { eyePoint - getViewPlanePosition() };
     glm::dvec3 viewPlaneCenter { getViewPlanePosition() };
@@ -0,0 +1,115 @@
+#include "mcrt/checkpoint.hh"
+#include "mcrt/film.hh"
+
+#include <cstdio>
+#include <limits>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+    const char MAGIC[] { 'M', 'C', 'R', 'T', 'C', 'K', 'P', 'T' };
+
+    template<typename T> void write(std::ofstream& fileStream, const T& value) {
+        fileStream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template<typename T> T read(std::ifstream& fileStream) {
+        T value { 0 };
+        fileStream.read(reinterpret_cast<char*>(&value), sizeof(T));
+        return value;
+    }
+
+    // Bytes after the current position, so no length is trusted beyond the file.
+    std::uint64_t remaining(std::ifstream& fileStream) {
+        std::streampos position { fileStream.tellg() };
+        fileStream.seekg(0, std::ios::end);
+        std::streampos end { fileStream.tellg() };
+        fileStream.seekg(position);
+        return fileStream ? static_cast<std::uint64_t>(end - position) : 0;
+    }
+}
+
+void mcrt::Checkpoint::save(const std::string& file) const {
+    // Written to the side first, so a crash mid-write keeps the last checkpoint.
+    std::string temporaryFile { file + ".tmp" };
+    std::ofstream fileStream { temporaryFile, std::ios::binary };
+    if (!fileStream) throw std::runtime_error { "Could not create '" + temporaryFile + "'!" };
+
+    fileStream.write(MAGIC, sizeof(MAGIC));
+    write<std::uint32_t>(fileStream, std::uint32_t { VERSION });
+    write(fileStream, width);
+    write(fileStream, height);
+    write(fileStream, seed);
+    write(fileStream, nextPass);
+    write(fileStream, endPass);
+    write<std::uint64_t>(fileStream, parameters.size());
+    fileStream.write(parameters.data(), parameters.size());
+    write<std::uint64_t>(fileStream, film.size());
+    fileStream.write(reinterpret_cast<const char*>(film.data()), film.size() * sizeof(double));
+
+    fileStream.close();
+    if (!fileStream) throw std::runtime_error { "Could not write '" + temporaryFile + "'!" };
+    if (std::rename(temporaryFile.c_str(), file.c_str()) != 0)
+        throw std::runtime_error { "Could not replace '" + file + "'!" };
+}
+
+mcrt::Checkpoint mcrt::Checkpoint::load(const std::string& file) {
+    std::ifstream fileStream { file, std::ios::binary };
+    if (!fileStream) throw std::runtime_error { "Could not open '" + file + "'!" };
+
+    char magic[sizeof(MAGIC)];
+    fileStream.read(magic, sizeof(magic));
+    if (!fileStream || !std::equal(magic, magic + sizeof(magic), MAGIC))
+        throw std::runtime_error { "'" + file + "' isn't a checkpoint!" };
+    if (read<std::uint32_t>(fileStream) != VERSION)
+        throw std::runtime_error { "'" + file + "' is from another version!" };
+
+    Checkpoint checkpoint;
+    checkpoint.width = read<std::uint64_t>(fileStream);
+    checkpoint.height = read<std::uint64_t>(fileStream);
+    checkpoint.seed = read<std::uint64_t>(fileStream);
+    checkpoint.nextPass = read<std::uint64_t>(fileStream);
+    checkpoint.endPass = read<std::uint64_t>(fileStream);
+
+    // The film has to be exactly as big as its resolution, or it'd be read out of bounds.
+    const std::uint64_t maximum { std::numeric_limits<std::size_t>::max() / 8 };
+    if (checkpoint.width == 0 || checkpoint.height == 0 || checkpoint.width > maximum / checkpoint.height)
+        throw std::runtime_error { "'" + file + "' has a malformed resolution!" };
+
+    std::uint64_t parameterLength { read<std::uint64_t>(fileStream) };
+    if (!fileStream || parameterLength > remaining(fileStream))
+        throw std::runtime_error { "'" + file + "' is truncated!" };
+    checkpoint.parameters.resize(parameterLength);
+    fileStream.read(&checkpoint.parameters[0], checkpoint.parameters.size());
+
+    std::uint64_t filmLength { read<std::uint64_t>(fileStream) };
+    if (filmLength != Film::getPackedSize(checkpoint.width, checkpoint.height))
+        throw std::runtime_error { "The film in '" + file + "' doesn't fit its resolution!" };
+    if (!fileStream || filmLength > remaining(fileStream) / sizeof(double))
+        throw std::runtime_error { "'" + file + "' is truncated!" };
+    checkpoint.film.resize(filmLength);
+    fileStream.read(reinterpret_cast<char*>(checkpoint.film.data()),
+                    checkpoint.film.size() * sizeof(double));
+
+    if (!fileStream) throw std::runtime_error { "'" + file + "' is truncated!" };
+    return checkpoint;
+}
+
+void mcrt::CheckpointWriter::write(Checkpoint&& checkpoint) {
+    wait();
+    std::string file { path };
+    pending = std::async(std::launch::async, [file](Checkpoint checkpoint) {
+        checkpoint.save(file);
+    }, std::move(checkpoint));
+}
+
+void mcrt::CheckpointWriter::wait() {
+    if (!pending.valid()) return;
+    // Losing a checkpoint isn't worth stopping the render over.
+    try { pending.get(); }
+    catch (const std::exception& error) {
+        std::cerr << "Warning: " << error.what() << std::endl;
+    }
+}
@@ -0,0 +1,107 @@
+#include "mcrt/cluster.hh"
+
+#include <algorithm>
+
+#ifdef MCRT_MPI
+#include <mpi.h>
+
+namespace {
+    // Counts are ints in MPI, so anything bigger than this (e.g photon maps and films
+    // of a few GiB) is sent as several messages, which arrive in the order they left.
+    constexpr std::size_t CHUNK_BYTES { std::size_t { 1 } << 30 };
+
+    void broadcastBytes(void* data, std::size_t bytes) {
+        char* begin { static_cast<char*>(data) };
+        for (std::size_t sent { 0 }; sent < bytes; sent += CHUNK_BYTES) {
+            int count { static_cast<int>(std::min(CHUNK_BYTES, bytes - sent)) };
+            MPI_Bcast(begin + sent, count, MPI_BYTE, 0, MPI_COMM_WORLD);
+        }
+    }
+}
+#endif
+
+mcrt::Cluster::Cluster(int& argc, char**& argv) {
+#ifdef MCRT_MPI
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+#else
+    (void) argc; (void) argv;
+#endif
+}
+
+mcrt::Cluster::~Cluster() {
+#ifdef MCRT_MPI
+    MPI_Finalize();
+#endif
+}
+
+bool mcrt::Cluster::isAvailable() {
+#ifdef MCRT_MPI
+    return true;
+#else
+    return false;
+#endif
+}
+
+void mcrt::Cluster::broadcast(std::string& data) const {
+#ifdef MCRT_MPI
+    unsigned long length = data.size();
+    MPI_Bcast(&length, 1, MPI_UNSIGNED_LONG, 0, MPI_COMM_WORLD);
+    data.resize(length);
+    broadcastBytes(&data[0], length);
+#else
+    (void) data;
+#endif
+}
+
+void mcrt::Cluster::broadcast(std::vector<Photon>& photons) const {
+#ifdef MCRT_MPI
+    // Photons are plain old data, and the nodes are all alike, so send the bytes.
+    unsigned long length = photons.size();
+    MPI_Bcast(&length, 1, MPI_UNSIGNED_LONG, 0, MPI_COMM_WORLD);
+    photons.resize(length);
+    broadcastBytes(photons.data(), length * sizeof(Photon));
+#else
+    (void) photons;
+#endif
+}
+
+void mcrt::Cluster::reduce(std::vector<double>& data) const {
+#ifdef MCRT_MPI
+    // Binomial tree: in every round, the ranks with the bit set send their sums to
+    // the one without it, and are done, so the root only has log2(size) receives.
+    const std::size_t chunk { CHUNK_BYTES / sizeof(double) };
+    std::vector<double> received(data.size());
+    for (int step { 1 }; step < size; step <<= 1) {
+        if (rank & step) {
+            for (std::size_t i { 0 }; i < data.size(); i += chunk) {
+                int count { static_cast<int>(std::min(chunk, data.size() - i)) };
+                MPI_Send(data.data() + i, count, MPI_DOUBLE, rank - step, 0, MPI_COMM_WORLD);
+            }
+
+            break;
+        } else if (rank + step < size) {
+            for (std::size_t i { 0 }; i < data.size(); i += chunk) {
+                int count { static_cast<int>(std::min(chunk, data.size() - i)) };
+                MPI_Recv(received.data() + i, count, MPI_DOUBLE, rank + step, 0,
+                         MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            }
+
+            for (std::size_t i { 0 }; i < data.size(); ++i) data[i] += received[i];
+        }
+    }
+#else
+    (void) data;
+#endif
+}
+
+std::size_t mcrt::Cluster::minimum(std::size_t value) const {
+#ifdef MCRT_MPI
+    unsigned long local = value, smallest;
+    MPI_Allreduce(&local, &smallest, 1, MPI_UNSIGNED_LONG, MPI_MIN, MPI_COMM_WORLD);
+    return smallest;
+#else
+    return value;
+#endif
+}
@@ -0,0 +1,132 @@
+#include "mcrt/film.hh"
+
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+mcrt::Film::Tile::Tile(std::size_t x, std::size_t y, std::size_t width,
+                       std::size_t height, std::size_t padding)
+    : x { x }, y { y }, width { width }, height { height }, padding { padding },
+      bufferWidth { width + 2*padding }, bufferHeight { height + 2*padding },
+      pixels(bufferWidth*bufferHeight) {  }
+
+void mcrt::Film::Tile::add(std::size_t px, std::size_t py, const glm::dvec3& radiance, double weight) {
+    // Buffer starts at (x - padding, y - padding), anything further out is dropped.
+    std::size_t bx { px + padding - x }, by { py + padding - y };
+    if (bx >= bufferWidth || by >= bufferHeight) return;
+    Pixel& pixel { pixels[by*bufferWidth + bx] };
+    pixel.radiance += radiance * weight;
+    pixel.weight += weight;
+}
+
+void mcrt::Film::Tile::splat(const glm::dvec2& position, const glm::dvec3& radiance, const Filter& filter) {
+    // Every pixel with its center in (p - r, p + r], so a box only ever gets one.
+    double radius { filter.getRadius() };
+    long minimumX = std::floor(position.x - radius - 0.5) + 1, maximumX = std::floor(position.x + radius - 0.5),
+         minimumY = std::floor(position.y - radius - 0.5) + 1, maximumY = std::floor(position.y + radius - 0.5);
+    for (long py { minimumY }; py <= maximumY; ++py) {
+        for (long px { minimumX }; px <= maximumX; ++px) {
+            long bx { px + static_cast<long>(padding) - static_cast<long>(x) },
+                 by { py + static_cast<long>(padding) - static_cast<long>(y) };
+            if (bx < 0 || by < 0 || bx >= static_cast<long>(bufferWidth)
+                                 || by >= static_cast<long>(bufferHeight)) continue;
+            double weight { filter.weight(position.x - (px + 0.5), position.y - (py + 0.5)) };
+            Pixel& pixel { pixels[by*bufferWidth + bx] };
+            pixel.radiance += radiance * weight;
+            pixel.weight += weight;
+        }
+    }
+}
+
+mcrt::Film::Film(std::size_t width, std::size_t height, std::size_t threads, std::size_t padding)
+    : width { width }, height { height }, padding { padding },
+      tilesX { (width  + TILE_SIZE - 1) / TILE_SIZE },
+      tilesY { (height + TILE_SIZE - 1) / TILE_SIZE },
+      pixels(width*height), splats(std::max<std::size_t>(threads, 1), { width, height }) {  }
+
+mcrt::Film::Tile mcrt::Film::getTile(std::size_t index) const {
+    std::size_t x { (index % tilesX) * TILE_SIZE },
+                y { (index / tilesX) * TILE_SIZE };
+    std::size_t tileSize { TILE_SIZE };
+    return { x, y, std::min(tileSize, width  - x),
+                   std::min(tileSize, height - y), padding };
+}
+
+void mcrt::Film::merge(const Tile& tile) {
+    // The padding overlaps the neighbouring tiles, but it's only once per tile.
+    std::lock_guard<std::mutex> lock { mergeMutex };
+    for (std::size_t by { 0 }; by < tile.bufferHeight; ++by) {
+        std::size_t y { tile.y + by - tile.padding };
+        if (y >= height) continue; // Also wraps around when above.
+        for (std::size_t bx { 0 }; bx < tile.bufferWidth; ++bx) {
+            std::size_t x { tile.x + bx - tile.padding };
+            if (x >= width) continue;
+            const Pixel& sample { tile.pixels[by*tile.bufferWidth + bx] };
+            Pixel& pixel { pixels[y*width + x] };
+            pixel.radiance += sample.radiance;
+            pixel.weight += sample.weight;
+        }
+    }
+}
+
+void mcrt::Film::add(std::size_t x, std::size_t y, const Pixel& sample) {
+    Pixel& pixel { pixels[y*width + x] };
+    pixel.radiance += sample.radiance;
+    pixel.weight += sample.weight;
+}
+
+glm::dvec3 mcrt::Film::resolve(std::size_t p) const {
+    glm::dvec3 radiance { 0.0 };
+    if (pixels[p].weight > 0.0) radiance = pixels[p].radiance / pixels[p].weight;
+    if (passes > 0) {
+        for (const Splats& layer : splats)
+            radiance += layer.pixels[p] / static_cast<double>(passes);
+    }
+
+    return radiance;
+}
+
+void mcrt::Film::develop(Image& image) const {
+    auto& imagePixels = image.getPixelData();
+    for (std::size_t p { 0 }; p < pixels.size(); ++p)
+        imagePixels[p] = resolve(p); // Also makes it opaque.
+}
+
+void mcrt::Film::develop(float* buffer) const {
+    for (std::size_t p { 0 }; p < pixels.size(); ++p) {
+        glm::dvec3 radiance { resolve(p) };
+        buffer[p*4 + 0] = radiance.r;
+        buffer[p*4 + 1] = radiance.g;
+        buffer[p*4 + 2] = radiance.b;
+        buffer[p*4 + 3] = 1.0f;
+    }
+}
+
+std::vector<double> mcrt::Film::pack() const {
+    std::vector<double> buffer;
+    buffer.reserve(getPackedSize(width, height));
+    for (std::size_t p { 0 }; p < pixels.size(); ++p) {
+        glm::dvec3 splatted { 0.0 }; // All of the layers are folded into one.
+        for (const Splats& layer : splats) splatted += layer.pixels[p];
+        buffer.insert(buffer.end(), { pixels[p].radiance.r, pixels[p].radiance.g,
+                                      pixels[p].radiance.b, pixels[p].weight,
+                                      splatted.r, splatted.g, splatted.b });
+    }
+
+    buffer.push_back(passes);
+    return buffer;
+}
+
+void mcrt::Film::unpack(const std::vector<double>& buffer) {
+    if (buffer.size() != getPackedSize(width, height))
+        throw std::runtime_error { "Error: the packed film has another size!" };
+    for (Splats& layer : splats) std::fill(layer.pixels.begin(), layer.pixels.end(), glm::dvec3 { 0.0 });
+    for (std::size_t p { 0 }; p < pixels.size(); ++p) {
+        const double* packed { &buffer[p * 7] };
+        pixels[p].radiance = { packed[0], packed[1], packed[2] };
+        pixels[p].weight = packed[3];
+        splats[0].pixels[p] = { packed[4], packed[5], packed[6] };
+    }
+
+    passes = buffer.back();
+}
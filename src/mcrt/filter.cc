@@ -0,0 +1,48 @@
+#include "mcrt/filter.hh"
+
+#include <cmath>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+mcrt::Filter::Filter(Type type, double radius)
+    : type { type }, radius { std::max(radius, 0.5) }, table(TABLE_SIZE) {
+    inverseRadius = 1.0 / this->radius;
+    // Sampled at the middle of each table entry, since lookups round down.
+    for (std::size_t i { 0 }; i < TABLE_SIZE; ++i)
+        table[i] = evaluate((i + 0.5) / TABLE_SIZE * this->radius);
+}
+
+std::size_t mcrt::Filter::getPadding() const {
+    if (type == Type::BOX && radius <= 0.5) return 0;
+    return std::ceil(radius);
+}
+
+double mcrt::Filter::evaluate(double x) const {
+    x = std::abs(x);
+    switch (type) {
+    case Type::BOX: return 1.0;
+    case Type::GAUSSIAN: // Shifted down so that it reaches zero at the radius.
+        return std::max(0.0, std::exp(-GAUSSIAN_ALPHA * x * x)
+                           - std::exp(-GAUSSIAN_ALPHA * radius * radius));
+    case Type::MITCHELL: {
+        // Defined over [-2, 2], so it's stretched to fit the radius.
+        x = 2.0 * x * inverseRadius;
+        const double B { MITCHELL_B }, C { MITCHELL_C };
+        if (x > 1.0) return ((-B - 6.0*C) * x*x*x + (6.0*B + 30.0*C) * x*x
+                           + (-12.0*B - 48.0*C) * x + (8.0*B + 24.0*C)) / 6.0;
+        return ((12.0 - 9.0*B - 6.0*C) * x*x*x + (-18.0 + 12.0*B + 6.0*C) * x*x
+              + (6.0 - 2.0*B)) / 6.0;
+    }
+
+    case Type::BLACKMAN_HARRIS: {
+        // The window goes over [0, 1], and has its peak at the middle.
+        double t { 0.5 + 0.5 * x * inverseRadius };
+        double tau { 2.0 * glm::pi<double>() * t };
+        return 0.35875 - 0.48829 * std::cos(tau) + 0.14128 * std::cos(2.0*tau)
+                       - 0.01168 * std::cos(3.0*tau);
+    }
+
+    default: return 0.0;
+    }
+}
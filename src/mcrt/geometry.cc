@@ -4,6 +4,12 @@ namespace mcrt {
     Geometry::Geometry(Material* m)
         : material { m } {  }
 
+    Ray::Intersection Geometry::intersect(const Ray& ray) const {
+        Ray::Hit rayHit = hit(ray);
+        if (rayHit.distance <= 0.0) return {0, glm::dvec3(0.0), material, glm::dvec3(0.0)};
+        return interact(ray, rayHit);
+    }
+
     Material* Geometry::getMaterial() const {
         return material;
     }
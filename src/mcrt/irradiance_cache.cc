@@ -0,0 +1,136 @@
+#include "mcrt/irradiance_cache.hh"
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+mcrt::IrradianceCache::IrradianceCache(const glm::dvec3& center, double halfSize, double error)
+    : root { new Node { center, halfSize } }, error { error } {  }
+
+mcrt::IrradianceCache::Node::~Node() {
+    for (auto& child : children) delete child.load();
+    Entry* entry { entries.load() };
+    while (entry != nullptr) {
+        Entry* next { entry->next };
+        delete entry;
+        entry = next;
+    }
+}
+
+void mcrt::IrradianceCache::clear() {
+    delete root;
+    root = nullptr;
+    records = 0;
+}
+
+double mcrt::IrradianceCache::getHalfSize() const {
+    if (root == nullptr) return 0.0;
+    return root->halfSize;
+}
+
+double mcrt::IrradianceCache::weight(const Record& record, const glm::dvec3& position,
+                                     const glm::dvec3& normal) const {
+    double distance { glm::distance(position, record.position) };
+    double normalDeviation { std::sqrt(std::max(0.0, 1.0 - glm::dot(normal, record.normal))) };
+    double denominator { distance / record.harmonicDistance + normalDeviation };
+    if (denominator <= 0.0) return std::numeric_limits<double>::max();
+    return 1.0 / denominator;
+}
+
+// Fetches the child octant, creating it if we are the first thread to get here.
+mcrt::IrradianceCache::Node* mcrt::IrradianceCache::child(Node* node, std::size_t octant) const {
+    Node* existing { node->children[octant].load(std::memory_order_acquire) };
+    if (existing != nullptr) return existing;
+
+    double halfSize { node->halfSize / 2.0 };
+    glm::dvec3 center { node->center };
+    center.x += (octant & 1) ? halfSize : -halfSize;
+    center.y += (octant & 2) ? halfSize : -halfSize;
+    center.z += (octant & 4) ? halfSize : -halfSize;
+
+    Node* created { new Node { center, halfSize } };
+    if (node->children[octant].compare_exchange_strong(existing, created,
+                                                       std::memory_order_acq_rel))
+        return created;
+    delete created; // Someone else beat us to it, use theirs.
+    return existing;
+}
+
+void mcrt::IrradianceCache::insert(const Record& record) {
+    if (root == nullptr) return;
+
+    // Outside of the record's radius of influence the weights will always be below 1/a.
+    double influence { error * record.harmonicDistance };
+    Node* node { root };
+
+    glm::dvec3 offset { glm::abs(record.position - root->center) };
+    bool inside { std::max(offset.x, std::max(offset.y, offset.z)) <= root->halfSize };
+
+    // Go down until we find the smallest octant which can still hold the record.
+    for (std::size_t depth { 0 }; inside && depth < MAX_DEPTH; ++depth) {
+        if (node->halfSize / 2.0 < influence) break;
+        std::size_t octant { 0 };
+        if (record.position.x > node->center.x) octant |= 1;
+        if (record.position.y > node->center.y) octant |= 2;
+        if (record.position.z > node->center.z) octant |= 4;
+        node = child(node, octant);
+    }
+
+    Entry* entry { new Entry { record, node->entries.load(std::memory_order_relaxed) } };
+    while (!node->entries.compare_exchange_weak(entry->next, entry,
+                                                std::memory_order_release,
+                                                std::memory_order_relaxed));
+    ++records;
+}
+
+bool mcrt::IrradianceCache::interpolate(const glm::dvec3& position, const glm::dvec3& normal,
+                                        glm::dvec3& irradiance) const {
+    if (root == nullptr) return false;
+
+    double totalWeight { 0.0 };
+    glm::dvec3 weightedIrradiance { 0.0 };
+
+    std::vector<const Node*> nodes { root };
+    while (!nodes.empty()) {
+        const Node* node { nodes.back() };
+        nodes.pop_back();
+
+        for (const Entry* entry { node->entries.load(std::memory_order_acquire) };
+             entry != nullptr; entry = entry->next) {
+            const Record& record { entry->record };
+            double w { weight(record, position, normal) };
+            if (w <= 1.0 / error) continue;
+
+            // Skip records which are in front of the point, they see other things.
+            glm::dvec3 displacement { position - record.position };
+            if (glm::dot(displacement, (normal + record.normal) / 2.0) < -0.01 * record.harmonicDistance)
+                continue;
+
+            // First-order Taylor expansion of the record by using its gradients.
+            glm::dvec3 rotation { glm::cross(record.normal, normal) };
+            glm::dvec3 extrapolated;
+            for (int channel { 0 }; channel < 3; ++channel) {
+                extrapolated[channel] = record.irradiance[channel]
+                                      + glm::dot(rotation, record.rotationalGradient[channel])
+                                      + glm::dot(displacement, record.translationalGradient[channel]);
+            }
+
+            if (w == std::numeric_limits<double>::max()) w = 1e12;
+            weightedIrradiance += w * glm::max(extrapolated, glm::dvec3 { 0.0 });
+            totalWeight += w;
+        }
+
+        // Records in a node only reach at most its size beyond the octant.
+        for (const auto& octant : node->children) {
+            const Node* child { octant.load(std::memory_order_acquire) };
+            if (child == nullptr) continue;
+            glm::dvec3 offset { glm::abs(position - child->center) };
+            if (std::max(offset.x, std::max(offset.y, offset.z)) <= 2.0 * child->halfSize)
+                nodes.push_back(child);
+        }
+    }
+
+    if (totalWeight <= 0.0) return false;
+    irradiance = weightedIrradiance / totalWeight;
+    return true;
+}
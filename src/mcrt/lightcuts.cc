@@ -0,0 +1,252 @@
+#include "mcrt/lightcuts.hh"
+#include "mcrt/scene.hh"
+#include "mcrt/sampling.hh"
+
+#include <queue>
+#include <limits>
+#include <random>
+#include <algorithm>
+#include <glm/gtc/constants.hpp>
+
+namespace {
+    double luminance(const glm::dvec3& color) {
+        return 0.2126*color.r + 0.7152*color.g + 0.0722*color.b;
+    }
+
+    double angleBetween(const glm::dvec3& a, const glm::dvec3& b) {
+        return std::acos(glm::clamp(glm::dot(a, b), -1.0, 1.0));
+    }
+
+    // Largest cosine for any direction which is at least that angle away.
+    double cosineBound(double angle) {
+        if (angle <= 0.0) return 1.0;
+        if (angle >= glm::half_pi<double>()) return 0.0;
+        return std::cos(angle);
+    }
+
+    // Largest cosine between the axis and any direction from the origin to the box,
+    // as in Walter et al, by bounding the box in a frame where the axis is up (z).
+    double boxCosineBound(const glm::dvec3& axis, const glm::dvec3& origin,
+                          const glm::dvec3& minimum, const glm::dvec3& maximum) {
+        glm::dvec3 tangent, bitangent;
+        mcrt::sampling::tangentFrame(axis, tangent, bitangent);
+
+        glm::dvec3 low { std::numeric_limits<double>::max() }, high { -std::numeric_limits<double>::max() };
+        for (int corner { 0 }; corner < 8; ++corner) {
+            glm::dvec3 point { (corner & 1) ? maximum.x : minimum.x,
+                               (corner & 2) ? maximum.y : minimum.y,
+                               (corner & 4) ? maximum.z : minimum.z };
+            glm::dvec3 offset { point - origin };
+            glm::dvec3 local { glm::dot(offset, tangent), glm::dot(offset, bitangent), glm::dot(offset, axis) };
+            low = glm::min(low, local);
+            high = glm::max(high, local);
+        }
+
+        if (high.z <= 0.0) return 0.0;
+        double x { (low.x <= 0.0 && high.x >= 0.0) ? 0.0 : std::min(std::abs(low.x), std::abs(high.x)) },
+               y { (low.y <= 0.0 && high.y >= 0.0) ? 0.0 : std::min(std::abs(low.y), std::abs(high.y)) };
+        return high.z / std::sqrt(x*x + y*y + high.z*high.z);
+    }
+}
+
+mcrt::LightTree::LightTree(const std::vector<VirtualLight>& virtualLights, double error)
+    : lights { virtualLights }, error { error } {
+    if (lights.empty()) return;
+    intensities.resize(lights.size());
+
+    glm::dvec3 minimum { lights[0].position }, maximum { lights[0].position };
+    for (const VirtualLight& light : lights) {
+        minimum = glm::min(minimum, light.position);
+        maximum = glm::max(maximum, light.position);
+    }
+
+    orientationScale = glm::distance(minimum, maximum) / 4.0;
+    minimumDistance = glm::distance(minimum, maximum) * CLAMP_RATIO;
+    nodes.reserve(2 * lights.size());
+    // Fixed seed, so the same lights give the very same tree (and image) each time.
+    std::mt19937 generator { 0 };
+    build(0, lights.size(), generator);
+}
+
+// Top-down median split along the widest axis, the representative of a cluster
+// is picked from its children's with probability proportional to intensities.
+int mcrt::LightTree::build(std::size_t begin, std::size_t end, std::mt19937& generator) {
+    int index = nodes.size();
+    nodes.emplace_back();
+
+    if (end - begin == 1) {
+        const VirtualLight& light { lights[begin] };
+        glm::dvec3 albedo { light.material->color };
+        double maximumAlbedo { std::max(albedo.r, std::max(albedo.g, albedo.b)) };
+        nodes[index].minimum = nodes[index].maximum = light.position;
+        nodes[index].intensity = light.flux * maximumAlbedo / glm::pi<double>();
+        nodes[index].axis = light.normal;
+        nodes[index].coneAngle = 0.0;
+        nodes[index].representative = begin;
+        intensities[begin] = nodes[index].intensity;
+        return index;
+    }
+
+    glm::dvec3 minimum { lights[begin].position }, maximum { lights[begin].position };
+    for (std::size_t i { begin }; i < end; ++i) {
+        minimum = glm::min(minimum, lights[i].position);
+        maximum = glm::max(maximum, lights[i].position);
+    }
+
+    glm::dvec3 normalMinimum { lights[begin].normal }, normalMaximum { lights[begin].normal };
+    for (std::size_t i { begin }; i < end; ++i) {
+        normalMinimum = glm::min(normalMinimum, lights[i].normal);
+        normalMaximum = glm::max(normalMaximum, lights[i].normal);
+    }
+
+    // Split along the widest of the position and (scaled) normal axes, so
+    // that lights facing different ways are separated early on as well.
+    double extent[6];
+    for (int i { 0 }; i < 3; ++i) {
+        extent[i] = maximum[i] - minimum[i];
+        extent[i + 3] = (normalMaximum[i] - normalMinimum[i]) * orientationScale;
+    }
+
+    int axis { 0 };
+    for (int i { 1 }; i < 6; ++i)
+        if (extent[i] > extent[axis]) axis = i;
+
+    std::size_t middle { begin + (end - begin) / 2 };
+    std::nth_element(lights.begin() + begin, lights.begin() + middle, lights.begin() + end,
+                     [axis](const VirtualLight& a, const VirtualLight& b) {
+                         if (axis < 3) return a.position[axis] < b.position[axis];
+                         return a.normal[axis - 3] < b.normal[axis - 3];
+                     });
+
+    int left { build(begin, middle, generator) }, right { build(middle, end, generator) };
+    Node& node { nodes[index] };
+    node.minimum = minimum;
+    node.maximum = maximum;
+    node.left = left;
+    node.right = right;
+    node.intensity = nodes[left].intensity + nodes[right].intensity;
+
+    // Not the tightest cone, but lights on the same wall end up with a narrow one.
+    glm::dvec3 coneAxis { nodes[left].axis * luminance(nodes[left].intensity) +
+                      nodes[right].axis * luminance(nodes[right].intensity) };
+    if (glm::length(coneAxis) <= 0.0) coneAxis = nodes[left].axis;
+    node.axis = glm::normalize(coneAxis);
+    node.coneAngle = std::min(glm::pi<double>(),
+                              std::max(angleBetween(node.axis, nodes[left].axis)  + nodes[left].coneAngle,
+                                       angleBetween(node.axis, nodes[right].axis) + nodes[right].coneAngle));
+
+    double leftWeight { luminance(nodes[left].intensity) },
+           totalWeight { luminance(node.intensity) };
+    double choice { std::uniform_real_distribution<double> { 0.0, 1.0 }(generator) };
+    if (totalWeight <= 0.0 || choice * totalWeight < leftWeight)
+        node.representative = nodes[left].representative;
+    else node.representative = nodes[right].representative;
+
+    return index;
+}
+
+// Same as with the point lights, but with the light's own BRDF and cosine too.
+glm::dvec3 mcrt::LightTree::contribution(const VirtualLight& light, const glm::dvec3& normal,
+                                         const glm::dvec3& outgoing, const Ray::Intersection& rayHit,
+                                         const Scene& scene) const {
+    glm::dvec3 rayToLightSource { light.position - rayHit.position };
+    double distance { glm::length(rayToLightSource) };
+    if (distance <= 0.0) return glm::dvec3 { 0.0 };
+    glm::dvec3 rayToLightNormal { rayToLightSource / distance };
+
+    double cosineSurface { glm::dot(normal, rayToLightNormal) },
+           cosineLight   { glm::dot(light.normal, -rayToLightNormal) };
+    if (cosineSurface <= 0.0 || cosineLight <= 0.0) return glm::dvec3 { 0.0 };
+
+    Ray shadowRay { Ray::offset(rayHit.position, normal, rayToLightNormal), rayToLightNormal };
+    // The light itself is on a surface, so let that one through.
+    if (scene.inShadow(shadowRay) < distance * (1.0 - 1e-4)) return glm::dvec3 { 0.0 };
+
+    glm::dvec3 surfaceBrdf { rayHit.material->brdf(rayHit.position, normal, rayToLightNormal, outgoing) },
+               lightBrdf   { light.material->brdf(light.position, light.normal, -light.incoming,
+                                                  -rayToLightNormal) };
+    double distanceSquared { std::max(distance * distance, minimumDistance * minimumDistance) };
+    return surfaceBrdf * cosineSurface * light.flux * lightBrdf * cosineLight / distanceSquared;
+}
+
+// Scales the contribution of the representative to the whole cluster.
+glm::dvec3 mcrt::LightTree::estimate(const Node& node, const glm::dvec3& representative) const {
+    glm::dvec3 lightIntensity { intensities[node.representative] };
+    glm::dvec3 scale;
+    for (int c { 0 }; c < 3; ++c)
+        scale[c] = lightIntensity[c] > 0.0 ? node.intensity[c] / lightIntensity[c] : 0.0;
+    return representative * scale;
+}
+
+// Upper bound on the contribution of the cluster, with the visibility bounded by 1.
+double mcrt::LightTree::errorBound(const Node& node, const glm::dvec3& position,
+                                   const glm::dvec3& normal, const Material* material) const {
+    glm::dvec3 closest { glm::clamp(position, node.minimum, node.maximum) };
+    double distanceSquared { glm::dot(closest - position, closest - position) };
+    distanceSquared = std::max(distanceSquared, minimumDistance * minimumDistance);
+
+    double receiving { boxCosineBound(normal, position, node.minimum, node.maximum) };
+    if (receiving <= 0.0) return 0.0;
+
+    // Mirror the box around the shading point to get the directions back to it.
+    double emitting { boxCosineBound(node.axis, position, 2.0*position - node.maximum,
+                                                          2.0*position - node.minimum) };
+    emitting = cosineBound(std::acos(emitting) - node.coneAngle);
+
+    glm::dvec3 albedo { material->color };
+    double materialBound { std::max(albedo.r, std::max(albedo.g, albedo.b)) / glm::pi<double>() };
+    return luminance(node.intensity) * materialBound * receiving * emitting / distanceSquared;
+}
+
+glm::dvec3 mcrt::LightTree::radiance(const Ray& ray, const Ray::Intersection& rayHit,
+                                      const Scene& scene, const glm::dvec3& known) const {
+    if (nodes.empty()) return glm::dvec3 { 0.0 };
+
+    glm::dvec3 normal { rayHit.normal };
+    if (glm::dot(normal, ray.direction) > 0.0) normal = -normal;
+    glm::dvec3 outgoing { -ray.direction };
+
+    struct Cluster {
+        double bound;
+        int node;
+        glm::dvec3 representative, estimate;
+        bool operator<(const Cluster& other) const { return bound < other.bound; }
+    };
+
+    auto evaluate = [&](int index, const glm::dvec3* representative) {
+        const Node& node { nodes[index] };
+        Cluster cluster;
+        cluster.node = index;
+        cluster.representative = representative != nullptr ? *representative
+                               : contribution(lights[node.representative], normal, outgoing, rayHit, scene);
+        cluster.estimate = estimate(node, cluster.representative);
+        cluster.bound = node.isLeaf() ? 0.0 : errorBound(node, rayHit.position, normal, rayHit.material);
+        return cluster;
+    };
+
+    std::priority_queue<Cluster> cut;
+    Cluster root { evaluate(0, nullptr) };
+    glm::dvec3 total { root.estimate };
+    cut.push(root);
+
+    std::size_t cutSize { 1 };
+    while (!cut.empty() && cutSize < MAX_CUT) {
+        Cluster worst { cut.top() };
+        if (worst.bound <= error * luminance(total + known)) break;
+        cut.pop();
+
+        // One of the children shares the representative, so we can reuse its work.
+        const Node& node { nodes[worst.node] };
+        total -= worst.estimate;
+        for (int child : { node.left, node.right }) {
+            bool shared { nodes[child].representative == node.representative };
+            Cluster refined { evaluate(child, shared ? &worst.representative : nullptr) };
+            total += refined.estimate;
+            if (!nodes[child].isLeaf()) cut.push(refined);
+        }
+
+        ++cutSize;
+    }
+
+    return glm::max(total, glm::dvec3 { 0.0 });
+}
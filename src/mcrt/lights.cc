@@ -1,4 +1,5 @@
 #include "mcrt/lights.hh"
+#include "mcrt/sampling.hh"
 
 #define GLM_ENABLE_EXPERIMENTAL
 
@@ -23,7 +24,7 @@ namespace mcrt {
         glm::dvec3 rayToLightSource = origin - rayHit.position;
         glm::dvec3 rayToLightNormal { glm::normalize(rayToLightSource) };
 
-        Ray shadowRay { rayHit.position + rayToLightNormal*Ray::EPSILON,
+        Ray shadowRay { Ray::offset(rayHit.position, rayHit.normal, rayToLightNormal),
                 glm::normalize(rayToLightSource) };
 
         double oclusionDistance = scene->inShadow(shadowRay);
@@ -37,67 +38,54 @@ namespace mcrt {
         return glm::dvec3(0);
     }
 
-    Ray::Intersection PointLight::intersect(const Ray&) const {
-        Ray::Intersection result {0.0, glm::dvec3(0.0), material, glm::dvec3(0.0)};
-       return result;
+    // Points can't be hit.
+    Ray::Hit PointLight::hit(const Ray&) const {
+        return {};
+    }
+
+    Ray::Intersection PointLight::interact(const Ray&, const Ray::Hit&) const {
+        return {0.0, glm::dvec3(0.0), material, glm::dvec3(0.0)};
     }
 
     size_t AreaLight::shadowRayCount = 10;
 
-    AreaLight::AreaLight(glm::dvec3 v0, glm::dvec3 v1, glm::dvec3 v2, glm::dvec3 color, double intensity) : Light(color,intensity), v0(v0), v1(v1), v2(v2) 
+    AreaLight::AreaLight(glm::dvec3 v0, glm::dvec3 v1, glm::dvec3 v2, glm::dvec3 color, double intensity) : Light(color,intensity), v0(v0), v1(v1), v2(v2)
     {
-        normal = glm::normalize(glm::cross(v1-v0, v2-v0));
-        area = 0.5*glm::length(glm::cross(v1-v0, v2-v0));
+        refit();
+    }
+
+    void AreaLight::refit() {
+        e1 = v1 - v0;
+        e2 = v2 - v0;
+        normal = glm::normalize(glm::cross(e1, e2));
+        area = 0.5*glm::length(glm::cross(e1, e2));
     }
      
     glm::dvec3 AreaLight::sampleHemisphere() const {
-       static std::random_device rd; 
-       static std::mt19937 gen(rd());
-       static std::uniform_real_distribution<double> dis(0.0, 1.0);
-
-
-       // Uses the cosine-weighted sampling over the
-       // hemisphere for filter out unimportant rays.
-       double phi = dis(gen) * glm::pi<double>() * 2.0;
-       double theta = std::asin(std::sqrt(dis(gen)));
-
-       glm::dvec3 v1 = glm::normalize(sample() - sample());
-       glm::dvec3 v2 = glm::normalize(glm::cross(v1,normal));
-       
-       const glm::dvec3 azimuthRotation = glm::rotate(v1, phi, normal);
-       const glm::dvec3 inclinationRotation = glm::rotate(normal, theta, v2);
-       const glm::dvec3 outgoing = glm::normalize(azimuthRotation + inclinationRotation);
-       return outgoing;
+        // Uses the cosine-weighted sampling over the hemisphere for filter
+        // out unimportant rays. The pdf is exactly cos(theta) / pi here.
+        return sampling::cosineHemisphere(normal, sampling::uniform(),
+                                                  sampling::uniform());
     }
 
     glm::dvec3 AreaLight::sample() const{     
         double u;
         double v;
 
-        static std::random_device rd;
-        static std::mt19937 gen(rd());
-        static std::uniform_real_distribution<> dist(0,1);
-
         do {
-            u = dist(gen);
-            v = dist(gen);
+            u = sampling::uniform();
+            v = sampling::uniform();
         } while (u + v >= 1);
 
         return (1 - u - v)*v0 + u*v1 + v*v2;
     }
 
-    Ray::Intersection AreaLight::intersect(const Ray& ray) const {
-        glm::dvec3 e1 = v1 - v0;
-        glm::dvec3 e2 = v2 - v0;
+    Ray::Hit AreaLight::hit(const Ray& ray) const {
+        Ray::Hit result;
 
         glm::dvec3 pvec = glm::cross(ray.direction,e2);
         double det = glm::dot(e1,pvec);
 
-        glm::dvec3 normal { glm::normalize(glm::cross(e1, e2)) };
-        if (glm::dot(normal, ray.direction) > 0) normal = -normal;
-
-        Ray::Intersection result {0.0, normal, material, glm::dvec3(0.0)};
-
         if(det < Ray::EPSILON && det > -Ray::EPSILON) {
             return result;
         }
@@ -116,10 +104,16 @@ namespace mcrt {
         }
 
         result.distance = glm::dot(e2,qvec) * inv_det;
-        result.position = ray.origin + ray.direction*result.distance;
+        result.u = u;
+        result.v = v;
         return result;
     }
 
+    Ray::Intersection AreaLight::interact(const Ray& ray, const Ray::Hit& hit) const {
+        glm::dvec3 facing { glm::dot(normal, ray.direction) > 0 ? -normal : normal };
+        return {hit.distance, facing, material, ray.origin + ray.direction*hit.distance};
+    }
+
     glm::dvec3 AreaLight::radiance(const Ray& ray, const Ray::Intersection& rayHit, const Scene* scene) {
         glm::dvec3 radiance(0.0);
         std::vector<glm::dvec3> lightOrigins;
@@ -129,7 +123,7 @@ namespace mcrt {
             glm::dvec3 rayToLightSource = origin - rayHit.position;
             glm::dvec3 rayToLightNormal { glm::normalize(rayToLightSource) };
 
-            Ray shadowRay { rayHit.position + rayToLightNormal * Ray::EPSILON, rayToLightNormal };
+            Ray shadowRay { Ray::offset(rayHit.position, rayHit.normal, rayToLightNormal), rayToLightNormal };
 
             // Return distance to light, 0 if occluded
             double occlusionDistance = scene->inShadow(shadowRay);
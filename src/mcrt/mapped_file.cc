@@ -0,0 +1,54 @@
+#include "mcrt/mapped_file.hh"
+
+#include <stdexcept>
+
+#ifndef WINDOWS
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#else
+#include <fstream>
+#include <sstream>
+#endif
+
+mcrt::MappedFile::MappedFile(const std::string& path) {
+#ifndef WINDOWS
+    int file { ::open(path.c_str(), O_RDONLY) };
+    if (file < 0) throw std::runtime_error { "Could not open '" + path + "'!" };
+
+    struct stat status;
+    if (::fstat(file, &status) != 0) {
+        ::close(file);
+        throw std::runtime_error { "Could not open '" + path + "'!" };
+    }
+
+    size = status.st_size;
+    if (size > 0) { // Can't map nothing, but empty files are still fine.
+        void* mapping { ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0) };
+        if (mapping == MAP_FAILED) {
+            ::close(file);
+            throw std::runtime_error { "Could not map '" + path + "'!" };
+        }
+
+        ::madvise(mapping, size, MADV_WILLNEED);
+        data = static_cast<const char*>(mapping);
+    }
+
+    ::close(file); // The mapping keeps it around.
+#else
+    std::ifstream fileStream { path, std::ios::binary };
+    if (!fileStream) throw std::runtime_error { "Could not open '" + path + "'!" };
+    std::stringstream bytes;
+    bytes << fileStream.rdbuf();
+    contents = bytes.str();
+    data = contents.data();
+    size = contents.size();
+#endif
+}
+
+mcrt::MappedFile::~MappedFile() {
+#ifndef WINDOWS
+    if (data != nullptr) ::munmap(const_cast<char*>(data), size);
+#endif
+}
@@ -0,0 +1,88 @@
+#include "mcrt/mcrt.h"
+#include "mcrt/renderer.hh"
+#include "mcrt/param_import.hh"
+
+#include <new>
+#include <string>
+#include <exception>
+
+struct mcrt_renderer {
+    mcrt::Renderer renderer;
+    std::string error;
+};
+
+namespace {
+    // No exceptions may leave through the C interface, they become error codes.
+    template<typename F> int guard(mcrt_renderer* handle, F call) {
+        if (handle == nullptr) return -1;
+        handle->error.clear();
+        try {
+            call(handle->renderer);
+            return 0;
+        } catch (const std::exception& error) {
+            handle->error = error.what();
+        } catch (...) {
+            handle->error = "Unknown error!";
+        }
+
+        return -1;
+    }
+}
+
+mcrt_renderer* mcrt_create(void) {
+    try {
+        return new mcrt_renderer;
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void mcrt_destroy(mcrt_renderer* handle) {
+    delete handle;
+}
+
+const char* mcrt_error(const mcrt_renderer* handle) {
+    if (handle == nullptr) return "No renderer!";
+    return handle->error.c_str();
+}
+
+int mcrt_load_scene(mcrt_renderer* handle, const char* path) {
+    return guard(handle, [path](mcrt::Renderer& renderer) { renderer.loadScene(path); });
+}
+
+int mcrt_load_parameters(mcrt_renderer* handle, const char* path) {
+    return guard(handle, [path](mcrt::Renderer& renderer) { renderer.loadParameters(path); });
+}
+
+int mcrt_set_parameters(mcrt_renderer* handle, const char* json) {
+    return guard(handle, [json](mcrt::Renderer& renderer) {
+        renderer.setParameters(mcrt::ParameterImporter::parse(json), json);
+    });
+}
+
+size_t mcrt_width(const mcrt_renderer* handle) {
+    return handle != nullptr ? handle->renderer.getWidth() : 0;
+}
+
+size_t mcrt_height(const mcrt_renderer* handle) {
+    return handle != nullptr ? handle->renderer.getHeight() : 0;
+}
+
+int mcrt_render(mcrt_renderer* handle, size_t passes, float* rgba,
+                mcrt_progress progress, void* user) {
+    return guard(handle, [=](mcrt::Renderer& renderer) {
+        renderer.render(passes, [=](std::size_t pass, std::size_t total) {
+            if (progress != nullptr) progress(pass, total, user);
+        });
+
+        if (rgba != nullptr) renderer.develop(rgba);
+    });
+}
+
+int mcrt_reset(mcrt_renderer* handle) {
+    return guard(handle, [](mcrt::Renderer& renderer) { renderer.reset(); });
+}
+
+int mcrt_save(mcrt_renderer* handle, const char* path) {
+    return guard(handle, [path](mcrt::Renderer& renderer) { renderer.save(path); });
+}
@@ -2,72 +2,81 @@
 
 #define GLM_ENABLE_EXPERIMENTAL
 
+#include <limits>
+#include <algorithm>
 #include <iostream>
 #include <glm/gtx/string_cast.hpp>
+#include <glm/gtx/rotate_vector.hpp>
 
 namespace mcrt {
-    glm::dvec3 getMin(MeshTriangle* t) {
-        glm::dmat3 m{ t->getCorners() };
-        double x = std::min(std::min(m[0][0], m[1][0]), m[2][0]);
-        double y = std::min(std::min(m[0][1], m[1][1]), m[2][1]);
-        double z = std::min(std::min(m[0][2], m[1][2]), m[2][2]);
-        return {x, y, z};
+    Mesh::Mesh() : Geometry { nullptr } {  }
+    Mesh::Mesh(Material* m) : Geometry { m } {  }
+    Mesh::Mesh(MeshData&& data, Material* m) : Geometry { m }, _data { std::move(data) } {
+        updateBoundingSphere();
     }
 
-    glm::dvec3 getMax(MeshTriangle* t) {
-        glm::dmat3 m{ t->getCorners() };
-        double x = std::max(std::max(m[0][0], m[1][0]), m[2][0]);
-        double y = std::max(std::max(m[0][1], m[1][1]), m[2][1]);
-        double z = std::max(std::max(m[0][2], m[1][2]), m[2][2]);
-        return {x, y, z};
-
+    Mesh::Mesh(MeshData&& data, Bvh&& bvh, Material* m)
+        : Geometry { m }, _data { std::move(data) }, _bvh { std::move(bvh) } {
+        if (_bvh.isEmpty()) {
+            updateBoundingSphere();
+        } else { // It was built over these same triangles, so its bounds fit already.
+            updateTriangles();
+            updateSphere();
+        }
     }
 
-
-    Mesh::Mesh() : Geometry { nullptr } {  }
-    Mesh::Mesh(Material* m) : Geometry { m } {  }
-
     void Mesh::move(glm::dvec3 p) {
-        for (std::size_t i = 0; i < _triangles.size(); i++) {
-            _triangles[i]->move(p);
-        }
+        for (glm::vec3& position : _data.positions)
+            position = glm::dvec3 { position } + p;
     }
 
     void Mesh::scale(const double& c) {
-        for (std::size_t i = 0; i < _triangles.size(); i++) {
-            _triangles[i]->scale(c);
-        }
+        for (glm::vec3& position : _data.positions)
+            position = glm::dvec3 { position } * c;
+    }
+
+    void Mesh::rotate(const glm::dvec3& axis, double radius) {
+        for (glm::vec3& position : _data.positions)
+            position = glm::rotate(glm::dvec3 { position }, radius, axis);
     }
 
     void Mesh::rotateX(const double& radius) {
-        for (std::size_t i = 0; i < _triangles.size(); i++)
-            _triangles[i]->rotate({1.0, 0.0, 0.0}, radius);
+        rotate({1.0, 0.0, 0.0}, radius);
     }
 
     void Mesh::rotateY(const double& radius) {
-        for (std::size_t i = 0; i < _triangles.size(); i++)
-            _triangles[i]->rotate({0.0, 1.0, 0.0}, radius);
+        rotate({0.0, 1.0, 0.0}, radius);
     }
 
     void Mesh::rotateZ(const double& radius) {
-        for (std::size_t i = 0; i < _triangles.size(); i++)
-            _triangles[i]->rotate({0.0, 0.0, 1.0}, radius);
+        rotate({0.0, 0.0, 1.0}, radius);
     }
 
     void Mesh::updateBoundingSphere() {
-        glm::dvec3 min { getMin(_triangles[0]) };
-        glm::dvec3 max { getMax(_triangles[0]) };
-
-        for (std::size_t i = 1; i < _triangles.size(); i++) {
-            auto t = _triangles[i];
-            glm::dvec3 min2 { getMin(t) };
-            glm::dvec3 max2 { getMax(t) };
-            min[0] = std::min(min[0], min2[0]);
-            min[1] = std::min(min[1], min2[1]);
-            min[2] = std::min(min[2], min2[2]);
-            max[0] = std::max(max[0], max2[0]);
-            max[1] = std::max(max[1], max2[1]);
-            max[2] = std::max(max[2], max2[2]);
+        updateTriangles();
+        if (_bvh.isEmpty() && getTriangleCount() > 0) {
+            // The triangles of each leaf have to be next to each other, so they're put
+            // in the order of the hierarchy, once. After that it only has to be refit.
+            std::vector<std::uint32_t> order { _bvh.build(getTriangles()) };
+            std::vector<std::uint32_t> indices(_data.indices.size());
+            for (std::size_t t = 0; t < order.size(); ++t)
+                for (std::size_t k = 0; k < 3; ++k)
+                    indices[3*t + k] = _data.indices[3*order[t] + k];
+            _data.indices = std::move(indices);
+            updateTriangles();
+        } else {
+            _bvh.refit(getTriangles());
+        }
+
+        updateSphere();
+    }
+
+    void Mesh::updateSphere() {
+        if (_data.positions.empty()) return;
+        glm::dvec3 min { _data.positions[0] }, max { _data.positions[0] };
+        for (const glm::vec3& position : _data.positions) {
+            min = glm::min(min, glm::dvec3 { position });
+            max = glm::max(max, glm::dvec3 { position });
         }
 
         double radius = glm::distance(min,max)/2;
@@ -75,45 +84,104 @@ namespace mcrt {
         _bound = BoundingSphere{origin, radius};
     }
 
+    void Mesh::updateTriangles() {
+        std::size_t triangles { _data.getTriangleCount() };
+        for (std::size_t k = 0; k < 3; ++k) {
+            _x[k].assign(triangles + simd::PADDING, 0.0f);
+            _y[k].assign(triangles + simd::PADDING, 0.0f);
+            _z[k].assign(triangles + simd::PADDING, 0.0f);
+            for (std::size_t t = 0; t < triangles; ++t) {
+                const glm::vec3& corner { _data.positions[_data.indices[3*t + k]] };
+                _x[k][t] = corner.x;
+                _y[k][t] = corner.y;
+                _z[k][t] = corner.z;
+            }
+        }
+
+        _nx.resize(triangles);
+        _ny.resize(triangles);
+        _nz.resize(triangles);
+        for (std::size_t t = 0; t < triangles; ++t) {
+            glm::dvec3 v0 { _x[0][t], _y[0][t], _z[0][t] };
+            glm::dvec3 e1 { _x[1][t] - v0.x, _y[1][t] - v0.y, _z[1][t] - v0.z };
+            glm::dvec3 e2 { _x[2][t] - v0.x, _y[2][t] - v0.y, _z[2][t] - v0.z };
+            glm::dvec3 normal { glm::normalize(glm::cross(e1, e2)) };
+            _nx[t] = normal.x;
+            _ny[t] = normal.y;
+            _nz[t] = normal.z;
+        }
+    }
+
     void Mesh::setMaterial(Material* m) {
         material = m;
     }
 
-    void Mesh::addTriangle(MeshTriangle* t) {
-        _triangles.push_back(t);
+    std::size_t Mesh::getMemoryUsage() const {
+        std::size_t bytes { sizeof(Mesh) };
+        bytes += _data.positions.capacity() * sizeof(glm::vec3);
+        bytes += _data.indices.capacity() * sizeof(std::uint32_t);
+        for (std::size_t k = 0; k < 3; ++k)
+            bytes += (_x[k].capacity() + _y[k].capacity() + _z[k].capacity()) * sizeof(float);
+        bytes += (_nx.capacity() + _ny.capacity() + _nz.capacity()) * sizeof(float);
+        return bytes + _bvh.getMemoryUsage();
     }
 
-    void Mesh::addTriangle(const glm::dvec3& v0, const glm::dvec3& v1, const glm::dvec3& v2,
-                           const glm::dvec3& n0, const glm::dvec3& n1, const glm::dvec3& n2){
-        MeshTriangle* t = new MeshTriangle{v0, v1, v2, n0, n1, n2, material};
-        _triangles.push_back(t);
+    simd::Triangles Mesh::getTriangles() const {
+        return { { _x[0].data(), _x[1].data(), _x[2].data() },
+                 { _y[0].data(), _y[1].data(), _y[2].data() },
+                 { _z[0].data(), _z[1].data(), _z[2].data() }, getTriangleCount() };
     }
 
-    std::vector<MeshTriangle*> Mesh::getTriangles() const {
-        return _triangles;
+    Ray::Hit Mesh::hit(const Ray& ray) const {
+        return hit(ray, std::numeric_limits<double>::max());
     }
 
-    Ray::Intersection Mesh::intersect(const Ray& ray) const {
-        Ray::Intersection boundIntersection = _bound.intersect(ray);
-        if (boundIntersection.distance == 0)
-            return boundIntersection;
+    Ray::Hit Mesh::hit(const Ray& ray, double maxDistance) const {
+        if (_bound.intersect(ray) == 0)
+            return {};
+
+        // The closest triangle in front of the ray, looked up again by interact.
+        Ray::Hit closest;
+        closest.distance = maxDistance;
+        _bvh.intersect(getTriangles(), Vector3 { ray.origin }, Vector3 { ray.direction }, closest);
+        if (closest.distance >= maxDistance) return {};
+        return closest;
+    }
 
-        Ray::Intersection res{0, glm::dvec3(), material, glm::dvec3{}};
-        for (auto t : _triangles) {
-            Ray::Intersection i = t->intersect(ray);
-            if (i.distance == 0) continue;
-            if (res.distance == 0) {
-                res = i;
-            } else if (i.distance < res.distance) {
-                res = i;
+    void Mesh::hit(const Ray* rays, std::size_t count, Ray::Hit* hits) const {
+        for (std::size_t first = 0; first < count; first += simd::Packet::SIZE) {
+            simd::Packet packet {  };
+            packet.count = std::min(count - first, simd::Packet::SIZE);
+            double limits[simd::Packet::SIZE];
+            for (std::size_t r = 0; r < packet.count; ++r) {
+                const Ray& ray { rays[first + r] };
+                Vector3 origin { ray.origin }, direction { ray.direction };
+                packet.ox[r] = origin.x; packet.oy[r] = origin.y; packet.oz[r] = origin.z;
+                packet.dx[r] = direction.x; packet.dy[r] = direction.y; packet.dz[r] = direction.z;
+                // Nothing is closer than 0, so the rays that miss the bound are left out.
+                limits[r] = hits[first + r].distance;
+                if (_bound.intersect(ray) == 0) hits[first + r].distance = 0.0;
             }
+
+            _bvh.intersect(getTriangles(), packet, hits + first);
+            for (std::size_t r = 0; r < packet.count; ++r)
+                if (hits[first + r].distance == 0.0) hits[first + r].distance = limits[r];
         }
-        return res;
+    }
+
+    Ray::Intersection Mesh::interact(const Ray& ray, const Ray::Hit& hit) const {
+        std::size_t t { hit.index };
+        glm::dvec3 normal { _nx[t], _ny[t], _nz[t] };
+        if (glm::dot(normal, ray.direction) > 0) normal = -normal;
+        return {hit.distance, normal, material, ray.origin + ray.direction * hit.distance};
     }
 
     void Mesh::print() {
-        for (MeshTriangle* t : _triangles) {
-            std::cout << *t << std::endl;
+        for (std::size_t t = 0; t < getTriangleCount(); ++t) {
+            std::cout << "Triangle:\n";
+            for (std::size_t k = 0; k < 3; ++k)
+                std::cout << glm::to_string(glm::vec3 { _x[k][t], _y[k][t], _z[k][t] }) << "\n";
+            std::cout << std::endl;
         }
     }
 }
@@ -0,0 +1,221 @@
+#include "mcrt/mesh_cache.hh"
+#include "mcrt/mapped_file.hh"
+
+#include <cstdio>
+#include <cstddef>
+#include <random>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include <sys/stat.h>
+
+namespace {
+    const char MAGIC[] { 'M', 'C', 'R', 'T', 'M', 'E', 'S', 'H' };
+
+    // Everything before the buffers, which are then aligned to at least 16 bytes.
+    struct Header {
+        char magic[sizeof(MAGIC)];
+        std::uint32_t version, flags; // Flags are the Bvh::Layout of the nodes.
+        std::uint64_t sourceSize;
+        std::int64_t sourceTime;
+        std::uint64_t sourceHash;
+        std::uint64_t vertices, indices, bvhNodes;
+    };
+
+    static_assert(sizeof(Header) == 64, "The header is a part of the file format!");
+
+    bool getStatus(const std::string& source, std::uint64_t& size, std::int64_t& time) {
+        struct stat status;
+        if (::stat(source.c_str(), &status) != 0) return false;
+        size = status.st_size;
+        time = status.st_mtime;
+        return true;
+    }
+
+    std::size_t align(std::size_t offset) {
+        return (offset + 15) & ~std::size_t { 15 };
+    }
+
+    std::size_t getNodeSize(mcrt::Bvh::Layout layout) {
+        switch (layout) {
+        case mcrt::Bvh::Layout::BINARY: return sizeof(mcrt::Bvh::Node);
+        case mcrt::Bvh::Layout::BVH4:   return sizeof(mcrt::Bvh::WideNode<4>);
+        case mcrt::Bvh::Layout::BVH8:   return sizeof(mcrt::Bvh::WideNode<8>);
+        default:                        return 0;
+        }
+    }
+
+    // Children always come after their parents, and no deeper than the traversals have
+    // room for on their stacks. Leaves have to be within the triangles of the mesh.
+    bool isValid(const std::vector<mcrt::Bvh::Node>& nodes, std::size_t triangles) {
+        std::vector<std::size_t> depths(nodes.size(), 0);
+        for (std::size_t i = 0; i < nodes.size(); ++i) {
+            const mcrt::Bvh::Node& node { nodes[i] };
+            if (node.count > 0) {
+                if (node.index > triangles || node.count > triangles - node.index) return false;
+            } else {
+                if (node.axis > 2 || node.index <= i || node.index >= nodes.size() - 1) return false;
+                if (depths[i] >= mcrt::Bvh::MAX_DEPTH) return false;
+                for (std::size_t child : { node.index, node.index + 1 })
+                    depths[child] = std::max(depths[child], depths[i] + 1);
+            }
+        }
+
+        return true;
+    }
+
+    // Same for the wide nodes, where the empty slots must never be hit by any ray.
+    template<std::size_t N> bool isValid(const std::vector<mcrt::Bvh::WideNode<N>>& nodes, std::size_t triangles) {
+        std::vector<std::size_t> depths(nodes.size(), 0);
+        for (std::size_t i = 0; i < nodes.size(); ++i) {
+            const mcrt::Bvh::WideNode<N>& node { nodes[i] };
+            for (std::size_t slot = 0; slot < N; ++slot) {
+                std::size_t child { node.child[slot] }, count { node.count[slot] };
+                if (count > 0) {
+                    if (child > triangles || count > triangles - child) return false;
+                } else if (child != 0) {
+                    if (child <= i || child >= nodes.size() || depths[i] >= mcrt::Bvh::MAX_DEPTH) return false;
+                    depths[child] = std::max(depths[child], depths[i] + 1);
+                } else if (node.minX[slot] <= node.maxX[slot] && node.minY[slot] <= node.maxY[slot] &&
+                           node.minZ[slot] <= node.maxZ[slot]) return false;
+            }
+
+            for (std::uint32_t order : node.order)
+                for (std::size_t k = 0; k < N; ++k)
+                    if (((order >> (4 * k)) & 15) >= N) return false;
+        }
+
+        return true;
+    }
+
+    template<typename Node> bool assignNodes(mcrt::Bvh& bvh, const char* bytes, std::size_t count,
+                                             std::size_t triangles) {
+        std::vector<Node> nodes(count);
+        std::memcpy(nodes.data(), bytes, count * sizeof(Node));
+        if (!isValid(nodes, triangles)) return false;
+        bvh.assign(std::move(nodes));
+        return true;
+    }
+}
+
+std::uint64_t mcrt::MeshCache::hash(const char* data, std::size_t size) {
+    // FNV-1a, but eight bytes at a time, with a final mix so all of the bits matter.
+    std::uint64_t hash { 0xcbf29ce484222325ull };
+    std::size_t i { 0 };
+    for (; i + 8 <= size; i += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * 0x100000001b3ull;
+        hash ^= hash >> 32;
+    }
+
+    for (; i < size; ++i) hash = (hash ^ static_cast<unsigned char>(data[i])) * 0x100000001b3ull;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    return hash ^ size;
+}
+
+bool mcrt::MeshCache::load(const std::string& cache, const std::string& source, MeshData& data, Bvh& bvh) {
+    std::uint64_t sourceSize, cacheSize;
+    std::int64_t sourceTime, cacheTime;
+    if (!getStatus(cache, cacheSize, cacheTime) || !getStatus(source, sourceSize, sourceTime))
+        return false;
+
+    const MappedFile file { cache };
+    Header header;
+    if (file.getSize() < sizeof(header)) return false;
+    std::memcpy(&header, file.getData(), sizeof(header));
+    if (!std::equal(header.magic, header.magic + sizeof(MAGIC), MAGIC) || header.version != VERSION)
+        return false;
+
+    // Counts which couldn't possibly fit in the file, so the offsets can't overflow.
+    Bvh::Layout layout { static_cast<Bvh::Layout>(header.flags) };
+    if (getNodeSize(layout) == 0) return false;
+    if (header.vertices > file.getSize() / sizeof(glm::vec3) || header.indices > file.getSize() / sizeof(std::uint32_t) ||
+        header.bvhNodes > file.getSize() / getNodeSize(layout)) return false;
+    if (header.indices % 3 != 0) return false;
+
+    std::size_t positionOffset { align(sizeof(header)) },
+                indexOffset { align(positionOffset + header.vertices * sizeof(glm::vec3)) },
+                bvhOffset { align(indexOffset + header.indices * sizeof(std::uint32_t)) };
+    if (file.getSize() < bvhOffset || file.getSize() - bvhOffset < header.bvhNodes * getNodeSize(layout))
+        return false; // Truncated.
+
+    // Hashing the source is still a lot faster than parsing it, but mostly not needed.
+    if (header.sourceSize != sourceSize) return false;
+    if (header.sourceTime != sourceTime) {
+        const MappedFile sourceFile { source };
+        if (hash(sourceFile.getData(), sourceFile.getSize()) != header.sourceHash) return false;
+        // Still the same, so only the time has to be fixed, for the next time.
+        std::fstream fileStream { cache, std::ios::binary | std::ios::in | std::ios::out };
+        fileStream.seekp(offsetof(Header, sourceTime));
+        fileStream.write(reinterpret_cast<const char*>(&sourceTime), sizeof(sourceTime));
+    }
+
+    const char* bytes { file.getData() };
+    MeshData cached;
+    cached.positions.resize(header.vertices);
+    cached.indices.resize(header.indices);
+    std::memcpy(cached.positions.data(), bytes + positionOffset, header.vertices * sizeof(glm::vec3));
+    std::memcpy(cached.indices.data(), bytes + indexOffset, header.indices * sizeof(std::uint32_t));
+    for (std::uint32_t index : cached.indices)
+        if (index >= header.vertices) return false;
+
+    // Corrupted nodes would be traversed out of bounds, so it's parsed again instead.
+    std::size_t triangles { cached.getTriangleCount() };
+    if (header.bvhNodes != 0 && layout == bvh.getLayout()) {
+        bool valid { false };
+        switch (layout) {
+        case Bvh::Layout::BINARY: valid = assignNodes<Bvh::Node>(bvh, bytes + bvhOffset, header.bvhNodes, triangles); break;
+        case Bvh::Layout::BVH4:   valid = assignNodes<Bvh::WideNode<4>>(bvh, bytes + bvhOffset, header.bvhNodes, triangles); break;
+        case Bvh::Layout::BVH8:   valid = assignNodes<Bvh::WideNode<8>>(bvh, bytes + bvhOffset, header.bvhNodes, triangles); break;
+        }
+
+        if (!valid) return false;
+    }
+
+    data = std::move(cached);
+    return true;
+}
+
+void mcrt::MeshCache::save(const std::string& cache, const std::string& source,
+                           const MeshData& data, const Bvh& bvh) {
+    Header header {  };
+    std::copy(MAGIC, MAGIC + sizeof(MAGIC), header.magic);
+    header.version = VERSION;
+    if (!getStatus(source, header.sourceSize, header.sourceTime))
+        throw std::runtime_error { "Could not open '" + source + "'!" };
+    const MappedFile sourceFile { source };
+    header.sourceHash = hash(sourceFile.getData(), sourceFile.getSize());
+    header.vertices = data.positions.size();
+    header.indices = data.indices.size();
+    header.flags = static_cast<std::uint32_t>(bvh.getLayout());
+    header.bvhNodes = bvh.getNodeCount();
+
+    // Every process (of OpenMPI) might be writing it at once, so they each get a file.
+    std::string temporaryFile { cache + "." + std::to_string(std::random_device {  }()) + ".tmp" };
+    std::ofstream fileStream { temporaryFile, std::ios::binary };
+    if (!fileStream) throw std::runtime_error { "Could not create '" + temporaryFile + "'!" };
+
+    const char padding[16] {  };
+    auto writePadded = [&fileStream, &padding](const void* bytes, std::size_t size) {
+        fileStream.write(static_cast<const char*>(bytes), size);
+        std::size_t offset = fileStream.tellp();
+        fileStream.write(padding, align(offset) - offset);
+    };
+
+    writePadded(&header, sizeof(header));
+    writePadded(data.positions.data(), data.positions.size() * sizeof(glm::vec3));
+    writePadded(data.indices.data(), data.indices.size() * sizeof(std::uint32_t));
+    writePadded(bvh.getNodes().data(), bvh.getNodes().size() * sizeof(Bvh::Node));
+    writePadded(bvh.getNodes4().data(), bvh.getNodes4().size() * sizeof(Bvh::WideNode<4>));
+    writePadded(bvh.getNodes8().data(), bvh.getNodes8().size() * sizeof(Bvh::WideNode<8>));
+
+    fileStream.close();
+    if (!fileStream || std::rename(temporaryFile.c_str(), cache.c_str()) != 0) {
+        std::remove(temporaryFile.c_str());
+        throw std::runtime_error { "Could not write '" + cache + "'!" };
+    }
+}
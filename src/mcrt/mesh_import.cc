@@ -1,66 +1,282 @@
 #include "mcrt/mesh_import.hh"
+#include "mcrt/mesh_cache.hh"
+#include "mcrt/mapped_file.hh"
 
 #include <vector>
-#include <tiny_obj_loader.hh>
 #include <glm/glm.hpp>
 #include <string>
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <iomanip>
+#include <sstream>
 #include <iostream>
+#include <stdexcept>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+    // Lines of the file between these, which one thread takes. Also the number of the
+    // positions before it, which are counted in a pass of their own first.
+    struct Chunk {
+        const char* begin { nullptr };
+        const char* end { nullptr };
+        std::size_t positions { 0 };
+        std::size_t positionOffset { 0 };
+        std::vector<std::uint32_t> corners; // Position of each, three for every triangle.
+        bool valid { true };
+    };
+
+    // Plenty for the threads to share, and still small enough to be balanced.
+    constexpr std::size_t CHUNK_SIZE { 1 << 20 };
+
+    bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+    bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+    const char* skipSpaces(const char* p, const char* end) {
+        while (p < end && isSpace(*p)) ++p;
+        return p;
+    }
+
+    template<typename F> void forEachLine(const char* p, const char* end, F line) {
+        while (p < end) {
+            const char* lineEnd { static_cast<const char*>(std::memchr(p, '\n', end - p)) };
+            if (lineEnd == nullptr) lineEnd = end;
+            line(skipSpaces(p, lineEnd), lineEnd);
+            p = lineEnd + 1;
+        }
+    }
+
+    // Exact powers up to the ones which still fit in the mantissa of a double.
+    double power10(int exponent) {
+        static const double powers[] { 1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                       1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                       1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+        if (exponent <= 22) return powers[exponent];
+        return std::pow(10.0, exponent);
+    }
+
+    // Not locale dependent (or as slow) as strtof, and exact enough for any floats,
+    // since the digits are gathered as an integer and only scaled once at the end.
+    const char* parseFloat(const char* p, const char* end, float& value) {
+        p = skipSpaces(p, end);
+        bool negative { false };
+        if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+        std::uint64_t mantissa { 0 };
+        int exponent { 0 }, digits { 0 };
+        for (; p < end && isDigit(*p); ++p, ++digits) {
+            if (mantissa < 100000000000000000ull) mantissa = mantissa*10 + (*p - '0');
+            else ++exponent; // Way beyond what a float can tell apart anyway.
+        }
+
+        if (p < end && *p == '.') {
+            for (++p; p < end && isDigit(*p); ++p, ++digits) {
+                if (mantissa >= 100000000000000000ull) continue;
+                mantissa = mantissa*10 + (*p - '0');
+                --exponent;
+            }
+        }
+
+        if (digits == 0) return nullptr;
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            const char* e { p + 1 };
+            bool negativeExponent { false };
+            if (e < end && (*e == '-' || *e == '+')) negativeExponent = *e++ == '-';
+            int power { 0 };
+            const char* powerBegin { e };
+            for (; e < end && isDigit(*e); ++e) if (power < 1000) power = power*10 + (*e - '0');
+            if (e != powerBegin) {
+                exponent += negativeExponent ? -power : power;
+                p = e;
+            }
+        }
+
+        double result = mantissa;
+        if (exponent < 0) result /= power10(-exponent);
+        else if (exponent > 0) result *= power10(exponent);
+        value = negative ? -result : result;
+        return p;
+    }
+
+    const char* parseIndex(const char* p, const char* end, std::int64_t& value) {
+        bool negative { false };
+        if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+        const char* begin { p };
+        std::int64_t index { 0 };
+        for (; p < end && isDigit(*p); ++p) index = index*10 + (*p - '0');
+        if (p == begin) return nullptr;
+        value = negative ? -index : index;
+        return p;
+    }
+
+    // OBJ counts from 1, and negative ones count back from the last one so far.
+    std::int64_t resolveIndex(std::int64_t index, std::size_t sofar) {
+        return index > 0 ? index - 1 : static_cast<std::int64_t>(sofar) + index;
+    }
+
+    bool isVertex(const char* p, const char* end) {
+        return end - p >= 2 && p[0] == 'v' && isSpace(p[1]);
+    }
+
+    bool isFace(const char* p, const char* end) {
+        return end - p >= 2 && p[0] == 'f' && isSpace(p[1]);
+    }
+
+    void parseFace(const char* p, const char* end, Chunk& chunk,
+                   std::size_t positions, std::size_t totalPositions) {
+        std::int64_t first { 0 }, previous { 0 };
+        std::size_t count { 0 };
+        while (true) {
+            p = skipSpaces(p, end);
+            if (p >= end || *p == '#') break;
+
+            // Any of v, v/vt, v//vn or v/vt/vn, where only the positions are used, since
+            // the triangles are flat shaded (by their own normals) anyway.
+            std::int64_t position, texture, normal { 0 };
+            p = parseIndex(p, end, position);
+            if (p != nullptr && p < end && *p == '/') {
+                if (++p < end && *p != '/') p = parseIndex(p, end, texture);
+                if (p != nullptr && p < end && *p == '/') p = parseIndex(p + 1, end, normal);
+            }
+
+            if (p == nullptr || position == 0 || (p < end && !isSpace(*p))) {
+                chunk.valid = false;
+                return;
+            }
+
+            std::int64_t corner { resolveIndex(position, positions) };
+            if (corner < 0 || corner >= static_cast<std::int64_t>(totalPositions)) {
+                chunk.valid = false;
+                return;
+            }
+
+            if (count == 0) {
+                first = corner;
+            } else if (count >= 2) { // A fan around the first corner.
+                chunk.corners.insert(chunk.corners.end(), { static_cast<std::uint32_t>(first),
+                                                            static_cast<std::uint32_t>(previous),
+                                                            static_cast<std::uint32_t>(corner) });
+            }
+
+            previous = corner;
+            ++count;
+        }
+
+        if (count < 3) chunk.valid = false;
+    }
+}
 
 namespace mcrt {
     Material* MeshImporter::_material { nullptr };
 
     Mesh* MeshImporter::load(std::string filename) {
-        tinyobj::attrib_t attrib;
-        std::vector<tinyobj::shape_t> shapes;
-        std::vector<tinyobj::material_t> materials;
+        auto loadStart = std::chrono::steady_clock::now();
+        MeshData data;
+        Bvh bvh;
+        std::string cache { MeshCache::getPath(filename) };
+        bool cached { MeshCache::load(cache, filename, data, bvh) };
+        if (!cached) data = parse(filename);
 
-        std::string err;
-        bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, filename.c_str());
+        // Builds the hierarchy if it didn't come with the cache (and puts the triangles
+        // in its order), which is then saved for the next time along with the rest.
+        bool built { bvh.isEmpty() && data.getTriangleCount() > 0 };
+        Mesh* mesh { new Mesh { std::move(data), std::move(bvh), _material } };
+        if (cached) {
+            std::chrono::duration<double> loadTime { std::chrono::steady_clock::now() - loadStart };
+            std::cout << "Loaded '" << filename << "': " << mesh->getTriangleCount() << " triangles, from '"
+                      << cache << "' in " << static_cast<std::size_t>(loadTime.count() * 1000) << " ms." << std::endl;
+        }
 
-        if (!err.empty()) { // `err` may contain warning message.
-            std::cerr << err << std::endl;
+        if (!cached || built) {
+            try { // Next time it's only mapped, but it works without too.
+                MeshCache::save(cache, filename, mesh->getData(), mesh->getBvh());
+            } catch (const std::exception& error) {
+                std::cerr << "Warning: " << error.what() << " The mesh will be parsed again." << std::endl;
+            }
         }
 
-        Mesh* mesh = new Mesh{_material};
+        return mesh;
+    }
+
+    MeshData MeshImporter::parse(const std::string& filename) {
+        auto parseStart = std::chrono::steady_clock::now();
+        const MappedFile file { filename };
+        const char* begin { file.getData() };
+        const char* end { begin + file.getSize() };
 
-        if (!ret) {
-            return mesh;
+        // The chunks start after the first line break past where they would've started.
+        std::vector<Chunk> chunks;
+        const char* chunkBegin { begin };
+        while (chunkBegin < end) {
+            const char* chunkEnd { chunkBegin + std::min<std::size_t>(CHUNK_SIZE, end - chunkBegin) };
+            const char* lineEnd { static_cast<const char*>(std::memchr(chunkEnd, '\n', end - chunkEnd)) };
+            chunkEnd = lineEnd != nullptr ? lineEnd + 1 : end;
+            chunks.emplace_back();
+            chunks.back().begin = chunkBegin;
+            chunks.back().end = chunkEnd;
+            chunkBegin = chunkEnd;
         }
 
-        // Loop over shapes
-        for (size_t s = 0; s < shapes.size(); s++) {
-            // Loop over faces(polygon)
-            size_t index_offset = 0;
-            for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
-                unsigned fv = shapes[s].mesh.num_face_vertices[f];
-
-                std::vector<glm::dvec3> vertices;
-                std::vector<glm::dvec3>  normals;
-
-                // Loop over vertices in the face.
-                for (size_t v = 0; v < fv; v++) {
-                    tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
-                    tinyobj::real_t vx = attrib.vertices[3*idx.vertex_index+0];
-                    tinyobj::real_t vy = attrib.vertices[3*idx.vertex_index+1];
-                    tinyobj::real_t vz = attrib.vertices[3*idx.vertex_index+2];
-                    tinyobj::real_t nx = attrib.normals[3*idx.normal_index+0];
-                    tinyobj::real_t ny = attrib.normals[3*idx.normal_index+1];
-                    tinyobj::real_t nz = attrib.normals[3*idx.normal_index+2];
-
-                    vertices.push_back({vx, vy, vz});
-                    normals.push_back({nx, ny, nz});
-                }
+        // First only count them, so every chunk knows where its positions go.
+        #pragma omp parallel for schedule(dynamic)
+        for (std::size_t i = 0; i < chunks.size(); ++i) {
+            Chunk& chunk { chunks[i] };
+            forEachLine(chunk.begin, chunk.end, [&chunk](const char* p, const char* lineEnd) {
+                if (isVertex(p, lineEnd)) ++chunk.positions;
+            });
+        }
+
+        std::size_t totalPositions { 0 };
+        for (Chunk& chunk : chunks) {
+            chunk.positionOffset = totalPositions;
+            totalPositions += chunk.positions;
+        }
 
-                if (vertices.size() == 3 && normals.size() == 3) {
-                    mesh->addTriangle(vertices[0], vertices[1], vertices[2],
-                                      normals[0],  normals[1],  normals[2]);
+        // Then parse them straight into their place, which are the vertices of the mesh.
+        MeshData data;
+        data.positions.resize(totalPositions);
+        #pragma omp parallel for schedule(dynamic)
+        for (std::size_t i = 0; i < chunks.size(); ++i) {
+            Chunk& chunk { chunks[i] };
+            std::size_t position { chunk.positionOffset };
+            forEachLine(chunk.begin, chunk.end, [&](const char* p, const char* lineEnd) {
+                if (!chunk.valid) return;
+                if (isVertex(p, lineEnd)) {
+                    glm::vec3& value { data.positions[position++] };
+                    ++p;
+                    for (int axis = 0; axis < 3 && p != nullptr; ++axis)
+                        p = parseFloat(p, lineEnd, value[axis]);
+                    if (p == nullptr) chunk.valid = false;
+                } else if (isFace(p, lineEnd)) {
+                    parseFace(p + 1, lineEnd, chunk, position, totalPositions);
                 }
+            });
+        }
 
-                index_offset += fv;
-            }
+        std::size_t corners { 0 };
+        for (const Chunk& chunk : chunks) {
+            if (!chunk.valid) throw std::runtime_error { "Error: '" + filename + "' has a line which isn't valid!" };
+            corners += chunk.corners.size();
         }
 
-        return mesh;
+        // Faces index the positions of the file directly, so they're only put together.
+        data.indices.reserve(corners);
+        for (const Chunk& chunk : chunks)
+            data.indices.insert(data.indices.end(), chunk.corners.begin(), chunk.corners.end());
+
+        std::chrono::duration<double> parseTime { std::chrono::steady_clock::now() - parseStart };
+        double megabytes { file.getSize() / 1e6 };
+        std::ostringstream report;
+        report << std::fixed << std::setprecision(1) << "Loaded '" << filename << "': "
+               << data.getTriangleCount() << " triangles, " << megabytes << " MB at "
+               << megabytes / std::max(parseTime.count(), 1e-6) << " MB/s.";
+        std::cout << report.str() << std::endl;
+        return data;
     }
 
     void MeshImporter::setMaterial(Material* m) {
@@ -0,0 +1,183 @@
+#include "mcrt/metropolis.hh"
+
+#include <cmath>
+#include <numeric>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+void mcrt::MetropolisTracer::PrimarySamples::startIteration() {
+    ++iteration;
+    largeStep = uniform(generator) < largeStepProbability;
+    index = 0;
+}
+
+void mcrt::MetropolisTracer::PrimarySamples::startLargeStep() {
+    ++iteration;
+    largeStep = true;
+    index = 0;
+}
+
+void mcrt::MetropolisTracer::PrimarySamples::accept() {
+    if (largeStep) lastLargeStep = iteration;
+}
+
+void mcrt::MetropolisTracer::PrimarySamples::reject() {
+    for (Sample& sample : samples) {
+        if (sample.lastModified == iteration) {
+            sample.value = sample.backupValue;
+            sample.lastModified = sample.backupModified;
+        }
+    }
+
+    --iteration;
+}
+
+double mcrt::MetropolisTracer::PrimarySamples::next() {
+    if (index >= samples.size()) samples.resize(index + 1);
+    Sample& sample { samples[index++] };
+    mutate(sample);
+    return sample.value;
+}
+
+void mcrt::MetropolisTracer::PrimarySamples::mutate(Sample& sample) {
+    if (sample.lastModified == iteration) return; // Already used this iteration.
+
+    // Sample hasn't been touched since the last large step, so it would've been reset.
+    if (sample.lastModified < lastLargeStep) {
+        sample.value = uniform(generator);
+        sample.lastModified = lastLargeStep;
+    }
+
+    sample.backupValue = sample.value;
+    sample.backupModified = sample.lastModified;
+
+    if (largeStep) {
+        sample.value = uniform(generator);
+    } else {
+        // Catch up on all the small steps this sample has missed since then.
+        std::int64_t smallSteps { iteration - sample.lastModified };
+        double sigma { MUTATION_SIGMA * std::sqrt(static_cast<double>(smallSteps)) };
+        sample.value += normal(generator) * sigma;
+        sample.value -= std::floor(sample.value);
+    }
+
+    sample.lastModified = iteration;
+}
+
+mcrt::MetropolisTracer::MetropolisTracer(const Scene& scene, const Image& image,
+                                         std::size_t chainCount, double largeStepProbability)
+    : scene { scene }, image { image }, chainCount { std::max<std::size_t>(chainCount, 1) },
+      largeStepProbability { largeStepProbability } {  }
+
+void mcrt::MetropolisTracer::bootstrap(std::size_t bootstrapSamples, bool parallel, std::uint64_t seed) {
+    bootstrapSamples = std::max<std::size_t>(bootstrapSamples, 1);
+    std::vector<double> weights(bootstrapSamples);
+
+    #pragma omp parallel for schedule(dynamic, 64) if (parallel)
+    for (std::size_t i = 0; i < bootstrapSamples; ++i) {
+        PrimarySamples samples { sampling::streamSeed(seed, i), largeStepProbability };
+        samples.startLargeStep();
+        glm::dvec2 raster;
+        weights[i] = contribution(evaluate(samples, raster));
+    }
+
+    brightness = std::accumulate(weights.begin(), weights.end(), 0.0) / bootstrapSamples;
+
+    std::vector<double> cdf(bootstrapSamples);
+    std::partial_sum(weights.begin(), weights.end(), cdf.begin());
+
+    // Start the chains at the bootstrap paths proportionally to how bright they were.
+    chains.clear();
+    chains.reserve(chainCount);
+    for (std::size_t i { 0 }; i < chainCount; ++i) {
+        std::mt19937_64 generator { sampling::streamSeed(seed, bootstrapSamples + i) };
+        double target { std::uniform_real_distribution<double> { 0.0, cdf.back() }(generator) };
+        std::size_t start = std::upper_bound(cdf.begin(), cdf.end(), target) - cdf.begin();
+        start = std::min(start, bootstrapSamples - 1);
+
+        // Same seed as in the bootstrap, so we'll get the very same path back again.
+        Chain chain { PrimarySamples { sampling::streamSeed(seed, start), largeStepProbability },
+                      generator, glm::dvec2 { 0.0 }, glm::dvec3 { 0.0 }, 0.0 };
+        chain.samples.startLargeStep();
+        chain.radiance = evaluate(chain.samples, chain.raster);
+        chain.contribution = contribution(chain.radiance);
+        chain.samples.accept();
+        chains.push_back(std::move(chain));
+    }
+}
+
+void mcrt::MetropolisTracer::render(std::size_t mutations, Film& film, bool parallel) {
+    if (chains.empty() || brightness <= 0.0) return;
+    std::size_t chainMutations { (mutations + chains.size() - 1) / chains.size() };
+    // Each pixel is expected to get brightness times the average mutations per pixel.
+    double scale { brightness * image.getSize() / (chainMutations * chains.size()) };
+
+    #pragma omp parallel for schedule(dynamic) if (parallel)
+    for (std::size_t c = 0; c < chains.size(); ++c) {
+        std::size_t thread { 0 };
+#ifdef _OPENMP
+        if (parallel) thread = omp_get_thread_num();
+#endif
+        Chain& chain { chains[c] };
+        Film::Splats& splats { film.getSplats(thread) };
+        std::uniform_real_distribution<double> uniform { 0.0, 1.0 };
+
+        for (std::size_t i { 0 }; i < chainMutations; ++i) {
+            chain.samples.startIteration();
+            glm::dvec2 raster;
+            glm::dvec3 radiance { evaluate(chain.samples, raster) };
+            double proposed { contribution(radiance) };
+
+            double acceptance { 1.0 };
+            if (chain.contribution > 0.0) acceptance = std::min(1.0, proposed / chain.contribution);
+
+            // Expected values, so both the current and the proposed state get a splat.
+            if (acceptance > 0.0 && proposed > 0.0)
+                splat(splats, raster, radiance * scale * acceptance / proposed);
+            if (chain.contribution > 0.0)
+                splat(splats, chain.raster, chain.radiance * scale * (1.0 - acceptance) / chain.contribution);
+
+            if (uniform(chain.generator) < acceptance) {
+                chain.raster = raster;
+                chain.radiance = radiance;
+                chain.contribution = proposed;
+                chain.samples.accept();
+            } else chain.samples.reject();
+        }
+    }
+}
+
+glm::dvec3 mcrt::MetropolisTracer::evaluate(PrimarySamples& samples, glm::dvec2& raster) const {
+    sampling::setStream(&samples);
+
+    // First two samples pick where in the image the path goes through.
+    raster = { sampling::uniform() * image.getWidth(), sampling::uniform() * image.getHeight() };
+    std::size_t x = std::min<std::size_t>(raster.x, image.getWidth()  - 1),
+                y = std::min<std::size_t>(raster.y, image.getHeight() - 1);
+
+    const Camera& camera { scene.getCamera() };
+    auto samplingPlane = camera.getPixelSamplingPlane(image, x, y);
+    glm::dvec3 viewPlanePoint { samplingPlane.corners[0] };
+    viewPlanePoint += (raster.x - x) * (samplingPlane.corners[1] - samplingPlane.corners[0]);
+    viewPlanePoint += (raster.y - y) * (samplingPlane.corners[3] - samplingPlane.corners[0]);
+
+    glm::dvec3 rayDirection { glm::normalize(viewPlanePoint - camera.getEyePosition()) };
+    glm::dvec3 radiance { scene.rayTrace({ viewPlanePoint, rayDirection }, 0) };
+
+    sampling::setStream(nullptr);
+    return radiance;
+}
+
+double mcrt::MetropolisTracer::contribution(const glm::dvec3& radiance) {
+    // Luminance, so the chains spend their time on what we perceive.
+    return std::max(0.0, 0.2126*radiance.r + 0.7152*radiance.g + 0.0722*radiance.b);
+}
+
+void mcrt::MetropolisTracer::splat(Film::Splats& splats, const glm::dvec2& raster, const glm::dvec3& radiance) const {
+    std::size_t x = std::min<std::size_t>(raster.x, image.getWidth()  - 1),
+                y = std::min<std::size_t>(raster.y, image.getHeight() - 1);
+    splats.add(x, y, radiance);
+}
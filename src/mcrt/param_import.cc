@@ -1,13 +1,19 @@
 #include "mcrt/param_import.hh"
 
 #include <fstream>
+#include <sstream>
 #include <stdexcept>
 #include "json.hh"
 
 mcrt::Parameters mcrt::ParameterImporter::load(const std::string& file) {
     std::ifstream fileStream { file };
-    nlohmann::json parser;
-    fileStream >> parser;
+    std::stringstream contents;
+    contents << fileStream.rdbuf();
+    return parse(contents.str());
+}
+
+mcrt::Parameters mcrt::ParameterImporter::parse(const std::string& json) {
+    nlohmann::json parser = nlohmann::json::parse(json);
 
     Parameters parameters;
 
@@ -25,6 +31,14 @@ mcrt::Parameters mcrt::ParameterImporter::load(const std::string& file) {
         else std::runtime_error { "Error: no support for parallel framework '" + parallel + "'!" };
     }
 
+    if (parser.find("integrator") != parser.end()) {
+        std::string integrator { parser["integrator"].get<std::string>() };
+        if (integrator == "path") parameters.integrator = Parameters::Integrator::PATH;
+        else if (integrator == "bdpt") parameters.integrator = Parameters::Integrator::BIDIRECTIONAL;
+        else if (integrator == "mlt") parameters.integrator = Parameters::Integrator::METROPOLIS;
+        else throw std::runtime_error { "Error: no support for the '" + integrator + "' integrator!" };
+    }
+
     if (parser.find("resolution") != parser.end()) {
         nlohmann::json resolution { parser["resolution"] };
         if (resolution.size() != 2) std::runtime_error { "Error: resolution parameter is malformed!" };
@@ -66,6 +80,18 @@ mcrt::Parameters mcrt::ParameterImporter::load(const std::string& file) {
         else std::runtime_error { "Error: no support for this: '" + sampleMethod + "' pattern!" };
     }
 
+    if (parser.find("filter") != parser.end()) {
+        nlohmann::json filter = parser["filter"]; // Braces would make ["box", 0.5] an object.
+        if (filter.size() != 2) throw std::runtime_error { "Error: filter parameters are malformed!" };
+        std::string filterType { filter[0].get<std::string>() };
+        if (filterType == "box") parameters.filterType = Filter::Type::BOX;
+        else if (filterType == "gaussian") parameters.filterType = Filter::Type::GAUSSIAN;
+        else if (filterType == "mitchell") parameters.filterType = Filter::Type::MITCHELL;
+        else if (filterType == "blackman-harris") parameters.filterType = Filter::Type::BLACKMAN_HARRIS;
+        else throw std::runtime_error { "Error: no support for this: '" + filterType + "' filter!" };
+        parameters.filterRadius = filter[1].get<double>();
+    }
+
     if (parser.find("maxRayDepth") != parser.end()) {
         size_t maxRayDepth { parser["maxRayDepth"].get<size_t>() };
         parameters.maxRayDepth = maxRayDepth;
@@ -89,6 +115,20 @@ mcrt::Parameters mcrt::ParameterImporter::load(const std::string& file) {
         else parameters.photonMap = false;
     }
 
+    if (parser.find("globalPhotonMap") != parser.end()) {
+        size_t globalPhotonMap { parser["globalPhotonMap"].get<size_t>() };
+        if (globalPhotonMap > 0) parameters.globalPhotonMap = true;
+        else parameters.globalPhotonMap = false;
+    }
+
+    if (parser.find("globalPhotonAmount") != parser.end()) {
+        parameters.globalPhotonAmount = parser["globalPhotonAmount"].get<size_t>();
+    }
+
+    if (parser.find("globalEstimationRadius") != parser.end()) {
+        parameters.globalEstimationRadius = parser["globalEstimationRadius"].get<double>();
+    }
+
     if (parser.find("recordStatistics") != parser.end()) {
         size_t recordStatistics { parser["recordStatistics"].get<size_t>() };
         if (recordStatistics > 0) parameters.recordStatistics = true;
@@ -101,5 +141,71 @@ mcrt::Parameters mcrt::ParameterImporter::load(const std::string& file) {
         else parameters.photonMapVisualize = false;
     }
 
+    if (parser.find("irradianceCache") != parser.end()) {
+        size_t irradianceCache { parser["irradianceCache"].get<size_t>() };
+        if (irradianceCache > 0) parameters.irradianceCache = true;
+        else parameters.irradianceCache = false;
+    }
+
+    if (parser.find("irradianceCacheError") != parser.end()) {
+        parameters.irradianceCacheError = parser["irradianceCacheError"].get<double>();
+    }
+
+    if (parser.find("finalGatherRays") != parser.end()) {
+        parameters.finalGatherRays = parser["finalGatherRays"].get<size_t>();
+    }
+
+    if (parser.find("virtualLights") != parser.end()) {
+        parameters.virtualLights = parser["virtualLights"].get<size_t>() > 0;
+    }
+
+    if (parser.find("virtualLightPaths") != parser.end()) {
+        parameters.virtualLightPaths = parser["virtualLightPaths"].get<size_t>();
+    }
+
+    if (parser.find("lightcutError") != parser.end()) {
+        parameters.lightcutError = parser["lightcutError"].get<double>();
+    }
+
+    if (parser.find("restir") != parser.end()) {
+        parameters.restir = parser["restir"].get<size_t>() > 0;
+    }
+
+    if (parser.find("restirCandidates") != parser.end()) {
+        parameters.restirCandidates = parser["restirCandidates"].get<size_t>();
+    }
+
+    if (parser.find("restirNeighbours") != parser.end()) {
+        parameters.restirNeighbours = parser["restirNeighbours"].get<size_t>();
+    }
+
+    if (parser.find("restirRadius") != parser.end()) {
+        parameters.restirRadius = parser["restirRadius"].get<double>();
+    }
+
+    if (parser.find("metropolisBootstrap") != parser.end()) {
+        parameters.metropolisBootstrap = parser["metropolisBootstrap"].get<size_t>();
+    }
+
+    if (parser.find("metropolisChains") != parser.end()) {
+        parameters.metropolisChains = parser["metropolisChains"].get<size_t>();
+    }
+
+    if (parser.find("largeStepProbability") != parser.end()) {
+        parameters.largeStepProbability = parser["largeStepProbability"].get<double>();
+    }
+
+    if (parser.find("seed") != parser.end()) {
+        parameters.seed = parser["seed"].get<std::uint64_t>();
+    }
+
+    if (parser.find("checkpointInterval") != parser.end()) {
+        parameters.checkpointInterval = parser["checkpointInterval"].get<double>();
+    }
+
+    if (parser.find("temporalSamples") != parser.end()) {
+        parameters.temporalSamples = parser["temporalSamples"].get<size_t>();
+    }
+
     return parameters;
 }
@@ -3,7 +3,7 @@
 #include <fstream>
 #include <iostream>
 
-void mcrt::Parameters::writeStatistics(const std::string& renderPath, double seconds) {
+void mcrt::Parameters::writeStatistics(const std::string& renderPath, double seconds) const {
     bool writeHeader = false;
     std::ifstream checkFile { "statistics.csv" };
     if (!checkFile.good()) writeHeader = true;
@@ -11,8 +11,14 @@ void mcrt::Parameters::writeStatistics(const std::string& renderPath, double sec
 
     std::ofstream fileStream { "statistics.csv", std::fstream::app };
     if (writeHeader) fileStream << "parallelFramework,resolutionWidth,resolutionHeight,scalingFactorX,scalingFactorY,"
-                                << "interpolationMethod,samplingPattern,samplesPerPixel,maxRayDepth,shadowRayCount,"
-                                << "photonEstimationRadius,photonAmount,photonMap,progressiveRendering,renderPath,renderTime"
+                                << "interpolationMethod,samplingPattern,samplesPerPixel,filter,filterRadius,maxRayDepth,shadowRayCount,"
+                                << "photonEstimationRadius,photonAmount,photonMap,progressiveRendering,"
+                                << "irradianceCache,irradianceCacheError,finalGatherRays,"
+                                << "globalPhotonMap,globalPhotonAmount,globalEstimationRadius,integrator,"
+                                << "metropolisBootstrap,metropolisChains,largeStepProbability,"
+                                << "virtualLights,virtualLightPaths,lightcutError,"
+                                << "restir,restirCandidates,restirNeighbours,restirRadius,seed,checkpointInterval,temporalSamples,"
+                                << "renderPath,renderTime"
                                 << std::endl;
 
     fileStream << *this;
@@ -36,8 +42,30 @@ std::ostream& operator<<(std::ostream& output, const mcrt::Parameters& parameter
     else if (parameters.samplingPattern == mcrt::Supersampler::Pattern::RANDOM) output << "rand" << ',';
     else if (parameters.samplingPattern == mcrt::Supersampler::Pattern::GAUSSIAN) output << "norm" << ',';
 
-    output << parameters.samplesPerPixel << ',' << parameters.maxRayDepth << ',' << parameters.shadowRayCount << ',';
+    output << parameters.samplesPerPixel << ',';
+    if (parameters.filterType == mcrt::Filter::Type::BOX) output << "box" << ',';
+    else if (parameters.filterType == mcrt::Filter::Type::GAUSSIAN) output << "gaussian" << ',';
+    else if (parameters.filterType == mcrt::Filter::Type::MITCHELL) output << "mitchell" << ',';
+    else if (parameters.filterType == mcrt::Filter::Type::BLACKMAN_HARRIS) output << "blackman-harris" << ',';
+    output << parameters.filterRadius << ',';
+    output << parameters.maxRayDepth << ',' << parameters.shadowRayCount << ',';
     output << parameters.photonEstimationRadius << ',' << parameters.photonAmount << ',';
     output << parameters.photonMap << ',' << parameters.progressiveRendering << ',';
+    output << parameters.irradianceCache << ',' << parameters.irradianceCacheError << ',';
+    output << parameters.finalGatherRays << ',';
+    output << parameters.globalPhotonMap << ',' << parameters.globalPhotonAmount << ',';
+    output << parameters.globalEstimationRadius << ',';
+
+    if (parameters.integrator == mcrt::Parameters::Integrator::PATH) output << "path" << ',';
+    else if (parameters.integrator == mcrt::Parameters::Integrator::BIDIRECTIONAL) output << "bdpt" << ',';
+    else if (parameters.integrator == mcrt::Parameters::Integrator::METROPOLIS) output << "mlt" << ',';
+    output << parameters.metropolisBootstrap << ',' << parameters.metropolisChains << ',';
+    output << parameters.largeStepProbability << ',';
+    output << parameters.virtualLights << ',' << parameters.virtualLightPaths << ',';
+    output << parameters.lightcutError << ',';
+    output << parameters.restir << ',' << parameters.restirCandidates << ',';
+    output << parameters.restirNeighbours << ',' << parameters.restirRadius << ',';
+    output << parameters.seed << ',' << parameters.checkpointInterval << ',';
+    output << parameters.temporalSamples << ',';
     return output;
 }
@@ -0,0 +1,208 @@
+#include "mcrt/primitives.hh"
+
+#include <limits>
+#include <algorithm>
+#include <typeinfo>
+
+namespace {
+    // Same as Sphere::intersect, but only the distance, or 0 if it missed.
+    mcrt::Real intersectSphere(const mcrt::Vector3& origin, mcrt::Real radius,
+                               const mcrt::Vector3& rayOrigin, const mcrt::Vector3& rayDirection) {
+        mcrt::Vector3 L = origin - rayOrigin;
+        mcrt::Real tca = glm::dot(L, rayDirection);
+        if (tca < 0) return 0;
+
+        mcrt::Real d2 = glm::dot(L, L) - tca * tca;
+        if (d2 > radius*radius) return 0;
+
+        mcrt::Real thc = std::sqrt(radius*radius - d2);
+        mcrt::Real t0 = tca - thc, t1 = tca + thc;
+        if (t0 > t1) std::swap(t0, t1);
+        if (t0 < 0) {
+            t0 = t1;
+            if (t0 < 0) return 0;
+        }
+
+        return t0;
+    }
+
+    // Same as Triangle::intersect (Möller–Trumbore), but only the distance, or 0.
+    mcrt::Real intersectTriangle(const mcrt::Vector3& v1, const mcrt::Vector3& e1, const mcrt::Vector3& e2,
+                                 const mcrt::Vector3& rayOrigin, const mcrt::Vector3& rayDirection) {
+        const mcrt::Real epsilon { mcrt::Ray::EPSILON };
+        mcrt::Vector3 pvec = glm::cross(rayDirection, e2);
+        mcrt::Real det = glm::dot(e1, pvec);
+        if (det < epsilon && det > -epsilon) return 0;
+
+        mcrt::Real inv_det = 1 / det;
+        mcrt::Vector3 tvec = rayOrigin - v1;
+        mcrt::Real u = glm::dot(tvec, pvec) * inv_det;
+        if (u < 0 || u > 1) return 0;
+
+        mcrt::Vector3 qvec = glm::cross(tvec, e1);
+        mcrt::Real v = glm::dot(rayDirection, qvec) * inv_det;
+        if (v < 0 || u + v > 1) return 0;
+
+        return glm::dot(e2, qvec) * inv_det;
+    }
+}
+
+void mcrt::Primitives::build(const std::vector<Geometry*>& geometries) {
+    clear();
+    for (const Geometry* geometry : geometries) add(geometry);
+}
+
+void mcrt::Primitives::add(const Geometry* geometry) {
+    // Only these exact types, anything derived from them might intersect differently.
+    const std::type_info& type { typeid(*geometry) };
+    if (type == typeid(Sphere)) {
+        const Sphere& sphere { static_cast<const Sphere&>(*geometry) };
+        sphereOrigins.push_back(Vector3 { sphere.getOrigin() });
+        sphereRadii.push_back(static_cast<Real>(sphere.getRadius()));
+        sphereMaterials.push_back(sphere.getMaterial());
+    } else if (type == typeid(Triangle)) {
+        const Triangle& triangle { static_cast<const Triangle&>(*geometry) };
+        glm::dmat3 corners { triangle.getCorners() };
+        triangleVertices.push_back(Vector3 { corners[0] });
+        triangleEdges1.push_back(Vector3 { corners[1] - corners[0] });
+        triangleEdges2.push_back(Vector3 { corners[2] - corners[0] });
+        triangleMaterials.push_back(triangle.getMaterial());
+    } else if (type == typeid(Mesh)) {
+        meshes.push_back(static_cast<const Mesh*>(geometry));
+    } else others.push_back(geometry);
+}
+
+void mcrt::Primitives::clear() {
+    sphereOrigins.clear();
+    sphereRadii.clear();
+    sphereMaterials.clear();
+    triangleVertices.clear();
+    triangleEdges1.clear();
+    triangleEdges2.clear();
+    triangleMaterials.clear();
+    meshes.clear();
+    others.clear();
+}
+
+template<typename Accept>
+mcrt::Primitives::Hit mcrt::Primitives::closest(const Ray& ray, const Accept& accept) const {
+    Hit hit;
+    hit.distance = std::numeric_limits<double>::max();
+    closestShapes(ray, accept, hit);
+
+    // These already only return their closest hit, so there's only one of them each.
+    // Their hierarchies skip whatever is behind the closest hit so far.
+    for (std::size_t i = 0; i < meshes.size(); ++i) {
+        if (!accept(meshes[i]->getMaterial())) continue;
+        Ray::Hit meshHit = meshes[i]->Mesh::hit(ray, hit.distance);
+        if (meshHit.distance > 0.0 && meshHit.distance < hit.distance) {
+            hit.type = Hit::Type::MESH;
+            hit.index = i;
+            hit.distance = meshHit.distance;
+            hit.surface = meshHit;
+        }
+    }
+
+    closestOthers(ray, accept, hit);
+    return hit;
+}
+
+template<typename Accept>
+void mcrt::Primitives::closestShapes(const Ray& ray, const Accept& accept, Hit& hit) const {
+    const Vector3 origin { ray.origin }, direction { ray.direction };
+
+    for (std::size_t i = 0; i < sphereRadii.size(); ++i) {
+        double distance { intersectSphere(sphereOrigins[i], sphereRadii[i], origin, direction) };
+        if (distance > 0.0 && distance < hit.distance && accept(sphereMaterials[i])) {
+            hit.type = Hit::Type::SPHERE;
+            hit.index = i;
+            hit.distance = distance;
+        }
+    }
+
+    for (std::size_t i = 0; i < triangleMaterials.size(); ++i) {
+        double distance { intersectTriangle(triangleVertices[i], triangleEdges1[i], triangleEdges2[i],
+                                            origin, direction) };
+        if (distance > 0.0 && distance < hit.distance && accept(triangleMaterials[i])) {
+            hit.type = Hit::Type::TRIANGLE;
+            hit.index = i;
+            hit.distance = distance;
+        }
+    }
+}
+
+template<typename Accept>
+void mcrt::Primitives::closestOthers(const Ray& ray, const Accept& accept, Hit& hit) const {
+    for (std::size_t i = 0; i < others.size(); ++i) {
+        Ray::Hit otherHit = others[i]->hit(ray);
+        if (otherHit.distance > 0.0 && otherHit.distance < hit.distance && accept(others[i]->getMaterial())) {
+            hit.type = Hit::Type::OTHER;
+            hit.index = i;
+            hit.distance = otherHit.distance;
+            hit.surface = otherHit;
+        }
+    }
+}
+
+mcrt::Ray::Intersection mcrt::Primitives::intersect(const Ray& ray) const {
+    return interact(ray, closest(ray, [](const Material*) { return true; }));
+}
+
+void mcrt::Primitives::intersect(const Ray* rays, std::size_t count, Ray::Intersection* intersections) const {
+    auto all = [](const Material*) { return true; };
+    for (std::size_t first = 0; first < count; first += simd::Packet::SIZE) {
+        std::size_t size { std::min(count - first, simd::Packet::SIZE) };
+        Hit hits[simd::Packet::SIZE];
+        for (std::size_t r = 0; r < size; ++r) {
+            hits[r].distance = std::numeric_limits<double>::max();
+            closestShapes(rays[first + r], all, hits[r]);
+        }
+
+        // Same as in closest, but each mesh traces the whole packet at once.
+        for (std::size_t i = 0; i < meshes.size(); ++i) {
+            Ray::Hit meshHits[simd::Packet::SIZE];
+            for (std::size_t r = 0; r < size; ++r) meshHits[r].distance = hits[r].distance;
+            meshes[i]->Mesh::hit(rays + first, size, meshHits);
+            for (std::size_t r = 0; r < size; ++r) {
+                if (meshHits[r].distance >= hits[r].distance) continue;
+                hits[r].type = Hit::Type::MESH;
+                hits[r].index = i;
+                hits[r].distance = meshHits[r].distance;
+                hits[r].surface = meshHits[r];
+            }
+        }
+
+        for (std::size_t r = 0; r < size; ++r) {
+            closestOthers(rays[first + r], all, hits[r]);
+            intersections[first + r] = interact(rays[first + r], hits[r]);
+        }
+    }
+}
+
+mcrt::Ray::Intersection mcrt::Primitives::interact(const Ray& ray, const Hit& hit) const {
+    glm::dvec3 position { ray.origin + ray.direction * hit.distance };
+
+    switch (hit.type) {
+    case Hit::Type::SPHERE:
+        return { hit.distance, glm::normalize(position - glm::dvec3 { sphereOrigins[hit.index] }),
+                 sphereMaterials[hit.index], position };
+    case Hit::Type::TRIANGLE: {
+        glm::dvec3 normal { glm::normalize(glm::cross(glm::dvec3 { triangleEdges1[hit.index] },
+                                                      glm::dvec3 { triangleEdges2[hit.index] })) };
+        if (glm::dot(normal, ray.direction) > 0) normal = -normal;
+        return { hit.distance, normal, triangleMaterials[hit.index], position };
+    }
+    case Hit::Type::MESH:
+        return meshes[hit.index]->Mesh::interact(ray, hit.surface);
+    case Hit::Type::OTHER:
+        return others[hit.index]->interact(ray, hit.surface);
+    default:
+        return { hit.distance, glm::dvec3(0.0), nullptr, glm::dvec3(0.0) };
+    }
+}
+
+double mcrt::Primitives::occlusion(const Ray& ray) const {
+    return closest(ray, [](const Material* material) {
+        return material->type != Material::Type::Refractive;
+    }).distance;
+}
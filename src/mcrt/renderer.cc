@@ -0,0 +1,443 @@
+#include "mcrt/renderer.hh"
+#include "mcrt/cluster.hh"
+#include "mcrt/filter.hh"
+#include "mcrt/progress.hh"
+#include "mcrt/sampling.hh"
+#include "mcrt/restir.hh"
+#include "mcrt/metropolis.hh"
+#include "mcrt/bidirectional.hh"
+#include "mcrt/supersample.hh"
+#include "mcrt/image_export.hh"
+#include "mcrt/param_import.hh"
+#include "mcrt/scene_import.hh"
+
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+    // Camera rays are intersected in packets of 8x8 pixels, 4 of them in every tile.
+    constexpr std::size_t PACKET_SIZE { 8 };
+    constexpr std::size_t TILE_BLOCKS { mcrt::Film::TILE_SIZE / PACKET_SIZE };
+    constexpr std::size_t TILE_PIXELS { mcrt::Film::TILE_SIZE * mcrt::Film::TILE_SIZE };
+
+    // Where in the tile a camera ray was sampled.
+    struct PixelSample {
+        std::size_t x, y;
+        glm::dvec2 rasterPosition;
+    };
+
+    std::string readFile(const std::string& path) {
+        std::ifstream fileStream { path };
+        if (!fileStream) throw std::runtime_error { "Could not open '" + path + "'!" };
+        std::stringstream contents;
+        contents << fileStream.rdbuf();
+        return contents.str();
+    }
+}
+
+mcrt::Renderer::Renderer() : scene { new Scene } {
+    setParameters(parameters);
+}
+
+mcrt::Renderer::~Renderer() = default;
+
+void mcrt::Renderer::loadScene(const std::string& file) {
+    setScene(SceneImporter::parse(readFile(file), file));
+}
+
+void mcrt::Renderer::setScene(Scene&& newScene) {
+    reset(); // The tracers still point to the old one.
+    scene.reset(new Scene { std::move(newScene) });
+    prepared = false;
+}
+
+void mcrt::Renderer::loadParameters(const std::string& file) {
+    std::string json { readFile(file) };
+    setParameters(ParameterImporter::parse(json), json);
+}
+
+void mcrt::Renderer::setParameters(const Parameters& newParameters, const std::string& json) {
+    reset();
+    parameters = newParameters;
+    parameterFile = json;
+    seed = parameters.seed;
+    if (seed == 0) seed = sampling::randomSeed();
+}
+
+void mcrt::Renderer::setCluster(const Cluster& newCluster) {
+    reset();
+    cluster = &newCluster;
+}
+
+int mcrt::Renderer::getRanks() const {
+    bool openmpi { parameters.parallelFramework == Parameters::ParallelFramework::OPENMPI };
+    return (openmpi && cluster != nullptr) ? cluster->getSize() : 1;
+}
+
+void mcrt::Renderer::prepare() {
+    bool root { cluster == nullptr || cluster->isRoot() };
+    int ranks { getRanks() };
+
+    Scene::maxRayDepth = parameters.maxRayDepth;
+    Scene::photonEstimationRadius = parameters.photonEstimationRadius;
+    Scene::globalEstimationRadius = parameters.globalEstimationRadius;
+    AreaLight::shadowRayCount = parameters.shadowRayCount;
+
+    if (parameters.photonMap && root) { // Trade-off between speed and memory.
+        sampling::seed(seed, PREPASS_STREAM, 0);
+        scene->gatherPhotons(parameters.photonAmount); // Photon map.
+    }
+
+    if (parameters.globalPhotonMap && root) { // For the indirect light, terminates paths early.
+        sampling::seed(seed, PREPASS_STREAM, 1);
+        scene->gatherGlobalPhotons(parameters.globalPhotonAmount);
+    }
+
+    if (parameters.photonMapVisualize && root) // Write photon map to a CSV:
+        scene->dumpPhotonMap("photon-map.csv"); // See: photon-map.r.
+    if (ranks > 1) { // The other ranks get the photons from rank 0 instead.
+        std::vector<Photon> photons { scene->getPhotonMap().getPhotons() },
+                            globalPhotons { scene->getGlobalPhotonMap().getPhotons() };
+        if (parameters.photonMap) cluster->broadcast(photons);
+        if (parameters.globalPhotonMap) cluster->broadcast(globalPhotons);
+        if (parameters.photonMap && !root) scene->setPhotonMap(photons);
+        if (parameters.globalPhotonMap && !root) scene->setGlobalPhotonMap(globalPhotons);
+    }
+
+    if (parameters.irradianceCache) // Filled lazily by final gathers.
+        scene->enableIrradianceCache(parameters.irradianceCacheError,
+                                     parameters.finalGatherRays);
+    if (parameters.virtualLights) { // Preview quality GI, without any of the noise.
+        sampling::seed(seed, PREPASS_STREAM, 2); // Every rank traces the same ones.
+        scene->gatherVirtualLights(parameters.virtualLightPaths,
+                                   parameters.lightcutError);
+    }
+
+    prepared = true;
+}
+
+void mcrt::Renderer::setSeed(std::uint64_t newSeed) {
+    seed = newSeed;
+}
+
+void mcrt::Renderer::resume(const Checkpoint& checkpoint) {
+    start();
+    if (checkpoint.width != film->getWidth() || checkpoint.height != film->getHeight())
+        throw std::runtime_error { "Error: the checkpoint has another resolution!" };
+    film->unpack(checkpoint.film);
+    seed = checkpoint.seed;
+    nextPass = checkpoint.nextPass;
+}
+
+mcrt::Checkpoint mcrt::Renderer::checkpoint(std::size_t endPass) const {
+    if (!film) throw std::runtime_error { "Error: there's no film to checkpoint yet!" };
+    return { film->getWidth(), film->getHeight(), seed, nextPass,
+             endPass, parameterFile, film->pack() };
+}
+
+void mcrt::Renderer::reset() {
+    metropolisTracer.reset();
+    reservoirResampler.reset();
+    bidirectionalTracer.reset();
+    film.reset();
+    image.reset();
+    bootstrapped = false;
+    history.clear();
+}
+
+void mcrt::Renderer::nextFrame(const Camera& camera) {
+    // Only the path tracer has all of its radiance in the pixels it traces, and ReSTIR
+    // already carries its reservoirs over, which can't follow the camera around.
+    bool temporal { parameters.temporalSamples > 0 && parameters.temporalSamples < parameters.samplesPerPixel &&
+                    parameters.integrator == Parameters::Integrator::PATH && !parameters.restir };
+    if (!temporal || !film) { // Nothing to reuse, e.g in the first frame.
+        scene->getCamera() = camera;
+        reset();
+        return;
+    }
+
+    // Everything that's needed from the last frame, before its film goes away.
+    const Camera lastCamera { scene->getCamera() };
+    const glm::dvec3 lastEyePoint { lastCamera.getEyePosition() };
+    const std::vector<Surface> lastSurfaces { traceSurfaces() };
+    std::vector<Film::Pixel> lastPixels;
+    lastPixels.reserve(film->getWidth() * film->getHeight());
+    for (std::size_t y = 0; y < film->getHeight(); ++y)
+    for (std::size_t x = 0; x < film->getWidth();  ++x)
+        lastPixels.push_back(film->getPixel(x, y));
+
+    scene->getCamera() = camera;
+    reset();
+    start();
+
+    // The old samples are faded out by as much as the new passes add, so every frame is
+    // a moving average over the last few, instead of having them pile up for ever.
+    historyStride = parameters.samplesPerPixel / parameters.temporalSamples;
+    double fresh = (parameters.samplesPerPixel + historyStride - 1) / historyStride;
+    double fade { 1.0 - fresh / parameters.samplesPerPixel };
+
+    // With OpenMPI the other ranks only had a part of the last film, rank 0 has the sum.
+    bool root { cluster == nullptr || cluster->isRoot() };
+    const std::vector<Surface> surfaces { traceSurfaces() };
+    history.assign(surfaces.size(), false);
+    std::size_t reprojected { 0 };
+    for (std::size_t y = 0; y < film->getHeight(); ++y)
+    for (std::size_t x = 0; x < film->getWidth();  ++x) {
+        const Surface& surface { surfaces[y*film->getWidth() + x] };
+        glm::dvec2 raster;
+        if (!surface.valid || !lastCamera.getRasterPosition(*image, surface.position, raster)) continue;
+        std::size_t last = static_cast<std::size_t>(raster.y) * film->getWidth() + static_cast<std::size_t>(raster.x);
+
+        // Disoccluded if something else was in front of it then, or it's another side.
+        const Surface& lastSurface { lastSurfaces[last] };
+        double depth { glm::distance(lastEyePoint, surface.position) };
+        if (!lastSurface.valid || lastPixels[last].weight <= 0.0) continue;
+        if (glm::dot(surface.normal, lastSurface.normal) < 0.9) continue;
+        if (std::abs(depth - lastSurface.depth) > 0.02 * lastSurface.depth) continue;
+
+        if (root) film->add(x, y, { lastPixels[last].radiance * fade, lastPixels[last].weight * fade });
+        history[y*film->getWidth() + x] = true;
+        ++reprojected;
+    }
+
+    if (root) std::cout << "Reprojected: " << 100 * reprojected / surfaces.size()
+                        << "% of the pixels from the last frame." << std::endl;
+}
+
+std::vector<mcrt::Renderer::Surface> mcrt::Renderer::traceSurfaces() const {
+    bool openmp { parameters.parallelFramework != Parameters::ParallelFramework::NONE };
+    const Camera& camera { scene->getCamera() };
+    const glm::dvec3 eyePoint { camera.getEyePosition() };
+
+    std::vector<Surface> surfaces(image->getSize());
+    #pragma omp parallel for schedule(dynamic) if (openmp)
+    for (std::size_t y = 0; y < image->getHeight(); ++y)
+    for (std::size_t x = 0; x < image->getWidth();  ++x) {
+        glm::dvec3 viewPlanePoint { camera.getPixelCenter(*image, x, y) };
+        Ray ray { viewPlanePoint, glm::normalize(viewPlanePoint - eyePoint) };
+        // Only diffuse surfaces look the same from everywhere, the rest is traced again.
+        Ray::Intersection rayHit = scene->intersect(ray);
+        if (rayHit.material == nullptr || rayHit.material->type != Material::Type::Diffuse) continue;
+
+        Surface& surface { surfaces[y*image->getWidth() + x] };
+        surface.position = rayHit.position;
+        surface.normal = rayHit.normal;
+        surface.depth = glm::distance(eyePoint, rayHit.position);
+        surface.valid = true;
+    }
+
+    return surfaces;
+}
+
+// Everything that only has to be done once per film, before the first pass.
+void mcrt::Renderer::start() {
+    if (film) return;
+
+    // With OpenMPI every rank takes every ranks:th pass, and the films are summed later.
+    passStride = getRanks();
+    nextPass = cluster != nullptr ? cluster->getRank() : 0;
+
+    // Note that render background will be transparent.
+    image.reset(new Image { parameters.resolutionWidth, parameters.resolutionHeight });
+
+    // Combine settings from the scenes and trace parameters.
+    double fieldOfView { scene->getCamera().getFieldOfView() };
+    scene->getCamera().setAspectRatio(image->getAspectRatio());
+    scene->getCamera().setFieldOfView(fieldOfView);
+
+    // Threads trace whole tiles into their own buffers, and splat into their own layer.
+    std::size_t threads { 1 };
+#ifdef _OPENMP
+    if (parameters.parallelFramework != Parameters::ParallelFramework::NONE)
+        threads = omp_get_max_threads();
+#endif
+    const Filter filter { parameters.filterType, parameters.filterRadius };
+    std::size_t padding { filter.getPadding() }; // The Gaussian pattern lands outside the pixel too.
+    if (parameters.samplingPattern == Supersampler::Pattern::GAUSSIAN) padding = std::max<std::size_t>(padding, 2);
+    film.reset(new Film { image->getWidth(), image->getHeight(), threads, padding });
+
+    // Light tracing in BDPT lands in any pixel, so it's splatted into the film.
+    bidirectionalTracer.reset(new BidirectionalTracer { *scene, *image });
+    // Direct light at the first hits is found by reservoirs which are reused over passes.
+    reservoirResampler.reset(new ReservoirResampler { *scene, *image, parameters.restirCandidates,
+                                                      parameters.restirNeighbours, parameters.restirRadius });
+    // MLT doesn't go pixel by pixel, its chains wander all over the image instead.
+    metropolisTracer.reset(new MetropolisTracer { *scene, *image, parameters.metropolisChains,
+                                                  parameters.largeStepProbability });
+}
+
+std::size_t mcrt::Renderer::getPassesUntil(std::size_t endPass) const {
+    std::size_t stride = getRanks(), first = nextPass;
+    if (!film) first = cluster != nullptr ? cluster->getRank() : 0;
+    return (std::max(endPass, first) + stride - 1 - first) / stride;
+}
+
+void mcrt::Renderer::render(std::size_t passes, const Progress& progress) {
+    start();
+    if (!prepared) prepare();
+
+    // Scenes might've been prepared with other ones, e.g by the server.
+    Scene::maxRayDepth = parameters.maxRayDepth;
+    Scene::photonEstimationRadius = parameters.photonEstimationRadius;
+    Scene::globalEstimationRadius = parameters.globalEstimationRadius;
+    AreaLight::shadowRayCount = parameters.shadowRayCount;
+
+    bool root { cluster == nullptr || cluster->isRoot() };
+    // Every rank still uses all of the cores on its own node.
+    bool openmp  { parameters.parallelFramework != Parameters::ParallelFramework::NONE };
+    bool bidirectional { parameters.integrator == Parameters::Integrator::BIDIRECTIONAL };
+    bool restir { parameters.restir && parameters.integrator == Parameters::Integrator::PATH };
+    bool metropolis { parameters.integrator == Parameters::Integrator::METROPOLIS };
+
+    const Supersampler sampler { parameters.samplesPerPixel,  parameters.samplingPattern };
+    const Filter filter { parameters.filterType, parameters.filterRadius };
+    const Camera& sceneCamera { scene->getCamera() };
+    const glm::dvec3 eyePoint { sceneCamera.getEyePosition() };
+
+    std::size_t pixelSamplesTaken { 0 }; // Shared resource.
+    const std::size_t imagePixels { image->getSize() };
+    double totalPixelSamples = passes * imagePixels;
+
+    if (metropolis && !bootstrapped) { // Needs to know how bright the image is first.
+        printProgress("Bootstrapping: ", 0.0);
+        // New chains for every rank (and when resuming), they are independent anyway.
+        std::uint64_t chainSeed { sampling::streamSeed(seed, nextPass, PREPASS_STREAM) };
+        metropolisTracer->bootstrap(parameters.metropolisBootstrap, openmp, chainSeed);
+        printProgress("Bootstrapping: ", 1.0);
+        std::cout << std::endl;
+        bootstrapped = true;
+    }
+
+    for (std::size_t pass = 0; pass < passes; ++pass) {
+        std::size_t i { nextPass };
+
+        // ----------------------- Ray Trace -----------------------
+
+        if (metropolis) {
+            if (root) printProgress("Ray tracing: ", pixelSamplesTaken /
+                                                     totalPixelSamples);
+            // One pass has as many mutations as there are pixels.
+            metropolisTracer->render(imagePixels, *film, openmp);
+            pixelSamplesTaken += imagePixels;
+        } else {
+            #pragma omp parallel for schedule(dynamic) if (openmp)
+            for (std::size_t t = 0; t < film->getTileCount(); ++t) {
+
+                #pragma omp critical
+                if (root) printProgress("Ray tracing: ", pixelSamplesTaken /
+                                                         totalPixelSamples);
+
+                std::size_t thread { 0 };
+#ifdef _OPENMP
+                if (openmp) thread = omp_get_thread_num();
+#endif
+                sampling::seed(seed, i, t);
+                Film::Tile tile { film->getTile(t) };
+                Ray rays[TILE_PIXELS];
+                PixelSample pixels[TILE_PIXELS];
+                std::size_t samples { 0 };
+                for (std::size_t y = tile.getY(); y < tile.getY() + tile.getHeight(); ++y)
+                for (std::size_t x = tile.getX(); x < tile.getX() + tile.getWidth();  ++x) {
+
+                    // Reprojected pixels already have most of their radiance from the last frame.
+                    if (!history.empty() && i % historyStride != 0 &&
+                        history[y*image->getWidth() + x]) continue;
+
+                    // Below is the interval in the pixel where we can get further pp samples.
+                    auto samplingPlane = sceneCamera.getPixelSamplingPlane(*image, x, y);
+
+                    // Here we actually fetch the next sampling position to take.
+                    glm::dvec2 sampleOffset { sampler.offset(i) };
+                    glm::dvec3 viewPlanePoint { sampler.position(samplingPlane, sampleOffset) };
+                    // Find our where in the scene our eye's pixel sample is looking at...
+                    glm::dvec3 rayDirection { glm::normalize(viewPlanePoint - eyePoint) };
+                    rays[samples] = Ray { viewPlanePoint, rayDirection };
+                    pixels[samples++] = { x, y, { x + sampleOffset.x, y + sampleOffset.y } };
+                }
+
+                // The camera rays of a block of pixels go about the same way, so they're
+                // intersected together as a packet, and only traced on one at a time.
+                Ray::Intersection hits[TILE_PIXELS];
+                if (!bidirectional && !restir) {
+                    for (std::size_t block = 0; block < TILE_BLOCKS * TILE_BLOCKS; ++block) {
+                        Ray packet[PACKET_SIZE * PACKET_SIZE];
+                        Ray::Intersection packetHits[PACKET_SIZE * PACKET_SIZE];
+                        std::size_t indices[PACKET_SIZE * PACKET_SIZE], size { 0 };
+                        for (std::size_t s = 0; s < samples; ++s) {
+                            std::size_t blockX { (pixels[s].x - tile.getX()) / PACKET_SIZE },
+                                        blockY { (pixels[s].y - tile.getY()) / PACKET_SIZE };
+                            if (blockY * TILE_BLOCKS + blockX != block) continue;
+                            indices[size] = s;
+                            packet[size++] = rays[s];
+                        }
+
+                        scene->intersect(packet, size, packetHits);
+                        for (std::size_t k = 0; k < size; ++k) hits[indices[k]] = packetHits[k];
+                    }
+                }
+
+                for (std::size_t s = 0; s < samples; ++s) {
+                    // Finally, raytrace through the scene and get the pixel irradiance.
+                    glm::dvec3 colorPixelSample;
+                    if (bidirectional) {
+                        colorPixelSample = bidirectionalTracer->trace(rays[s], film->getSplats(thread));
+                    } else if (restir) {
+                        colorPixelSample = reservoirResampler->trace(pixels[s].x, pixels[s].y, rays[s]);
+                    } else colorPixelSample = scene->rayTrace(rays[s], hits[s], 0);
+                    // Since this is just one sample, it should only contribute a bit...
+                    tile.splat(pixels[s].rasterPosition, colorPixelSample, filter); // Averaged later.
+                }
+
+                film->merge(tile); // Only place where the threads meet.
+                #pragma omp atomic
+                pixelSamplesTaken += tile.getSize();
+
+            }
+        }
+
+        // Resample from the neighbours and shade the direct light.
+        if (restir) reservoirResampler->resolve(*film, openmp);
+        film->nextPass();
+        nextPass = i + passStride;
+        if (progress) progress(pass + 1, passes);
+
+        // ---------------------------------------------------------
+
+    }
+
+    if (root) {
+        printProgress("Ray tracing: ", 1.0); // Might not be 100% in output.
+        std::cout << std::endl; // Reset buffer after progress bar flush() hack.
+    }
+}
+
+void mcrt::Renderer::develop(Image& developed) {
+    getFilm().develop(developed);
+}
+
+void mcrt::Renderer::develop(float* buffer) {
+    getFilm().develop(buffer);
+}
+
+void mcrt::Renderer::save(const std::string& file) {
+    Image developed { getWidth(), getHeight() };
+    develop(developed); // Finally, averages out the color by the sampling we have done.
+
+    std::size_t scaledWidth  = parameters.resolutionWidth  * parameters.scalingFactorX,
+                scaledHeight = parameters.resolutionHeight * parameters.scalingFactorY;
+    developed.resize(scaledWidth, scaledHeight, parameters.interpolationMethod);
+    ImageExporter::save(developed, file);
+}
+
+mcrt::Film& mcrt::Renderer::getFilm() {
+    start();
+    return *film;
+}
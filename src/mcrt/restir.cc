@@ -0,0 +1,186 @@
+#include "mcrt/restir.hh"
+#include "mcrt/sampling.hh"
+
+#include <cmath>
+#include <algorithm>
+#include <glm/gtc/constants.hpp>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+void mcrt::ReservoirResampler::Reservoir::update(const AreaLight* candidate,
+                                                 const glm::dvec3& candidatePoint, double w) {
+    weightSum += w;
+    if (w > 0.0 && sampling::uniform() * weightSum < w) {
+        light = candidate;
+        point = candidatePoint;
+    }
+}
+
+mcrt::ReservoirResampler::ReservoirResampler(const Scene& scene, const Image& image, std::size_t candidates,
+                                             std::size_t neighbours, double radius)
+    : scene { scene }, image { image }, candidates { std::max<std::size_t>(candidates, 1) },
+      neighbours { neighbours }, radius { radius },
+      surfaces(image.getSize()), previousSurfaces(image.getSize()),
+      reservoirs(image.getSize()), previousReservoirs(image.getSize()) {
+    for (Light* light : scene.getLights()) {
+        const AreaLight* areaLight = dynamic_cast<const AreaLight*>(light);
+        if (areaLight == nullptr) {
+            otherLights.push_back(light);
+            continue;
+        }
+        // Roughly by their power, the resampling takes care of the rest.
+        lights.push_back(areaLight);
+        lightWeights.push_back(areaLight->area * areaLight->intensity);
+        totalLightWeight += lightWeights.back();
+    }
+}
+
+// Same as in AreaLight::radiance, but for one point and without the shadow ray.
+glm::dvec3 mcrt::ReservoirResampler::unshadowed(const Surface& surface, const AreaLight* light,
+                                                const glm::dvec3& point) const {
+    if (light == nullptr) return glm::dvec3 { 0.0 };
+    glm::dvec3 rayToLightNormal { glm::normalize(point - surface.position) };
+    double shadowRayDistance = std::max(glm::distance(surface.position, point), 1.0);
+
+    double cosa = glm::clamp(glm::dot(rayToLightNormal, surface.normal), 0.0, 1.0);
+    double cosb = std::max(0.0, glm::dot(-rayToLightNormal, light->normal));
+    glm::dvec3 brdf = surface.material->brdf(surface.position, surface.normal,
+                                             surface.outgoing, rayToLightNormal);
+    return light->material->color * light->intensity * brdf * cosa * cosb
+         / (shadowRayDistance * shadowRayDistance);
+}
+
+double mcrt::ReservoirResampler::targetPdf(const Surface& surface, const AreaLight* light,
+                                           const glm::dvec3& point) const {
+    glm::dvec3 radiance { unshadowed(surface, light, point) };
+    return 0.2126*radiance.r + 0.7152*radiance.g + 0.0722*radiance.b;
+}
+
+// Another reservoir (from elsewhere) is resampled as if it was a single candidate.
+void mcrt::ReservoirResampler::merge(Reservoir& reservoir, const Reservoir& other, const Surface& surface) const {
+    if (other.samples <= 0.0) return;
+    double target { targetPdf(surface, other.light, other.point) };
+    reservoir.update(other.light, other.point, target * other.weight * other.samples);
+    reservoir.samples += other.samples;
+}
+
+void mcrt::ReservoirResampler::finalize(Reservoir& reservoir, const Surface& surface) const {
+    double target { targetPdf(surface, reservoir.light, reservoir.point) };
+    if (target <= 0.0 || reservoir.samples <= 0.0) reservoir.weight = 0.0;
+    else reservoir.weight = reservoir.weightSum / (reservoir.samples * target);
+}
+
+// Only reuse the samples from surfaces which are mostly alike, else we get bias.
+bool mcrt::ReservoirResampler::similar(const Surface& a, const Surface& b) const {
+    if (!a.valid || !b.valid) return false;
+    if (glm::dot(a.normal, b.normal) < 0.9) return false;
+    return std::abs(a.depth - b.depth) <= 0.1 * std::max(a.depth, b.depth);
+}
+
+glm::dvec3 mcrt::ReservoirResampler::trace(std::size_t x, std::size_t y, const Ray& ray) {
+    std::size_t pixel { y * image.getWidth() + x };
+    Surface& surface { surfaces[pixel] };
+    surface.valid = false;
+
+    Ray::Intersection rayHit = scene.intersect(ray);
+    if (rayHit.material == nullptr || rayHit.material->type != Material::Type::Diffuse
+        || lights.empty() || totalLightWeight <= 0.0)
+        return scene.rayTrace(ray, 0); // Nothing for us to do here.
+
+    surface.valid = true;
+    surface.position = rayHit.position;
+    surface.normal = rayHit.normal;
+    if (glm::dot(surface.normal, ray.direction) > 0.0) surface.normal = -surface.normal;
+    surface.outgoing = -ray.direction;
+    surface.material = rayHit.material;
+    surface.depth = rayHit.distance;
+
+    // Resampled importance sampling of the candidates, by their unshadowed light.
+    Reservoir reservoir;
+    for (std::size_t i { 0 }; i < candidates; ++i) {
+        double target { sampling::uniform() * totalLightWeight };
+        std::size_t chosen { 0 };
+        while (chosen + 1 < lights.size() && target >= lightWeights[chosen])
+            target -= lightWeights[chosen++];
+
+        const AreaLight* light { lights[chosen] };
+        glm::dvec3 point { light->sample() };
+        double pdf { lightWeights[chosen] / totalLightWeight / light->area };
+        reservoir.update(light, point, targetPdf(surface, light, point) / pdf);
+    }
+
+    reservoir.samples = candidates;
+    finalize(reservoir, surface);
+
+    // The camera doesn't move, so the same pixel in the last pass is the history.
+    if (similar(surface, previousSurfaces[pixel])) {
+        Reservoir history { previousReservoirs[pixel] };
+        history.samples = std::min(history.samples, MAX_HISTORY * candidates);
+        Reservoir combined;
+        merge(combined, reservoir, surface);
+        merge(combined, history, surface);
+        finalize(combined, surface);
+        reservoir = combined;
+    }
+
+    reservoirs[pixel] = reservoir;
+
+    glm::dvec3 direct { 0.0 };
+    for (Light* light : otherLights)
+        direct += light->radiance(ray, rayHit, &scene);
+    return direct + scene.indirectRadiance(ray, rayHit, 0, 0, direct);
+}
+
+void mcrt::ReservoirResampler::resolve(Film& film, bool parallel) {
+    const long width = image.getWidth(), height = image.getHeight();
+    std::vector<Reservoir> resolved(reservoirs.size());
+
+    #pragma omp parallel for schedule(dynamic) if (parallel)
+    for (long y = 0; y < height; ++y) {
+        for (long x = 0; x < width; ++x) {
+            std::size_t pixel = y * width + x;
+            const Surface& surface { surfaces[pixel] };
+            if (!surface.valid) continue;
+
+            Reservoir reservoir;
+            merge(reservoir, reservoirs[pixel], surface);
+
+            for (std::size_t i { 0 }; i < neighbours; ++i) {
+                double distance { radius * std::sqrt(sampling::uniform()) },
+                       angle { 2.0 * glm::pi<double>() * sampling::uniform() };
+                long nx = x + std::lround(distance * std::cos(angle)),
+                     ny = y + std::lround(distance * std::sin(angle));
+                if (nx < 0 || ny < 0 || nx >= width || ny >= height) continue;
+
+                std::size_t neighbour = ny * width + nx;
+                if (neighbour == pixel || !similar(surface, surfaces[neighbour])) continue;
+                merge(reservoir, reservoirs[neighbour], surface);
+            }
+
+            finalize(reservoir, surface);
+
+            // The one shadow ray, which also tells the next pass if it was occluded.
+            glm::dvec3 radiance { unshadowed(surface, reservoir.light, reservoir.point) };
+            if (radiance != glm::dvec3 { 0.0 }) {
+                glm::dvec3 rayToLightSource { reservoir.point - surface.position };
+                glm::dvec3 rayToLightNormal { glm::normalize(rayToLightSource) };
+                Ray shadowRay { Ray::offset(surface.position, surface.normal, rayToLightNormal), rayToLightNormal };
+                if (scene.inShadow(shadowRay) < glm::length(rayToLightSource)) reservoir.weight = 0.0;
+            }
+
+            // Once per pixel and pass, so it's a splat which is averaged by the passes.
+            std::size_t thread { 0 };
+#ifdef _OPENMP
+            if (parallel) thread = omp_get_thread_num();
+#endif
+            film.getSplats(thread).add(x, y, radiance * reservoir.weight);
+
+            resolved[pixel] = reservoir;
+        }
+    }
+
+    previousReservoirs.swap(resolved);
+    previousSurfaces.swap(surfaces);
+}
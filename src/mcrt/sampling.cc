@@ -0,0 +1,58 @@
+#include "mcrt/sampling.hh"
+
+#include <cmath>
+#include <random>
+#include <glm/gtc/constants.hpp>
+
+namespace {
+    thread_local mcrt::sampling::Stream* stream { nullptr };
+    thread_local std::mt19937_64 generator { std::random_device {  }() };
+
+    // SplitMix64, so that nearby streams don't start off correlated.
+    std::uint64_t mix(std::uint64_t x) {
+        x += 0x9e3779b97f4a7c15ull;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+}
+
+void mcrt::sampling::seed(std::uint64_t seed, std::uint64_t pass, std::uint64_t tile) {
+    generator.seed(streamSeed(seed, pass, tile));
+}
+
+std::uint64_t mcrt::sampling::streamSeed(std::uint64_t seed, std::uint64_t pass, std::uint64_t tile) {
+    return mix(mix(mix(seed) ^ pass) ^ tile);
+}
+
+std::uint64_t mcrt::sampling::randomSeed() {
+    std::random_device device;
+    return (static_cast<std::uint64_t>(device()) << 32) | device();
+}
+
+void mcrt::sampling::setStream(Stream* replacement) {
+    stream = replacement;
+}
+
+double mcrt::sampling::uniform() {
+    if (stream != nullptr) return stream->next();
+    // Top 53 bits, so it's uniform in the doubles and can never be one.
+    return (generator() >> 11) / 9007199254740992.0;
+}
+
+void mcrt::sampling::tangentFrame(const glm::dvec3& normal, glm::dvec3& tangent, glm::dvec3& bitangent) {
+    // Pick the axis which is the least parallel to the normal to avoid degenerate crosses.
+    glm::dvec3 axis { std::abs(normal.x) > 0.9 ? glm::dvec3 { 0.0, 1.0, 0.0 } : glm::dvec3 { 1.0, 0.0, 0.0 } };
+    tangent   = glm::normalize(glm::cross(axis, normal));
+    bitangent = glm::cross(normal, tangent);
+}
+
+glm::dvec3 mcrt::sampling::cosineHemisphere(const glm::dvec3& normal, double u1, double u2) {
+    glm::dvec3 tangent, bitangent;
+    tangentFrame(normal, tangent, bitangent);
+    double phi { 2.0 * glm::pi<double>() * u1 };
+    double sinTheta { std::sqrt(u2) }, cosTheta { std::sqrt(std::max(0.0, 1.0 - u2)) };
+    return glm::normalize(tangent   * (std::cos(phi) * sinTheta) +
+                          bitangent * (std::sin(phi) * sinTheta) +
+                          normal    * cosTheta);
+}
@@ -12,56 +12,58 @@
 
 #include "mcrt/photon.hh"
 #include "mcrt/progress.hh"
+#include "mcrt/sampling.hh"
 
 namespace mcrt {
     Ray::Intersection Scene::intersect(const Ray& ray) const {
-        Ray::Intersection closestHit {
-            std::numeric_limits<double>::max(),
-            glm::dvec3(0.0),
-            nullptr,
-            glm::dvec3(0.0)
-        };
+        return intersectLights(ray, primitives.intersect(ray));
+    }
 
-        for (const Geometry* geometry : geometries) {
-            Ray::Intersection rayHit = geometry->intersect(ray);
-            if (rayHit.distance > 0.0 && rayHit.distance < closestHit.distance)
-                closestHit = rayHit;
-        }
+    void Scene::intersect(const Ray* rays, std::size_t count, Ray::Intersection* intersections) const {
+        primitives.intersect(rays, count, intersections);
+        for (std::size_t i = 0; i < count; ++i)
+            intersections[i] = intersectLights(rays[i], intersections[i]);
+    }
 
-        for (Light* lightSource : lights) {
-            Ray::Intersection lightHit = lightSource->intersect(ray);
-            if(lightHit.distance > 0.0 && lightHit.distance < closestHit.distance ){
-                closestHit = lightHit;
+    Ray::Intersection Scene::intersectLights(const Ray& ray, const Ray::Intersection& closestHit) const {
+        // Misses have the max distance, so the lights only have to be closer than that.
+        const Light* closestLight { nullptr };
+        Ray::Hit lightHit;
+        lightHit.distance = closestHit.distance;
+        for (const Light* lightSource : lights) {
+            Ray::Hit rayHit = lightSource->hit(ray);
+            if(rayHit.distance > 0.0 && rayHit.distance < lightHit.distance ){
+                closestLight = lightSource;
+                lightHit = rayHit;
             }
         }
+
+        if (closestLight != nullptr) return closestLight->interact(ray, lightHit);
         return closestHit;
     }
 
     double Scene::inShadow(const Ray& ray) const{
 
-        double distance = std::numeric_limits<double>::max();
+        // Return distance to occlusion, refractive surfaces let the light through.
+        return primitives.occlusion(ray);
+    }
 
-        for(const Geometry* geometry: geometries){
-            Ray::Intersection rayHit = geometry->intersect(ray);
+    bool Scene::visible(const glm::dvec3& from, const glm::dvec3& to) const {
+        glm::dvec3 direction { to - from };
+        double distance { glm::length(direction) };
+        if (distance <= 0.0) return true;
+        direction /= distance;
 
-            if(rayHit.distance <= 0.0) {
-                continue;
-            }
-
-            // Intersects Refractive surface
-            if(rayHit.material->type == Material::Type::Refractive){
-                continue;
-            }
-            distance = std::min(distance, rayHit.distance);
-        }
-
-        // Return distance to occlusion
-        return distance;
+        Ray ray { Ray::offset(from, direction), direction };
+        Ray::Intersection rayHit = intersect(ray);
+        // The end is usually on a surface too, which might be hit just before it.
+        return rayHit.material == nullptr || rayHit.distance >= distance * (1.0 - 1e-6) - Ray::getOffset(to);
     }
 
     // Will be our resource after this...
     void Scene::add(Geometry* geometry) {
         geometries.push_back(geometry);
+        primitives.add(geometry);
     }
 
     void Scene::add(Material* material) {
@@ -74,19 +76,21 @@ namespace mcrt {
 
     size_t Scene::maxRayDepth = 10;
     double Scene::photonEstimationRadius = 0.5;
+    double Scene::globalEstimationRadius = 0.5;
 
     void Scene::getPhotons(const Ray& ray, const glm::dvec3& partialFlux){
 
-        std::vector<Ray::Intersection> intersections;
+        // Only the distances are needed, to put a photon at each one of the hits.
+        std::vector<Ray::Hit> intersections;
 
         for (const Geometry* geometry : geometries) {
-            Ray::Intersection rayHit = geometry->intersect(ray);
+            Ray::Hit rayHit = geometry->hit(ray);
             if (rayHit.distance > 0.0 )
               intersections.push_back(rayHit);
         }
 
         std::sort(intersections.begin(), intersections.end(), []
-            (const Ray::Intersection& i1, const Ray::Intersection& i2) -> bool
+            (const Ray::Hit& i1, const Ray::Hit& i2) -> bool
             {
                 return i1.distance < i2.distance;
             });
@@ -143,6 +147,7 @@ namespace mcrt {
     }
 
     void Scene::gatherPhotons(std::size_t photonAmount) {
+        gatheredPhotons = photonAmount;
         currentPhoton = 0;
 
         double cachedProgress = 0.0;
@@ -159,7 +164,7 @@ namespace mcrt {
             AreaLight* al = dynamic_cast<AreaLight*>(l);
             const double ratio = al->area / totalLightArea;
             const unsigned numPhotons = ratio * photonAmount;
-            const glm::dvec3 totalFlux = glm::pi<double>() * al->area * al->material->color;
+            const glm::dvec3 totalFlux = glm::pi<double>() * al->area * al->material->color * al->intensity;
             const glm::dvec3 partialFlux = totalFlux / (double)numPhotons;
 
             // Create photons for this area light
@@ -188,60 +193,192 @@ namespace mcrt {
         photonMap.rebalance();
     }
 
+    // Unlike photonTrace, this keeps bouncing off diffuse surfaces too, storing a
+    // photon at each one of them, until Russian roulette decides it's absorbed.
+    void Scene::globalPhotonTrace(const Ray& ray, const glm::dvec3& flux, const size_t depth,
+                                  const PhotonHit& store) const {
+        if (depth >= Scene::maxRayDepth)
+            return;
+
+        Ray::Intersection rayHit = intersect(ray);
+        if (rayHit.material == nullptr) return;
+        glm::dvec3 rayHitPosition { ray.origin + ray.direction * rayHit.distance };
+
+        if (rayHit.material->type == Material::Type::Diffuse) {
+            store(ray, rayHit, flux);
+
+            // Survival probability by the albedo, so surviving photons keep their power.
+            const glm::dvec3& albedo { rayHit.material->color };
+            double survival { std::max(albedo.r, std::max(albedo.g, albedo.b)) };
+            if (sampling::uniform() >= survival) return;
+
+            glm::dvec3 normal { rayHit.normal };
+            if (glm::dot(normal, ray.direction) > 0.0) normal = -normal;
+            glm::dvec3 bounceDirection { sampling::cosineHemisphere(normal, sampling::uniform(),
+                                                                            sampling::uniform()) };
+            Ray bounceRay { Ray::offset(rayHitPosition, normal, bounceDirection), bounceDirection };
+            globalPhotonTrace(bounceRay, flux * albedo / survival, depth + 1, store);
+        } else if (rayHit.material->type == Material::Type::Reflective) {
+            Ray reflectionRay { ray.reflect(rayHitPosition, rayHit.normal) };
+            globalPhotonTrace(reflectionRay, flux, depth + 1, store);
+        } else if (rayHit.material->type == Material::Type::Refractive) {
+            double kr = ray.fresnel(rayHit.normal, rayHit.material->refractionIndex);
+            bool outside = glm::dot(ray.direction, rayHit.normal) < 0.0;
+
+            // Pick either one of the paths instead of splitting photons.
+            if (kr < 1.0 && sampling::uniform() >= kr) {
+                Ray refractionRay { ray.refract(rayHitPosition, rayHit.normal,
+                                                rayHit.material->refractionIndex) };
+                globalPhotonTrace(refractionRay, flux, depth + 1, store);
+                return;
+            }
+
+            Ray reflectionRay;
+            if (outside) reflectionRay = ray.reflect(rayHitPosition, rayHit.normal);
+            else reflectionRay = ray.insideReflect(rayHitPosition, rayHit.normal);
+            globalPhotonTrace(reflectionRay, flux, depth + 1, store);
+        }
+    }
+
+    void Scene::gatherGlobalPhotons(std::size_t photonAmount) {
+        gatheredGlobalPhotons = photonAmount;
+        double cachedProgress = 0.0;
+        double totalLightArea = 0.0;
+        std::size_t totalPhotons = 0;
+
+        for (Light* l : lights) {
+            if (AreaLight* al = dynamic_cast<AreaLight*>(l))
+                totalLightArea += al->area;
+        }
+
+        std::vector<Photon> globalPhotons;
+        globalPhotons.reserve(photonAmount);
+
+        for (Light* l : lights) {
+            AreaLight* al = dynamic_cast<AreaLight*>(l);
+            if (al == nullptr) continue;
+
+            const double ratio = al->area / totalLightArea;
+            const std::size_t numPhotons = ratio * photonAmount;
+            const glm::dvec3 totalFlux = glm::pi<double>() * al->area * al->material->color * al->intensity;
+            const std::size_t firstPhoton = globalPhotons.size();
+
+            // Keep emitting until enough photons have been stored, then scale them
+            // down by the emitted count so paths which left the scene still count.
+            std::size_t emitted = 0;
+            while (globalPhotons.size() - firstPhoton < numPhotons) {
+                Ray path { al->sample(), al->sampleHemisphere() };
+                globalPhotonTrace(path, totalFlux, 0, [&globalPhotons](const Ray& ray, const Ray::Intersection& rayHit,
+                                                                       const glm::dvec3& flux) {
+                    glm::dvec3 rayHitPosition { ray.origin + ray.direction * rayHit.distance };
+                    globalPhotons.push_back({ rayHitPosition, ray.direction, flux, false });
+                });
+                ++emitted;
+
+                double progress = (totalPhotons + globalPhotons.size() - firstPhoton) / (double) photonAmount;
+                if (progress - cachedProgress >= 0.01) {
+                    cachedProgress = progress;
+                    printProgress("Global maps: ", std::min(progress, 1.0));
+                }
+
+                // Nothing stored after a lot of tries? Then it's probably hopeless.
+                if (globalPhotons.size() == firstPhoton && emitted > numPhotons) break;
+            }
+
+            for (std::size_t i { firstPhoton }; i < globalPhotons.size(); ++i)
+                globalPhotons[i].color /= static_cast<double>(emitted);
+            totalPhotons += globalPhotons.size() - firstPhoton;
+        }
+
+        printProgress("Global maps: ", 1.0);
+        std::cout << std::endl;
+
+        globalPhotonMap = PhotonMap { globalPhotons };
+        globalPhotonMapEnabled = !globalPhotons.empty();
+    }
+
+    void Scene::setPhotonMap(const std::vector<Photon>& photons) {
+        photonMap = PhotonMap { photons };
+        photonMapEnabled = true;
+    }
+
+    void Scene::setGlobalPhotonMap(const std::vector<Photon>& photons) {
+        globalPhotonMap = PhotonMap { photons };
+        globalPhotonMapEnabled = !photons.empty();
+    }
+
+    void Scene::gatherVirtualLights(std::size_t lightPaths, double error) {
+        gatheredLightPaths = lightPaths;
+        lightcutError = error;
+        double totalLightPower = 0.0;
+        for (Light* l : lights) {
+            if (AreaLight* al = dynamic_cast<AreaLight*>(l))
+                totalLightPower += al->area * al->intensity;
+        }
+
+        std::vector<VirtualLight> virtualLights;
+        for (Light* l : lights) {
+            AreaLight* al = dynamic_cast<AreaLight*>(l);
+            if (al == nullptr || totalLightPower <= 0.0) continue;
+
+            const std::size_t numPaths = std::max(1.0, al->area * al->intensity / totalLightPower * lightPaths);
+            const glm::dvec3 totalFlux = glm::pi<double>() * al->area * al->material->color * al->intensity;
+            const glm::dvec3 partialFlux = totalFlux / static_cast<double>(numPaths);
+
+            // Same paths as the global photons, but we keep the whole surface point.
+            for (std::size_t i = 0; i < numPaths; ++i) {
+                Ray path { al->sample(), al->sampleHemisphere() };
+                globalPhotonTrace(path, partialFlux, 0, [&virtualLights](const Ray& ray, const Ray::Intersection& rayHit,
+                                                                         const glm::dvec3& flux) {
+                    glm::dvec3 normal { rayHit.normal };
+                    if (glm::dot(normal, ray.direction) > 0.0) normal = -normal;
+                    virtualLights.push_back({ ray.origin + ray.direction * rayHit.distance,
+                                              normal, ray.direction, flux, rayHit.material });
+                });
+            }
+        }
+
+        lightTree = LightTree { virtualLights, error };
+    }
+
     void mcrt::Scene::dumpPhotonMap(const std::string& filePath) const {
         std::ofstream fileStream { filePath };
         fileStream << photonMap;
     }
 
-    glm::dvec3 Scene::rayTrace(const Ray& ray, const size_t depth = 0) const {
-        glm::dvec3 rayColor { 0.0 };
-
+    glm::dvec3 Scene::rayTrace(const Ray& ray, const size_t depth, const size_t diffuseDepth) const {
         // Make sure we don't bounce forever
+        if(depth >= Scene::maxRayDepth)
+            return glm::dvec3 { 0.0 };
+
+        return rayTrace(ray, intersect(ray), depth, diffuseDepth);
+    }
+
+    glm::dvec3 Scene::rayTrace(const Ray& ray, const Ray::Intersection& rayHit,
+                               const size_t depth, const size_t diffuseDepth) const {
+        glm::dvec3 rayColor { 0.0 };
         if(depth >= Scene::maxRayDepth)
             return rayColor;
 
-        Ray::Intersection rayHit = intersect(ray);
         glm::dvec3 rayHitPosition { ray.origin + ray.direction * rayHit.distance };
 
         // We have hit nothing or something like that I guess.....
         if (rayHit.material == nullptr) return glm::dvec3 { 0.0 };
 
         if(rayHit.material->type == Material::Type::Diffuse) {
-            glm::dvec3 reflectionDir = rayHit.sampleHemisphere(ray);
-            if (glm::length(reflectionDir) > 0.0) {
-                Ray reflectionRay { rayHit.position + reflectionDir*Ray::EPSILON, reflectionDir };
-                glm::dvec3 brdf = rayHit.material->brdf(rayHit.position, rayHit.normal, reflectionDir, -ray.direction);
-                rayColor += rayTrace(reflectionRay, depth + 1) * brdf * glm::pi<double>() / rayHit.material->reflectionRate;
-            }
+            // After the first diffuse bounce the global photon map is good enough.
+            if (diffuseDepth > 0 && hasGlobalPhotonMap() &&
+                estimateGlobalRadiance(ray, rayHit, rayColor))
+                return rayColor;
 
-            glm::dvec3 color { 0 };
-            const std::vector<const Photon*> photons = [this, &rayHit]() {
-                if (hasPhotonMap()) return photonMap.around(rayHit.position,
-                                                    photonEstimationRadius);
-                else return std::vector<const Photon*> {  };
-            }();
-
-            // Use photon map to estimate radiance from direct lighting
-            if (radianceEstimationPossible(photons)) {
-                for (const Photon* photon : photons) {
-                    double distance = glm::distance(rayHit.position, photon->position);
-                    double w = std::max(0.0, 1.0 - distance/photonEstimationRadius);
-                    glm::dvec3 brdf = rayHit.material->brdf(rayHit.position, rayHit.normal, -photon->incoming, -ray.direction);
-                    color += w * brdf * photon->color;
-                }
-                rayColor += color / ((1 - 2/3) * glm::pi<double>() * (photonEstimationRadius*photonEstimationRadius));
-            }
-            // Photon mapping conditions not met, use MC raytracing instead
-            else {
-                for (Light* lightSource : lights) {
-                    rayColor += lightSource->radiance(ray, rayHit, this);
-                }
-            }
+            glm::dvec3 direct { directRadiance(ray, rayHit) };
+            rayColor += indirectRadiance(ray, rayHit, depth, diffuseDepth, direct);
+            rayColor += direct;
 
         } else if(rayHit.material->type == Material::Type::Reflective) {
 
             Ray reflectionRay { ray.reflect(rayHitPosition, rayHit.normal) };
-            rayColor += rayTrace(reflectionRay, depth + 1) * 0.9; // Falloff.
+            rayColor += rayTrace(reflectionRay, depth + 1, diffuseDepth) * 0.9; // Falloff.
 
         } else if(rayHit.material->type == Material::Type::Refractive) {
 
@@ -253,22 +390,51 @@ namespace mcrt {
             if(kr < 1.0) { // Check if ray isn't completely parallel to graze.
                 Ray refractionRay { ray.refract(rayHitPosition, rayHit.normal,
                                                 rayHit.material->refractionIndex) };
-                refractionColor = rayTrace(refractionRay,depth + 1);
+                refractionColor = rayTrace(refractionRay, depth + 1, diffuseDepth);
             }
 
             Ray reflectionRay; // If we need to invert the bias if we are inside.
             if (outside) reflectionRay = ray.reflect(rayHitPosition, rayHit.normal);
             else reflectionRay = ray.insideReflect(rayHitPosition, rayHit.normal);
-            glm::dvec3 reflectionColor = rayTrace(reflectionRay, depth + 1);
+            glm::dvec3 reflectionColor = rayTrace(reflectionRay, depth + 1, diffuseDepth);
             rayColor += reflectionColor * kr + refractionColor * (1.0 - kr);
 
         } else if(rayHit.material->type == Material::Type::LightSource) {
+            // Same emitted radiance as in the direct light, i.e scaled by the intensity.
             rayColor = rayHit.material->color;
+            for (const Light* light : lights)
+                if (light->material == rayHit.material) rayColor *= light->intensity;
         }
 
         return rayColor;
     }
 
+    glm::dvec3 Scene::indirectRadiance(const Ray& ray, const Ray::Intersection& rayHit, const size_t depth,
+                                       const size_t diffuseDepth, const glm::dvec3& direct) const {
+        glm::dvec3 rayColor { 0.0 };
+        if (irradianceCache.isEnabled()) {
+            // Indirect light is interpolated from nearby final gathers instead.
+            glm::dvec3 brdf = rayHit.material->brdf(rayHit.position, rayHit.normal, rayHit.normal, -ray.direction);
+            rayColor += brdf * indirectIrradiance(rayHit);
+        } else if (lightTree.isEnabled()) {
+            // The virtual lights stand for all of the diffuse indirect light here,
+            // and the direct light also counts for how accurate the cut must be.
+            rayColor += lightTree.radiance(ray, rayHit, *this, direct);
+        } else {
+            glm::dvec3 reflectionDir = rayHit.sampleHemisphere(ray);
+            if (glm::length(reflectionDir) > 0.0) {
+                Ray reflectionRay { Ray::offset(rayHit.position, rayHit.normal, reflectionDir), reflectionDir };
+                glm::dvec3 brdf = rayHit.material->brdf(rayHit.position, rayHit.normal, reflectionDir, -ray.direction);
+                // Lights hit right away are already in the direct light, so they'd count twice.
+                Ray::Intersection bounceHit = intersect(reflectionRay);
+                if (bounceHit.material == nullptr || bounceHit.material->type != Material::Type::LightSource)
+                    rayColor += rayTrace(reflectionRay, bounceHit, depth + 1, diffuseDepth + 1) * brdf
+                              * glm::pi<double>() / rayHit.material->reflectionRate;
+            }
+        }
+        return rayColor;
+    }
+
     bool Scene::radianceEstimationPossible(const std::vector<const Photon*>& photons) const {
         if (!hasPhotonMap()) return false;
         if (photons.size() < 10) return false;
@@ -276,4 +442,286 @@ namespace mcrt {
 
         return true;
     }
+
+    bool Scene::estimateRadiance(const Ray& ray, const Ray::Intersection& rayHit, glm::dvec3& radiance) const {
+        const std::vector<const Photon*> photons = [this, &rayHit]() {
+            if (hasPhotonMap()) return photonMap.around(rayHit.position,
+                                                photonEstimationRadius);
+            else return std::vector<const Photon*> {  };
+        }();
+
+        if (!radianceEstimationPossible(photons)) return false;
+
+        glm::dvec3 color { 0 };
+        for (const Photon* photon : photons) {
+            double distance = glm::distance(rayHit.position, photon->position);
+            double w = std::max(0.0, 1.0 - distance/photonEstimationRadius);
+            glm::dvec3 brdf = rayHit.material->brdf(rayHit.position, rayHit.normal, -photon->incoming, -ray.direction);
+            color += w * brdf * photon->color;
+        }
+
+        radiance = color / ((1 - 2/3) * glm::pi<double>() * (photonEstimationRadius*photonEstimationRadius));
+        return true;
+    }
+
+    // Full radiance leaving the surface, i.e both the direct and the indirect light,
+    // by a cone-filtered density estimate (with k = 1) over the global photon map.
+    bool Scene::estimateGlobalRadiance(const Ray& ray, const Ray::Intersection& rayHit, glm::dvec3& radiance) const {
+        if (!hasGlobalPhotonMap()) return false;
+        const std::vector<const Photon*> photons = globalPhotonMap.around(rayHit.position,
+                                                                          globalEstimationRadius);
+        if (photons.size() < 8) return false;
+
+        glm::dvec3 color { 0.0 };
+        for (const Photon* photon : photons) {
+            // Photons arriving from behind the surface don't belong to it.
+            if (glm::dot(photon->incoming, rayHit.normal) * glm::dot(ray.direction, rayHit.normal) < 0.0)
+                continue;
+            double distance = glm::distance(rayHit.position, photon->position);
+            double w = std::max(0.0, 1.0 - distance/globalEstimationRadius);
+            glm::dvec3 brdf = rayHit.material->brdf(rayHit.position, rayHit.normal, -photon->incoming, -ray.direction);
+            color += w * brdf * photon->color;
+        }
+
+        double coneNormalization { 1.0 - 2.0/3.0 };
+        radiance = color / (coneNormalization * glm::pi<double>() * globalEstimationRadius * globalEstimationRadius);
+        return true;
+    }
+
+    glm::dvec3 Scene::directRadiance(const Ray& ray, const Ray::Intersection& rayHit) const {
+        glm::dvec3 radiance { 0.0 };
+        // Use photon map to estimate radiance from direct lighting
+        if (estimateRadiance(ray, rayHit, radiance)) return radiance;
+        // Photon mapping conditions not met, use MC raytracing instead
+        for (Light* lightSource : lights)
+            radiance += lightSource->radiance(ray, rayHit, this);
+        return radiance;
+    }
+
+    void Scene::enableIrradianceCache(double error, std::size_t gatherRays) {
+        // The gathers end at the first diffuse hit, so only one bounce is left without it.
+        if (!irradianceCache.isEnabled() && !globalPhotonMapEnabled)
+            std::cerr << "Warning: the irradiance cache without a global photon map only has "
+                         "one bounce of indirect light!" << std::endl;
+
+        // The octree should at least cover the lights and the camera.
+        glm::dvec3 minimum { camera.getEyePosition() },
+                   maximum { camera.getEyePosition() };
+        auto extend = [&minimum, &maximum](const glm::dvec3& point) {
+            minimum = glm::min(minimum, point);
+            maximum = glm::max(maximum, point);
+        };
+
+        for (const Light* light : lights) {
+            if (const AreaLight* areaLight = dynamic_cast<const AreaLight*>(light)) {
+                extend(areaLight->v0);
+                extend(areaLight->v1);
+                extend(areaLight->v2);
+            } else if (const PointLight* pointLight = dynamic_cast<const PointLight*>(light)) {
+                extend(pointLight->origin);
+            }
+        }
+
+        // Anything outside of it just ends up in the root.
+        glm::dvec3 extent { maximum - minimum };
+        double halfSize { std::max(extent.x, std::max(extent.y, extent.z)) };
+        if (halfSize <= 0.0) halfSize = 1.0;
+
+        irradianceCache = IrradianceCache { (minimum + maximum) / 2.0, halfSize, error };
+        finalGatherRays = gatherRays;
+        irradianceCacheError = error;
+    }
+
+    glm::dvec3 Scene::indirectIrradiance(const Ray::Intersection& rayHit) const {
+        glm::dvec3 irradiance;
+        if (irradianceCache.interpolate(rayHit.position, rayHit.normal, irradiance))
+            return irradiance;
+        // Nothing valid nearby, so we'll need to pay for a new record.
+        IrradianceCache::Record record { finalGather(rayHit) };
+        irradianceCache.insert(record);
+        return record.irradiance;
+    }
+
+    // Stratified gather over the hemisphere, with the gradients by Ward & Heckbert.
+    IrradianceCache::Record Scene::finalGather(const Ray::Intersection& rayHit) const {
+        const double pi { glm::pi<double>() };
+        const std::size_t M = std::max(2.0, std::round(std::sqrt(finalGatherRays / pi))),
+                          N = std::max(3.0, std::round(pi * M));
+
+        glm::dvec3 tangent, bitangent;
+        sampling::tangentFrame(rayHit.normal, tangent, bitangent);
+
+        std::vector<glm::dvec3> radiance(M * N);
+        std::vector<double> distance(M * N), sinTheta(M * N), tanTheta(M * N);
+
+        double inverseDistances { 0.0 };
+        glm::dvec3 irradiance { 0.0 };
+
+        for (std::size_t j { 0 }; j < M; ++j) {
+            for (std::size_t k { 0 }; k < N; ++k) {
+                std::size_t i { j * N + k };
+                double theta { std::asin(std::sqrt((j + sampling::uniform()) / M)) };
+                double phi { 2.0 * pi * (k + sampling::uniform()) / N };
+
+                glm::dvec3 direction { tangent   * (std::cos(phi) * std::sin(theta)) +
+                                       bitangent * (std::sin(phi) * std::sin(theta)) +
+                                       rayHit.normal * std::cos(theta) };
+                Ray gatherRay { Ray::offset(rayHit.position, rayHit.normal, direction), direction };
+                Ray::Intersection gatherHit = intersect(gatherRay);
+
+                radiance[i] = gatherRadiance(gatherRay, gatherHit, 0);
+                distance[i] = gatherHit.material != nullptr ? gatherHit.distance
+                                                            : std::numeric_limits<double>::max();
+                sinTheta[i] = std::sin(theta);
+                tanTheta[i] = std::tan(theta);
+
+                irradiance += radiance[i];
+                inverseDistances += 1.0 / distance[i];
+            }
+        }
+
+        IrradianceCache::Record record;
+        record.position = rayHit.position;
+        record.normal = rayHit.normal;
+        record.irradiance = irradiance * pi / static_cast<double>(M * N);
+
+        // Harmonic mean distance, but don't let it collapse or blow up too much.
+        double halfSize { irradianceCache.getHalfSize() };
+        double harmonicDistance { inverseDistances > 0.0 ? (M * N) / inverseDistances : halfSize };
+        record.harmonicDistance = glm::clamp(harmonicDistance, 1e-3 * halfSize, 0.1 * halfSize);
+
+        for (int c { 0 }; c < 3; ++c) {
+            record.rotationalGradient[c] = glm::dvec3 { 0.0 };
+            record.translationalGradient[c] = glm::dvec3 { 0.0 };
+        }
+
+        for (std::size_t k { 0 }; k < N; ++k) {
+            // The radial changes are along the centre of the cells, and the azimuthal
+            // ones across the edge they share with the previous cell, i.e at phiMinus.
+            double phi { 2.0 * pi * (k + 0.5) / N };
+            double phiMinus { 2.0 * pi * k / N };
+            glm::dvec3 rotationAxis { -std::sin(phi) * tangent + std::cos(phi) * bitangent };
+            glm::dvec3 u { std::cos(phi) * tangent + std::sin(phi) * bitangent };
+            glm::dvec3 v { -std::sin(phiMinus) * tangent + std::cos(phiMinus) * bitangent };
+
+            glm::dvec3 rotational { 0.0 }, radialChange { 0.0 }, azimuthalChange { 0.0 };
+            for (std::size_t j { 0 }; j < M; ++j) {
+                std::size_t i { j * N + k }, previousK { j * N + (k + N - 1) % N };
+                rotational -= tanTheta[i] * radiance[i];
+
+                double cosThetaMinus { std::sqrt(1.0 - j / static_cast<double>(M)) },
+                       cosThetaPlus  { std::sqrt(1.0 - (j + 1) / static_cast<double>(M)) };
+                azimuthalChange += (cosThetaMinus - cosThetaPlus)
+                                 / (sinTheta[i] * std::min(distance[i], distance[previousK]))
+                                 * (radiance[i] - radiance[previousK]);
+
+                if (j == 0) continue;
+                std::size_t previousJ { (j - 1) * N + k };
+                double sinThetaMinus { std::sqrt(j / static_cast<double>(M)) };
+                radialChange += sinThetaMinus * cosThetaMinus * cosThetaMinus
+                              / std::min(distance[i], distance[previousJ])
+                              * (radiance[i] - radiance[previousJ]);
+            }
+
+            for (int c { 0 }; c < 3; ++c) {
+                record.rotationalGradient[c] += rotationAxis * rotational[c];
+                record.translationalGradient[c] += u * (2.0 * pi / N) * radialChange[c]
+                                                 + v * azimuthalChange[c];
+            }
+        }
+
+        for (int c { 0 }; c < 3; ++c)
+            record.rotationalGradient[c] *= pi / static_cast<double>(M * N);
+
+        return record;
+    }
+
+    // Radiance leaving a gather ray's hit. Direct light is already accounted for at
+    // the shading point, so emitters don't count, and diffuse surfaces terminate it
+    // with the global photon map estimate (or just their direct light if it's off).
+    glm::dvec3 Scene::gatherRadiance(const Ray& ray, const Ray::Intersection& rayHit, const size_t depth) const {
+        if (depth >= Scene::maxRayDepth || rayHit.material == nullptr)
+            return glm::dvec3 { 0.0 };
+
+        glm::dvec3 rayHitPosition { ray.origin + ray.direction * rayHit.distance };
+
+        if (rayHit.material->type == Material::Type::Diffuse) {
+            glm::dvec3 radiance;
+            if (estimateGlobalRadiance(ray, rayHit, radiance))
+                return radiance;
+            return directRadiance(ray, rayHit);
+        } else if (rayHit.material->type == Material::Type::Reflective) {
+            Ray reflectionRay { ray.reflect(rayHitPosition, rayHit.normal) };
+            return gatherRadiance(reflectionRay, intersect(reflectionRay), depth + 1) * 0.9;
+        } else if (rayHit.material->type == Material::Type::Refractive) {
+            double kr = ray.fresnel(rayHit.normal, rayHit.material->refractionIndex);
+            bool outside = glm::dot(ray.direction, rayHit.normal) < 0.0;
+            glm::dvec3 refractionColor { 0.0 };
+
+            if (kr < 1.0) {
+                Ray refractionRay { ray.refract(rayHitPosition, rayHit.normal,
+                                                rayHit.material->refractionIndex) };
+                refractionColor = gatherRadiance(refractionRay, intersect(refractionRay), depth + 1);
+            }
+
+            Ray reflectionRay;
+            if (outside) reflectionRay = ray.reflect(rayHitPosition, rayHit.normal);
+            else reflectionRay = ray.insideReflect(rayHitPosition, rayHit.normal);
+            glm::dvec3 reflectionColor = gatherRadiance(reflectionRay, intersect(reflectionRay), depth + 1);
+            return reflectionColor * kr + refractionColor * (1.0 - kr);
+        }
+
+        return glm::dvec3 { 0.0 };
+    }
+
+    Scene::Invalidation Scene::invalidate(Invalidation level) {
+        invalidation = std::max(invalidation, level);
+        return level;
+    }
+
+    Scene::Invalidation Scene::editCamera(const std::function<void(Camera&)>& edit, Invalidation level) {
+        edit(camera);
+        return invalidate(level);
+    }
+
+    Scene::Invalidation Scene::editMaterial(std::size_t material, const std::function<void(Material&)>& edit,
+                                            Invalidation level) {
+        edit(*materials.at(material));
+        return invalidate(level);
+    }
+
+    Scene::Invalidation Scene::editLight(std::size_t light, const std::function<void(Light&)>& edit,
+                                         Invalidation level) {
+        edit(*lights.at(light));
+        return invalidate(level);
+    }
+
+    Scene::Invalidation Scene::editGeometry(std::size_t geometry, const std::function<void(Geometry&)>& edit,
+                                            Invalidation level) {
+        edit(*geometries.at(geometry));
+        return invalidate(level);
+    }
+
+    Scene::Invalidation Scene::update() {
+        Invalidation updated { invalidation };
+        invalidation = Invalidation::NOTHING;
+
+        // Only a few cheap ones, and an edit could have moved them with any invalidation.
+        for (Light* light : lights) light->refit();
+
+        if (updated >= Invalidation::GEOMETRY) {
+            for (Geometry* geometry : geometries) geometry->refit();
+            primitives.build(geometries); // Spheres and triangles are copies.
+        }
+
+        // Gathered again with the same settings, if they were enabled at all.
+        if (updated >= Invalidation::PHOTON_MAP) {
+            if (photonMapEnabled && gatheredPhotons > 0) gatherPhotons(gatheredPhotons);
+            if (globalPhotonMapEnabled && gatheredGlobalPhotons > 0) gatherGlobalPhotons(gatheredGlobalPhotons);
+            if (irradianceCache.isEnabled()) enableIrradianceCache(irradianceCacheError, finalGatherRays);
+            if (lightTree.isEnabled()) gatherVirtualLights(gatheredLightPaths, lightcutError);
+        }
+
+        return updated;
+    }
 }
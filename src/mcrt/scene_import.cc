@@ -1,6 +1,10 @@
 #include "mcrt/scene_import.hh"
 
+#include <cmath>
+#include <vector>
 #include <fstream>
+#include <sstream>
+#include <algorithm>
 #include <unordered_map>
 #include <stdexcept>
 #include "json.hh"
@@ -12,10 +16,118 @@
 #include "mcrt/camera.hh"
 #include "mcrt/mesh_import.hh"
 
+namespace {
+    // Camera block of the scene, i.e origin, fieldOfView (in degrees), lookAt and up.
+    void loadCamera(const nlohmann::json& camera, mcrt::Camera& sceneCamera) {
+        if (camera.find("origin") != camera.end()) {
+            glm::dvec3 origin;
+            origin.x = camera["origin"][0].get<double>();
+            origin.y = camera["origin"][1].get<double>();
+            origin.z = camera["origin"][2].get<double>();
+            sceneCamera.moveTo(origin);
+        }
+
+        if (camera.find("fieldOfView") != camera.end()) {
+            double toRadians { glm::pi<double>() / 180.0 };
+            double fieldOfView { camera["fieldOfView"].get<double>() };
+            sceneCamera.setFieldOfView(fieldOfView * toRadians);
+        }
+
+        glm::dvec3 lookAt { 0.0, 0.0, -1.0 },
+                   upVector { 0.0, 1.0, .0 };
+        if (camera.find("lookAt") != camera.end()) {
+            lookAt.x = camera["lookAt"][0].get<double>();
+            lookAt.y = camera["lookAt"][1].get<double>();
+            lookAt.z = camera["lookAt"][2].get<double>();
+        }
+
+        if (camera.find("up") != camera.end()) {
+            upVector.x = camera["up"][0].get<double>();
+            upVector.y = camera["up"][1].get<double>();
+            upVector.z = camera["up"][2].get<double>();
+        }
+
+        sceneCamera.lookAt(lookAt, upVector);
+    }
+
+    // Fields which a frame's camera doesn't have are the same as in "camera".
+    nlohmann::json mergeCamera(const nlohmann::json& base, const nlohmann::json& frame) {
+        nlohmann::json merged = base;
+        for (auto field = frame.begin(); field != frame.end(); ++field)
+            merged[field.key()] = field.value();
+        return merged;
+    }
+
+    glm::dvec3 toVector(const nlohmann::json& json) {
+        return { json[0].get<double>(), json[1].get<double>(), json[2].get<double>() };
+    }
+
+    // Cameras of the frames along a path, either straight between some key cameras
+    // (including the last one) or an orbit around a point (e.g a turntable), where
+    // the last frame stops short of the first, so that it can loop around smoothly.
+    std::vector<nlohmann::json> loadCameraPath(const nlohmann::json& base, const nlohmann::json& path) {
+        std::size_t frames { path["frames"].get<std::size_t>() };
+        std::vector<nlohmann::json> cameras;
+
+        if (path.find("keys") != path.end()) {
+            std::vector<nlohmann::json> keys;
+            for (const nlohmann::json& key : path["keys"]) keys.push_back(mergeCamera(base, key));
+            if (keys.empty()) throw std::runtime_error { "Error: the camera path needs keys!" };
+
+            for (std::size_t frame { 0 }; frame < frames; ++frame) {
+                double t { frames > 1 ? frame / (frames - 1.0) * (keys.size() - 1) : 0.0 };
+                std::size_t key = std::min<std::size_t>(t, keys.size() - 1);
+                std::size_t next = std::min<std::size_t>(key + 1, keys.size() - 1);
+                t -= key;
+
+                nlohmann::json camera = keys[key];
+                for (const char* field : { "origin", "lookAt", "up" }) {
+                    if (camera.find(field) == camera.end() || keys[next].find(field) == keys[next].end()) continue;
+                    glm::dvec3 value { glm::mix(toVector(keys[key][field]), toVector(keys[next][field]), t) };
+                    camera[field] = { value.x, value.y, value.z };
+                }
+
+                if (camera.find("fieldOfView") != camera.end() && keys[next].find("fieldOfView") != keys[next].end())
+                    camera["fieldOfView"] = glm::mix(keys[key]["fieldOfView"].get<double>(),
+                                                     keys[next]["fieldOfView"].get<double>(), t);
+                cameras.push_back(camera);
+            }
+        } else if (path.find("orbit") != path.end()) {
+            const nlohmann::json& orbit = path["orbit"];
+            glm::dvec3 center { toVector(orbit["center"]) };
+            glm::dvec3 origin { base.find("origin") != base.end() ? toVector(base["origin"]) : glm::dvec3 { 0.0 } };
+            glm::dvec3 axis { base.find("up") != base.end() ? toVector(base["up"]) : glm::dvec3 { 0.0, 1.0, 0.0 } };
+            axis = glm::normalize(axis);
+            double degrees { orbit.find("degrees") != orbit.end() ? orbit["degrees"].get<double>() : 360.0 };
+
+            for (std::size_t frame { 0 }; frame < frames; ++frame) {
+                double angle { glm::radians(degrees * frame / frames) };
+                // Rodrigues' rotation of the offset from the center, around the up axis.
+                glm::dvec3 offset { origin - center };
+                offset = offset * std::cos(angle) + glm::cross(axis, offset) * std::sin(angle)
+                       + axis * glm::dot(axis, offset) * (1.0 - std::cos(angle));
+
+                nlohmann::json camera = base;
+                glm::dvec3 position { center + offset };
+                camera["origin"] = { position.x, position.y, position.z };
+                camera["lookAt"] = { center.x, center.y, center.z };
+                cameras.push_back(camera);
+            }
+        } else throw std::runtime_error { "Error: the camera path needs keys or an orbit!" };
+
+        return cameras;
+    }
+}
+
 mcrt::Scene mcrt::SceneImporter::load(const std::string& file) {
     std::ifstream fileStream { file };
-    nlohmann::json parser;
-    fileStream >> parser;
+    std::stringstream contents;
+    contents << fileStream.rdbuf();
+    return parse(contents.str(), file);
+}
+
+mcrt::Scene mcrt::SceneImporter::parse(const std::string& json, const std::string& file) {
+    nlohmann::json parser = nlohmann::json::parse(json);
     mcrt::Scene scene;
 
     // Quick testing shows that this works on both Unix like
@@ -30,38 +142,26 @@ mcrt::Scene mcrt::SceneImporter::load(const std::string& file) {
     } else folderPath = "";
 
     if (parser.find("camera") != parser.end()) {
-        nlohmann::json camera { parser["camera"] };
-
-        if (camera[0].find("origin") != camera[0].end()) {
-            glm::dvec3 origin;
-            origin.x = camera[0]["origin"][0].get<double>();
-            origin.y = camera[0]["origin"][1].get<double>();
-            origin.z = camera[0]["origin"][2].get<double>();
-            scene.getCamera().moveTo(origin);
-        }
-
-        if (camera[0].find("fieldOfView") != camera[0].end()) {
-            double toRadians { glm::pi<double>() / 180.0 };
-            double fieldOfView { camera[0]["fieldOfView"].get<double>() };
-            scene.getCamera().setFieldOfView(fieldOfView * toRadians);
-        }
+        nlohmann::json camera = parser["camera"];
+        loadCamera(camera, scene.getCamera());
+    } else throw std::runtime_error { "Error: you must have a camera!" };
 
-        glm::dvec3 lookAt { 0.0, 0.0, -1.0 },
-                   upVector { 0.0, 1.0, .0 };
-        if (camera[0].find("lookAt") != camera[0].end()) {
-            lookAt.x = camera[0]["lookAt"][0].get<double>();
-            lookAt.y = camera[0]["lookAt"][1].get<double>();
-            lookAt.z = camera[0]["lookAt"][2].get<double>();
-        }
+    // Batch of frames, which are all rendered with the same scene one after another.
+    std::vector<nlohmann::json> frameCameras;
+    if (parser.find("cameras") != parser.end()) {
+        for (const nlohmann::json& camera : parser["cameras"])
+            frameCameras.push_back(mergeCamera(parser["camera"], camera));
+    }
 
-        if (camera[0].find("up") != camera[0].end()) {
-            upVector.x = camera[0]["up"][0].get<double>();
-            upVector.y = camera[0]["up"][1].get<double>();
-            upVector.z = camera[0]["up"][2].get<double>();
-        }
+    if (parser.find("cameraPath") != parser.end()) {
+        for (const nlohmann::json& camera : loadCameraPath(parser["camera"], parser["cameraPath"]))
+            frameCameras.push_back(camera);
+    }
 
-        scene.getCamera().lookAt(lookAt, upVector);
-    } else throw std::runtime_error { "Error: you must have a camera!" };
+    for (const nlohmann::json& camera : frameCameras) {
+        scene.getCameras().emplace_back();
+        loadCamera(camera, scene.getCameras().back());
+    }
 
     auto stringToLightType = [](const std::string& string) -> Light::Type {
         if (string == "point") return Light::Type::PointLight;
@@ -214,3 +314,7 @@ mcrt::Scene mcrt::SceneImporter::load(const std::string& file) {
 
     return scene;
 }
+
+void mcrt::SceneImporter::parseCamera(const std::string& json, Camera& camera) {
+    loadCamera(nlohmann::json::parse(json), camera);
+}
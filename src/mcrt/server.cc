@@ -0,0 +1,312 @@
+#include "mcrt/server.hh"
+#include "mcrt/mesh.hh"
+#include "mcrt/sampling.hh"
+#include "mcrt/mesh_cache.hh"
+#include "mcrt/mapped_file.hh"
+#include "mcrt/scene_import.hh"
+#include "mcrt/param_import.hh"
+#include "mcrt/image_export.hh"
+
+#include <chrono>
+#include <limits>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <stdexcept>
+#include <glm/gtc/constants.hpp>
+#include "json.hh"
+
+#ifndef WINDOWS
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/socket.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // Only for clients that hang up mid-render.
+#endif
+
+namespace {
+    std::string readFile(const std::string& path) {
+        std::ifstream fileStream { path };
+        if (!fileStream) throw std::runtime_error { "Could not open '" + path + "'!" };
+        std::stringstream contents;
+        contents << fileStream.rdbuf();
+        return contents.str();
+    }
+
+    // Everything that changes what Renderer::prepare (and the importer) leaves behind.
+    std::size_t sceneKey(const std::string& scenePath, const std::string& sceneFile,
+                         const mcrt::Parameters& parameters) {
+        std::ostringstream key;
+        key << scenePath << '\n' << sceneFile << '\n'; // Meshes are relative to it.
+
+        // Meshes can be edited without the scene, so their bytes count too (hashing them
+        // is still a lot faster than parsing them again).
+        nlohmann::json scene = nlohmann::json::parse(sceneFile);
+        std::size_t folderPathIndex { scenePath.find_last_of("/\\") };
+        std::string folderPath { folderPathIndex != std::string::npos ? scenePath.substr(0, folderPathIndex + 1) : "" };
+        if (scene.find("surfaces") != scene.end()) {
+            for (const nlohmann::json& surface : scene["surfaces"]) {
+                if (surface["geometry"].get<std::string>() != "mesh") continue;
+                const mcrt::MappedFile mesh { folderPath + surface["file"].get<std::string>() };
+                key << mcrt::MeshCache::hash(mesh.getData(), mesh.getSize()) << '\n';
+            }
+        }
+
+        key << parameters.maxRayDepth << ' ' << parameters.shadowRayCount << ' '
+            << parameters.photonMap << ' ' << parameters.photonAmount << ' '
+            << parameters.globalPhotonMap << ' ' << parameters.globalPhotonAmount << ' '
+            << parameters.irradianceCache << ' ' << parameters.irradianceCacheError << ' '
+            << parameters.finalGatherRays << ' ' << parameters.virtualLights << ' '
+            << parameters.virtualLightPaths << ' ' << parameters.lightcutError;
+        return std::hash<std::string> {  }(key.str());
+    }
+
+    glm::dvec3 vector(const nlohmann::json& json) {
+        return { json[0].get<double>(), json[1].get<double>(), json[2].get<double>() };
+    }
+
+    const char* invalidationName(mcrt::Scene::Invalidation invalidation) {
+        switch (invalidation) {
+        case mcrt::Scene::Invalidation::NOTHING: return "nothing";
+        case mcrt::Scene::Invalidation::ACCUMULATION: return "accumulation";
+        case mcrt::Scene::Invalidation::PHOTON_MAP: return "photon-map";
+        case mcrt::Scene::Invalidation::GEOMETRY: return "geometry";
+        }
+
+        return "nothing";
+    }
+
+    // One of the edits of a job, only the common look-dev ones, see the header.
+    void edit(mcrt::Scene& scene, const nlohmann::json& change) {
+        // Any edit can say it invalidates less (or more) than what's assumed.
+        auto level = [&change](mcrt::Scene::Invalidation assumed) {
+            if (change.find("invalidates") == change.end()) return assumed;
+            std::string name = change["invalidates"].get<std::string>();
+            for (auto invalidation : { mcrt::Scene::Invalidation::NOTHING, mcrt::Scene::Invalidation::ACCUMULATION,
+                                       mcrt::Scene::Invalidation::PHOTON_MAP, mcrt::Scene::Invalidation::GEOMETRY })
+                if (name == invalidationName(invalidation)) return invalidation;
+            throw std::runtime_error { "Unknown invalidation '" + name + "'!" };
+        };
+
+        if (change.find("material") != change.end()) {
+            scene.editMaterial(change["material"].get<std::size_t>(), [&change](mcrt::Material& material) {
+                if (change.find("color") != change.end()) material.color = vector(change["color"]);
+                if (change.find("reflectionRate") != change.end())
+                    material.reflectionRate = change["reflectionRate"].get<double>();
+                if (change.find("refractionIndex") != change.end())
+                    material.refractionIndex = change["refractionIndex"].get<double>();
+            }, level(mcrt::Scene::Invalidation::PHOTON_MAP));
+        } else if (change.find("light") != change.end()) {
+            scene.editLight(change["light"].get<std::size_t>(), [&change](mcrt::Light& light) {
+                if (change.find("intensity") != change.end())
+                    light.intensity = change["intensity"].get<double>();
+            }, level(mcrt::Scene::Invalidation::PHOTON_MAP));
+        } else if (change.find("geometry") != change.end()) {
+            scene.editGeometry(change["geometry"].get<std::size_t>(), [&change](mcrt::Geometry& geometry) {
+                mcrt::Mesh* mesh = dynamic_cast<mcrt::Mesh*>(&geometry);
+                if (mesh == nullptr) throw std::runtime_error { "Only meshes can be transformed!" };
+                double toRadians { glm::pi<double>() / 180.0 };
+                if (change.find("scale") != change.end()) mesh->scale(change["scale"].get<double>());
+                if (change.find("rotate") != change.end()) {
+                    glm::dvec3 rotation { vector(change["rotate"]) * toRadians };
+                    mesh->rotateX(rotation.x);
+                    mesh->rotateY(rotation.y);
+                    mesh->rotateZ(rotation.z);
+                }
+
+                if (change.find("move") != change.end()) mesh->move(vector(change["move"]));
+            }, level(mcrt::Scene::Invalidation::GEOMETRY));
+        } else throw std::runtime_error { "Unknown edit '" + change.dump() + "'!" };
+    }
+
+    void reply(int client, const nlohmann::json& message) {
+        std::string line { message.dump() + "\n" };
+#ifndef WINDOWS
+        std::size_t sent { 0 };
+        while (sent < line.size()) {
+            ssize_t bytes = send(client, line.data() + sent, line.size() - sent, MSG_NOSIGNAL);
+            if (bytes <= 0) return; // Client is gone, the render still finishes.
+            sent += bytes;
+        }
+#else
+        (void)client;
+#endif
+    }
+}
+
+mcrt::Server::Server(const std::string& path) : path { path } {
+#ifndef WINDOWS
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+        throw std::runtime_error { "Socket path '" + path + "' is too long!" };
+    std::strcpy(address.sun_path, path.c_str());
+
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) throw std::runtime_error { "Could not create a socket!" };
+    unlink(path.c_str()); // Left behind by an earlier server.
+    if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0
+        || listen(listener, 8) < 0) {
+        close(listener);
+        throw std::runtime_error { "Could not listen on '" + path + "'!" };
+    }
+#else
+    throw std::runtime_error { "The server needs Unix sockets!" };
+#endif
+}
+
+mcrt::Server::~Server() {
+#ifndef WINDOWS
+    if (listener >= 0) {
+        close(listener);
+        unlink(path.c_str());
+    }
+#endif
+}
+
+void mcrt::Server::run() {
+#ifndef WINDOWS
+    while (true) {
+        int client = accept(listener, nullptr, nullptr);
+        if (client < 0) continue;
+        bool running { serve(client) };
+        close(client);
+        if (!running) return;
+    }
+#endif
+}
+
+// Reads jobs off the connection until it's closed, false if asked to shut down.
+bool mcrt::Server::serve(int client) {
+#ifndef WINDOWS
+    std::string buffer;
+    char chunk[4096];
+    ssize_t bytes;
+    while ((bytes = recv(client, chunk, sizeof(chunk), 0)) > 0) {
+        buffer.append(chunk, bytes);
+        std::size_t newline;
+        while ((newline = buffer.find('\n')) != std::string::npos) {
+            std::string line { buffer.substr(0, newline) };
+            buffer.erase(0, newline + 1);
+            if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+
+            try {
+                if (!handle(client, line)) return false;
+            } catch (const std::exception& error) {
+                std::cerr << "Error: " << error.what() << std::endl;
+                reply(client, { { "status", "error" }, { "message", error.what() } });
+            }
+        }
+    }
+#else
+    (void)client;
+#endif
+    return true;
+}
+
+bool mcrt::Server::handle(int client, const std::string& line) {
+    nlohmann::json job = nlohmann::json::parse(line);
+    if (job.find("shutdown") != job.end() && job["shutdown"].get<bool>()) {
+        reply(client, { { "status", "shutdown" } });
+        return false;
+    }
+
+    auto jobStart { std::chrono::steady_clock::now() };
+    std::string scenePath = job.at("scene").get<std::string>(),
+                output = job.at("output").get<std::string>();
+
+    // Either a path to the parameter file, or the parameters themselves.
+    std::string parameterFile;
+    if (job.find("parameters") != job.end()) {
+        const nlohmann::json& parameterJob = job["parameters"];
+        if (parameterJob.is_string()) parameterFile = readFile(parameterJob.get<std::string>());
+        else parameterFile = parameterJob.dump();
+    }
+
+    Parameters parameters;
+    if (!parameterFile.empty()) parameters = ParameterImporter::parse(parameterFile);
+
+    bool cached;
+    CachedScene& entry { fetch(scenePath, parameters, cached) };
+    Renderer& renderer { *entry.renderer };
+    Scene& scene { renderer.getScene() };
+    bool sameParameters { renderer.getParameterFile() == parameterFile };
+    if (!sameParameters) renderer.setParameters(parameters, parameterFile);
+
+    // The camera is always relative to the file's, not to the last job's camera.
+    std::string cameraJob;
+    if (job.find("camera") != job.end()) cameraJob = job["camera"].dump();
+    if (cameraJob != entry.lastCamera) {
+        scene.editCamera([&](Camera& camera) {
+            camera = entry.camera;
+            if (!cameraJob.empty()) SceneImporter::parseCamera(cameraJob, camera);
+        });
+        entry.lastCamera = cameraJob;
+    }
+
+    if (job.find("edits") != job.end())
+        for (const nlohmann::json& change : job["edits"]) edit(scene, change);
+
+    // Only has to pay for what the edits (or the new camera) actually changed. Any
+    // photon maps or virtual lights traced again are the same for the same seed.
+    sampling::seed(renderer.getSeed(), Renderer::PREPASS_STREAM);
+    Scene::Invalidation invalidated { scene.update() };
+    bool accumulate { job.find("accumulate") != job.end() && job["accumulate"].get<bool>()
+                      && invalidated < Scene::Invalidation::ACCUMULATION && sameParameters };
+    if (!accumulate) renderer.reset();
+
+    Image preview { renderer.getWidth(), renderer.getHeight() };
+    renderer.render(parameters.samplesPerPixel, [&](std::size_t pass, std::size_t passes) {
+        if (parameters.progressiveRendering) {
+            renderer.develop(preview);
+            ImageExporter::save(preview, output);
+        }
+
+        reply(client, { { "status", "progress" }, { "pass", pass },
+                        { "passes", passes }, { "output", output } });
+    });
+
+    renderer.save(output);
+    std::chrono::duration<double> jobDuration { std::chrono::steady_clock::now() - jobStart };
+    if (parameters.recordStatistics) parameters.writeStatistics(output, jobDuration.count());
+    reply(client, { { "status", "done" }, { "output", output }, { "cached", cached },
+                    { "invalidated", invalidationName(invalidated) },
+                    { "accumulated", accumulate }, { "seconds", jobDuration.count() } });
+    return true;
+}
+
+mcrt::Server::CachedScene& mcrt::Server::fetch(const std::string& scenePath,
+                                               const Parameters& parameters, bool& cached) {
+    std::string sceneFile { readFile(scenePath) };
+    std::size_t key { sceneKey(scenePath, sceneFile, parameters) };
+    auto found = scenes.find(key);
+    cached = found != scenes.end();
+    if (cached) {
+        found->second.lastUsed = ++jobs;
+        return found->second;
+    }
+
+    if (scenes.size() >= MAX_SCENES) {
+        auto oldest = scenes.begin();
+        for (auto it = scenes.begin(); it != scenes.end(); ++it)
+            if (it->second.lastUsed < oldest->second.lastUsed) oldest = it;
+        scenes.erase(oldest);
+    }
+
+    std::unique_ptr<Renderer> renderer { new Renderer };
+    renderer->setScene(SceneImporter::parse(sceneFile, scenePath));
+    renderer->setParameters(parameters);
+    Camera camera { renderer->getScene().getCamera() };
+    renderer->prepare();
+
+    CachedScene& entry { scenes[key] };
+    entry.renderer = std::move(renderer);
+    entry.camera = camera;
+    entry.lastUsed = ++jobs;
+    return entry;
+}
@@ -0,0 +1,138 @@
+#include "mcrt/simd.hh"
+#include "mcrt/simd_kernel.hh"
+
+#include <limits>
+
+namespace {
+    // Möller–Trumbore like in Triangle, in Real (see precision.hh), one at a time.
+    void intersectScalar(const mcrt::simd::Triangles& triangles, std::size_t begin, std::size_t end,
+                         const mcrt::Vector3& origin, const mcrt::Vector3& direction, mcrt::Ray::Hit& closest) {
+        using mcrt::Real;
+        using mcrt::Vector3;
+        const float *x0 { triangles.x[0] }, *y0 { triangles.y[0] }, *z0 { triangles.z[0] },
+                    *x1 { triangles.x[1] }, *y1 { triangles.y[1] }, *z1 { triangles.z[1] },
+                    *x2 { triangles.x[2] }, *y2 { triangles.y[2] }, *z2 { triangles.z[2] };
+        const Real epsilon { mcrt::Ray::EPSILON };
+        Real closestDistance { closest.distance < std::numeric_limits<Real>::max()
+                             ? static_cast<Real>(closest.distance) : std::numeric_limits<Real>::max() };
+
+        for (std::size_t t = begin; t < end; ++t) {
+            Vector3 v0 { x0[t], y0[t], z0[t] };
+            Vector3 e1 { x1[t] - v0.x, y1[t] - v0.y, z1[t] - v0.z };
+            Vector3 e2 { x2[t] - v0.x, y2[t] - v0.y, z2[t] - v0.z };
+
+            Vector3 pvec = glm::cross(direction, e2);
+            Real det = glm::dot(e1, pvec);
+            if (det < epsilon && det > -epsilon) continue;
+
+            Real inv_det = 1 / det;
+            Vector3 tvec = origin - v0;
+            Real u = glm::dot(tvec, pvec) * inv_det;
+            if (u < 0 || u > 1) continue;
+
+            Vector3 qvec = glm::cross(tvec, e1);
+            Real v = glm::dot(direction, qvec) * inv_det;
+            if (v < 0 || u + v > 1) continue;
+
+            Real distance = glm::dot(e2, qvec) * inv_det;
+            if (distance > 0 && distance < closestDistance) {
+                closestDistance = distance;
+                closest = { distance, t, u, v };
+            }
+        }
+    }
+
+    // The nodes are still tested many at a time, since the vectors of the default
+    // flags are as wide as a BVH4, but the triangles in the leaves one at a time.
+    void intersectBvhScalar(const mcrt::Bvh& bvh, const mcrt::simd::Triangles& triangles,
+                            const mcrt::Vector3& origin, const mcrt::Vector3& direction, mcrt::Ray::Hit& closest) {
+        using mcrt::simd::traverseWide;
+        if (bvh.getLayout() == mcrt::Bvh::Layout::BVH4)
+            traverseWide(bvh.getNodes4(), triangles, origin, direction, closest, intersectScalar);
+        else
+            traverseWide(bvh.getNodes8(), triangles, origin, direction, closest, intersectScalar);
+    }
+
+    bool isAvailable(mcrt::simd::Isa isa) {
+        switch (isa) {
+        case mcrt::simd::Isa::SCALAR:
+        case mcrt::simd::Isa::SSE:
+            return true;
+#if defined(__x86_64__) || defined(__i386__)
+        // Also checks that the OS saves the wider registers.
+        case mcrt::simd::Isa::AVX2:
+            return __builtin_cpu_supports("avx2");
+        case mcrt::simd::Isa::AVX512:
+            return __builtin_cpu_supports("avx512f");
+#endif
+        default:
+            return false;
+        }
+    }
+
+    mcrt::simd::Isa detect() {
+        mcrt::simd::Isa best { mcrt::simd::Isa::SCALAR };
+        for (mcrt::simd::Isa isa : mcrt::simd::getSupported()) best = isa;
+        return best;
+    }
+}
+
+mcrt::simd::Isa mcrt::simd::getIsa() {
+    static const Isa isa { detect() };
+    return isa;
+}
+
+std::vector<mcrt::simd::Isa> mcrt::simd::getSupported() {
+    std::vector<Isa> supported;
+    for (Isa isa : { Isa::SCALAR, Isa::SSE, Isa::AVX2, Isa::AVX512 })
+        if (isAvailable(isa)) supported.push_back(isa);
+    return supported;
+}
+
+mcrt::simd::Kernel mcrt::simd::getKernel(Isa isa) {
+    if (!isAvailable(isa)) return nullptr;
+    switch (isa) {
+    case Isa::SCALAR: return intersectScalar;
+    case Isa::SSE:    return intersectSse;
+    case Isa::AVX2:   return intersectAvx2;
+    case Isa::AVX512: return intersectAvx512;
+    default:          return nullptr;
+    }
+}
+
+mcrt::simd::BvhKernel mcrt::simd::getBvhKernel(Isa isa) {
+    if (!isAvailable(isa)) return nullptr;
+    switch (isa) {
+    case Isa::SCALAR: return intersectBvhScalar;
+    case Isa::SSE:    return intersectBvhSse;
+    case Isa::AVX2:   return intersectBvhAvx2;
+    case Isa::AVX512: return intersectBvhAvx512;
+    default:          return nullptr;
+    }
+}
+
+mcrt::simd::PacketKernel mcrt::simd::getPacketKernel(Isa isa) {
+    if (!isAvailable(isa)) return nullptr;
+    switch (isa) {
+    case Isa::SSE:    return intersectPacketSse;
+    case Isa::AVX2:   return intersectPacketAvx2;
+    case Isa::AVX512: return intersectPacketAvx512;
+    default:          return nullptr; // The rays are traced one by one instead.
+    }
+}
+
+const char* mcrt::simd::getName(Isa isa) {
+    switch (isa) {
+    case Isa::SCALAR: return "scalar";
+    case Isa::SSE:    return "sse";
+    case Isa::AVX2:   return "avx2";
+    case Isa::AVX512: return "avx512";
+    default:          return "unknown";
+    }
+}
+
+void mcrt::simd::intersect(const Triangles& triangles, std::size_t begin, std::size_t end,
+                           const Vector3& origin, const Vector3& direction, Ray::Hit& closest) {
+    static const Kernel kernel { getKernel(getIsa()) };
+    kernel(triangles, begin, end, origin, direction, closest);
+}
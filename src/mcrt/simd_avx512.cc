@@ -0,0 +1,18 @@
+#define MCRT_SIMD_AVX512
+#include "mcrt/simd_kernel.hh"
+
+// Its kernels are built for AVX-512, so this may only be called when the CPU has it, see simd.cc.
+void mcrt::simd::intersectAvx512(const Triangles& triangles, std::size_t begin, std::size_t end,
+                                 const Vector3& origin, const Vector3& direction, Ray::Hit& closest) {
+    intersectWide<Real, 64 / sizeof(Real)>(triangles, begin, end, origin, direction, closest);
+}
+
+void mcrt::simd::intersectBvhAvx512(const Bvh& bvh, const Triangles& triangles,
+                                    const Vector3& origin, const Vector3& direction, Ray::Hit& closest) {
+    intersectBvh<Real, 64 / sizeof(Real)>(bvh, triangles, origin, direction, closest);
+}
+
+void mcrt::simd::intersectPacketAvx512(const Bvh& bvh, const Triangles& triangles,
+                                       const Packet& packet, Ray::Hit* hits) {
+    intersectPacket<Real, 64 / sizeof(Real)>(bvh, triangles, packet, hits);
+}
@@ -0,0 +1,18 @@
+#include "mcrt/simd_kernel.hh"
+
+// Built with the default flags, which has SSE2 on every x86-64 (and becomes NEON
+// or even plain scalar code elsewhere), so it's always there to fall back to.
+void mcrt::simd::intersectSse(const Triangles& triangles, std::size_t begin, std::size_t end,
+                              const Vector3& origin, const Vector3& direction, Ray::Hit& closest) {
+    intersectWide<Real, 16 / sizeof(Real)>(triangles, begin, end, origin, direction, closest);
+}
+
+void mcrt::simd::intersectBvhSse(const Bvh& bvh, const Triangles& triangles,
+                                 const Vector3& origin, const Vector3& direction, Ray::Hit& closest) {
+    intersectBvh<Real, 16 / sizeof(Real)>(bvh, triangles, origin, direction, closest);
+}
+
+void mcrt::simd::intersectPacketSse(const Bvh& bvh, const Triangles& triangles,
+                                    const Packet& packet, Ray::Hit* hits) {
+    intersectPacket<Real, 16 / sizeof(Real)>(bvh, triangles, packet, hits);
+}
@@ -6,9 +6,8 @@ namespace mcrt {
 
 
     // Return distance from ray origin to sphere, distance = 0 means no intersection.
-    Ray::Intersection Sphere::intersect(const Ray& ray) const{
-        Ray::Intersection result { 0, { 0.0, 0.0, 0.0 },
-                                   material, {0.0, 0.0, 0.0}};
+    Ray::Hit Sphere::hit(const Ray& ray) const{
+        Ray::Hit result;
 
         double t0,t1;
         glm::dvec3 L = _origin - ray.origin;
@@ -40,9 +39,12 @@ namespace mcrt {
         }
 
         result.distance = t0;
-        result.normal = glm::normalize((ray.origin + ray.direction * t0) - _origin);
-        result.position = ray.origin + ray.direction * t0;
         return result;
     }
 
+    Ray::Intersection Sphere::interact(const Ray& ray, const Ray::Hit& hit) const {
+        glm::dvec3 position { ray.origin + ray.direction * hit.distance };
+        return {hit.distance, glm::normalize(position - _origin), material, position};
+    }
+
 }
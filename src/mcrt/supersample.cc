@@ -2,42 +2,59 @@
 
 #include <cmath>
 #include <stdexcept>
+#include <glm/gtc/constants.hpp>
+
+#include "mcrt/sampling.hh"
 
 glm::dvec3 mcrt::Supersampler::next(Camera::SamplingPlane& samplingPlane, size_t currentSample) const {
+    return position(samplingPlane, offset(currentSample));
+}
+
+glm::dvec2 mcrt::Supersampler::offset(size_t currentSample) const {
     switch (pattern) {
     case Pattern::GRID:
-        if (samplingAmount == 1) return (samplingPlane.corners[0] + samplingPlane.corners[2]) / 2.0;
-        else return grid(samplingPlane, currentSample); // Otherwise, we sample pixel using an grid.
-    case Pattern::RANDOM: return prng(samplingPlane, currentSample);
-    case Pattern::GAUSSIAN: return norm(samplingPlane, currentSample);
+        if (samplingAmount == 1 && currentSample == 0) return glm::dvec2 { 0.5, 0.5 };
+        else return grid(currentSample); // Otherwise, we sample pixel using an grid.
+    case Pattern::RANDOM: return prng(currentSample);
+    case Pattern::GAUSSIAN: return norm(currentSample);
     default: throw std::runtime_error { "Error: a unknown pattern!" };
     }
 }
 
-glm::dvec3 mcrt::Supersampler::grid(Camera::SamplingPlane& samplingPlane, size_t currentSample) const {
+glm::dvec3 mcrt::Supersampler::position(Camera::SamplingPlane& samplingPlane, const glm::dvec2& offset) const {
     glm::dvec3 xViewPlaneAxis { samplingPlane.corners[1] - samplingPlane.corners[0] },
                yViewPlaneAxis { samplingPlane.corners[3] - samplingPlane.corners[0] };
+    return samplingPlane.corners[0] + xViewPlaneAxis*offset.x
+                                    + yViewPlaneAxis*offset.y;
+}
+
+glm::dvec2 mcrt::Supersampler::grid(size_t currentSample) const {
+    // Any samples past the grid (when continuing a render) go around once again.
+    size_t round { currentSample / samplingAmount };
+    currentSample %= samplingAmount;
     double ySampleAxisWeight = std::floor(currentSample / samplingWidth),
            xSampleAxisWeight = currentSample - ySampleAxisWeight*samplingWidth;
+    if (round > 0) { // But shifted inside of the cells by the R2 sequence, so they don't repeat.
+        xSampleAxisWeight += std::fmod(0.5 + round * 0.7548776662466927, 1.0);
+        ySampleAxisWeight += std::fmod(0.5 + round * 0.5698402909980532, 1.0);
+    }
+
     ySampleAxisWeight /= samplingWidth; xSampleAxisWeight /= samplingWidth;
-    return samplingPlane.corners[0] + xViewPlaneAxis*xSampleAxisWeight
-                                    + yViewPlaneAxis*ySampleAxisWeight;
+    return { xSampleAxisWeight, ySampleAxisWeight };
 }
 
-glm::dvec3 mcrt::Supersampler::prng(Camera::SamplingPlane& samplingPlane, size_t) const {
-    glm::dvec3 xViewPlaneAxis { samplingPlane.corners[1] - samplingPlane.corners[0] },
-               yViewPlaneAxis { samplingPlane.corners[3] - samplingPlane.corners[0] };
-    double xSampleAxisWeight { uniform(randomNumberGenerator) },
-           ySampleAxisWeight { uniform(randomNumberGenerator) };
-    return samplingPlane.corners[0] + xViewPlaneAxis*xSampleAxisWeight
-                                    + yViewPlaneAxis*ySampleAxisWeight;
+// Both draw from the thread's own generator, which is seeded for every tile.
+glm::dvec2 mcrt::Supersampler::prng(size_t) const {
+    double xSampleAxisWeight { sampling::uniform() },
+           ySampleAxisWeight { sampling::uniform() };
+    return { xSampleAxisWeight, ySampleAxisWeight };
 }
 
-glm::dvec3 mcrt::Supersampler::norm(Camera::SamplingPlane& samplingPlane, size_t) const {
-    glm::dvec3 xViewPlaneAxis { samplingPlane.corners[1] - samplingPlane.corners[0] },
-               yViewPlaneAxis { samplingPlane.corners[3] - samplingPlane.corners[0] };
-    double xSampleAxisWeight { gaussian(randomNumberGenerator) },
-           ySampleAxisWeight { gaussian(randomNumberGenerator) };
-    return samplingPlane.corners[0] + xViewPlaneAxis*xSampleAxisWeight
-                                    + yViewPlaneAxis*ySampleAxisWeight;
+glm::dvec2 mcrt::Supersampler::norm(size_t) const {
+    // Box-Muller, centered on the pixel with a standard deviation of half a pixel.
+    double radius { std::sqrt(-2.0 * std::log(1.0 - sampling::uniform())) },
+           angle { 2.0 * glm::pi<double>() * sampling::uniform() };
+    double xSampleAxisWeight { 0.5 + 0.5 * radius * std::cos(angle) },
+           ySampleAxisWeight { 0.5 + 0.5 * radius * std::sin(angle) };
+    return { xSampleAxisWeight, ySampleAxisWeight };
 }
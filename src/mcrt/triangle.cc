@@ -2,22 +2,15 @@
 
 namespace mcrt {
     Triangle::Triangle(const glm::dvec3& v1, const glm::dvec3& v2, const glm::dvec3& v3, Material* m)
-        : Geometry { m }, _v1 { v1 }, _v2 { v2 } , _v3 { v3 }  { }
+        : Geometry { m }, _v1 { v1 }, _v2 { v2 } , _v3 { v3 },
+          _e1 { v2 - v1 }, _e2 { v3 - v1 }, _normal { glm::normalize(glm::cross(_e1, _e2)) } { }
 
     // Returns distance from ray to triangle, 0 means no intersection.
-    Ray::Intersection Triangle::intersect(const Ray& ray) const {
-        glm::dvec3 e1 = _v2 - _v1;
-        glm::dvec3 e2 = _v3 - _v1;
-
-        // Surface normal I think
-        glm::dvec3 pvec = glm::cross(ray.direction,e2);
-        double det = glm::dot(e1,pvec);
-
-        glm::dvec3 normal { glm::normalize(glm::cross(e1, e2)) };
-        if (glm::dot(normal, ray.direction) > 0) normal = -normal;
-
-        Ray::Intersection result {0, normal, material, glm::dvec3()};
+    Ray::Hit Triangle::hit(const Ray& ray) const {
+        Ray::Hit result;
 
+        glm::dvec3 pvec = glm::cross(ray.direction,_e2);
+        double det = glm::dot(_e1,pvec);
         if(det < Ray::EPSILON && det > -Ray::EPSILON) {
             return result;
         }
@@ -29,15 +22,21 @@ namespace mcrt {
             return result;
         }
 
-        glm::dvec3 qvec = glm::cross(tvec,e1);
+        glm::dvec3 qvec = glm::cross(tvec,_e1);
         double v = glm::dot(ray.direction, qvec) * inv_det;
         if(v < 0.0 || u + v > 1.0) {
             return result;
         }
 
-        result.distance = glm::dot(e2,qvec) * inv_det;
-        result.material = material;
-        result.position = ray.origin + ray.direction * result.distance;
+        result.distance = glm::dot(_e2,qvec) * inv_det;
+        result.u = u;
+        result.v = v;
         return result;
     }
+
+    Ray::Intersection Triangle::interact(const Ray& ray, const Ray::Hit& hit) const {
+        // Facing the ray, so both sides are the same.
+        glm::dvec3 normal { glm::dot(_normal, ray.direction) > 0 ? -_normal : _normal };
+        return {hit.distance, normal, material, ray.origin + ray.direction * hit.distance};
+    }
 }
@@ -0,0 +1,17 @@
+// BDPT has its own light sampling and emission, which have to match the path tracer's,
+// also with lights brighter than their color (share/cornell.json has intensity 10).
+
+#include "tests.hh"
+
+bool tests::bidirectional() {
+    bool passed { true };
+    for (const std::string scene : { "share/scene.json", "share/cornell.json" }) {
+        mcrt::Parameters parameters;
+        parameters.samplesPerPixel = 64;
+        double path { render(parameters, scene) };
+        parameters.integrator = mcrt::Parameters::Integrator::BIDIRECTIONAL;
+        passed &= sameMean("BDPT on " + scene, render(parameters, scene), path);
+    }
+
+    return passed;
+}
@@ -0,0 +1,8 @@
+#include "tests.hh"
+
+int main() {
+    bool passed { true };
+    passed &= tests::metropolis();
+    passed &= tests::bidirectional();
+    return passed ? 0 : 1;
+}
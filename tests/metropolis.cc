@@ -0,0 +1,11 @@
+// MLT only gets its brightness from the bootstrap, so it has to match the path tracer.
+
+#include "tests.hh"
+
+bool tests::metropolis() {
+    mcrt::Parameters parameters;
+    parameters.samplesPerPixel = 16;
+    double path { render(parameters) };
+    parameters.integrator = mcrt::Parameters::Integrator::METROPOLIS;
+    return sameMean("MLT", render(parameters), path);
+}
@@ -0,0 +1,46 @@
+#ifndef MCRT_TESTS_HH
+#define MCRT_TESTS_HH
+
+#include "mcrt/renderer.hh"
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <iostream>
+
+// Checks for bin/tests, which are all run by tests/main.cc. They render the scenes in
+// share, so they have to be run from the root of the repository, e.g by make test.
+namespace tests {
+    // Small and quick render of the scene, with its mean over all of the pixels.
+    inline double render(mcrt::Parameters parameters, const std::string& scene = "share/scene.json") {
+        parameters.parallelFramework = mcrt::Parameters::ParallelFramework::OPENMP;
+        parameters.resolutionWidth = parameters.resolutionHeight = 32;
+        parameters.progressiveRendering = false;
+        parameters.seed = 1;
+
+        mcrt::Renderer renderer;
+        renderer.loadScene(scene);
+        renderer.setParameters(parameters);
+        renderer.render(parameters.samplesPerPixel);
+
+        std::vector<float> pixels(renderer.getWidth() * renderer.getHeight() * 4);
+        renderer.develop(pixels.data());
+        double sum { 0.0 };
+        for (std::size_t i { 0 }; i < pixels.size(); i += 4)
+            sum += (pixels[i + 0] + pixels[i + 1] + pixels[i + 2]) / 3.0;
+        return sum / (renderer.getWidth() * renderer.getHeight());
+    }
+
+    // Integrators which converge to the same image have about the same mean.
+    inline bool sameMean(const std::string& name, double mean, double expected, double tolerance = 0.05) {
+        std::cout << "Mean of the path tracer: " << expected << ", and of " << name << ": " << mean << std::endl;
+        if (std::abs(mean - expected) <= tolerance * expected) return true;
+        std::cerr << "Error: " << name << " isn't as bright as the path tracer!" << std::endl;
+        return false;
+    }
+
+    bool metropolis();
+    bool bidirectional();
+}
+
+#endif